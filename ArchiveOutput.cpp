@@ -0,0 +1,360 @@
+//
+// Bulk output streamed into tar or zip archives instead of one file per image.
+//
+
+#include "ArchiveOutput.hpp"
+#include "PngChecksum.hpp"
+#include "QrToPng.h"
+
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+namespace {
+    // stdio buffer per archive: every write() to the OS is this large
+    constexpr size_t WRITE_BUFFER_SIZE = 1 << 20;
+
+    constexpr uint64_t TAR_BLOCK = 512;
+
+    uint64_t tar_padded(uint64_t n) {
+        return (n + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+    }
+
+    void put_le16(std::vector<uint8_t> &out, uint16_t v) {
+        out.push_back(static_cast<uint8_t>(v));
+        out.push_back(static_cast<uint8_t>(v >> 8));
+    }
+
+    void put_le32(std::vector<uint8_t> &out, uint32_t v) {
+        for (int i = 0; i < 4; i++)
+            out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    void put_le64(std::vector<uint8_t> &out, uint64_t v) {
+        for (int i = 0; i < 8; i++)
+            out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    // fixed part of the zip records, without names and extra fields
+    constexpr uint64_t ZIP_LOCAL_HEADER = 30;
+    constexpr uint64_t ZIP_CENTRAL_HEADER = 46;
+    constexpr uint64_t ZIP_ZIP64_OFFSET_EXTRA = 12;
+    constexpr uint64_t ZIP_END_RECORDS = 56 + 20 + 22; // Zip64 end record, Zip64 locator, end record
+
+#if defined(_WIN32)
+    int seek(std::FILE *f, uint64_t offset, int whence) { return ::_fseeki64(f, static_cast<long long>(offset), whence); }
+#else
+    int seek(std::FILE *f, uint64_t offset, int whence) { return ::fseeko(f, static_cast<off_t>(offset), whence); }
+#endif
+}
+
+/*---- ArchiveOutput ----*/
+
+ArchiveOutput::Format ArchiveOutput::formatFor(const std::string &path) {
+    std::string ext = fs::path(path).extension().string();
+    return ext == ".zip" || ext == ".ZIP" ? Format::Zip : Format::Tar;
+}
+
+std::unique_ptr<ArchiveOutput> ArchiveOutput::create(Format format, const std::string &path, uint64_t shardSize) {
+    std::unique_ptr<ArchiveOutput> out;
+    if (format == Format::Zip)
+        out.reset(new ZipOutput(path, shardSize));
+    else
+        out.reset(new TarOutput(path, shardSize));
+    if (!out->_open())
+        throw std::runtime_error("Cannot create " + out->_files.back());
+    return out;
+}
+
+ArchiveOutput::ArchiveOutput(std::string path, uint64_t shardSize) : _path(std::move(path)), _shardSize(shardSize) {
+}
+
+ArchiveOutput::~ArchiveOutput() {
+    if (_file)
+        std::fclose(_file); // finish() was not called: the archive stays incomplete
+}
+
+bool ArchiveOutput::_open() {
+    std::string name = _path;
+    if (_shardSize > 0) {
+        fs::path p(_path);
+        char number[16];
+        std::snprintf(number, sizeof(number), "-%05zu", _files.size());
+        name = (p.parent_path() / (p.stem().string() + number + p.extension().string())).string();
+    }
+    _files.push_back(name);
+    _file = std::fopen(name.c_str(), "w+b"); // readable for links, see _get()
+    if (!_file)
+        return false;
+    std::setvbuf(_file, nullptr, _IOFBF, WRITE_BUFFER_SIZE);
+    _offset = 0;
+    _entries = 0;
+    _names.clear();
+    _reset();
+    return true;
+}
+
+bool ArchiveOutput::_close() {
+    bool ok = _writeTrailer();
+    ok = std::fclose(_file) == 0 && ok;
+    _file = nullptr;
+    return ok;
+}
+
+bool ArchiveOutput::_put(const void *data, size_t len) {
+    if (std::fwrite(data, 1, len, _file) != len)
+        return false;
+    _offset += len;
+    return true;
+}
+
+bool ArchiveOutput::_get(uint64_t offset, void *data, size_t len) {
+    // switching between writing and reading needs a seek in between, both ways
+    bool ok = std::fflush(_file) == 0 && seek(_file, offset, SEEK_SET) == 0 &&
+              std::fread(data, 1, len, _file) == len;
+    return seek(_file, 0, SEEK_END) == 0 && ok;
+}
+
+bool ArchiveOutput::_fits(uint64_t entrySize) const {
+    return _shardSize == 0 || _entries == 0 || _offset + _trailerSize() + entrySize <= _shardSize;
+}
+
+bool ArchiveOutput::write(const std::string &name, const uint8_t *data, size_t len, const std::string &) {
+    if (!_file)
+        return false;
+    if (!_fits(_entrySize(name, len))) {
+        if (!_close() || !_open())
+            return false;
+    }
+    if (!_writeEntry(name, data, len))
+        return false;
+    _entries++;
+    _names.insert(name);
+    return true;
+}
+
+bool ArchiveOutput::link(const std::string &name, const std::string &existing, const std::string &) {
+    // a new shard would not contain @existing
+    if (!_file || _names.count(existing) == 0 || !_fits(_linkSize(name, existing)))
+        return false;
+    if (!_writeLink(name, existing))
+        return false;
+    _entries++;
+    _names.insert(name);
+    return true;
+}
+
+bool ArchiveOutput::finish() {
+    return _file && _close();
+}
+
+/*---- TarOutput ----*/
+
+TarOutput::TarOutput(std::string path, uint64_t shardSize) : ArchiveOutput(std::move(path), shardSize) {
+}
+
+uint64_t TarOutput::_entrySize(const std::string &name, size_t len) const {
+    uint64_t size = TAR_BLOCK + tar_padded(len);
+    if (name.size() > 100)
+        size += TAR_BLOCK + tar_padded(name.size() + 1);
+    return size;
+}
+
+uint64_t TarOutput::_trailerSize() const {
+    return 2 * TAR_BLOCK;
+}
+
+uint64_t TarOutput::_linkSize(const std::string &name, const std::string &existing) const {
+    uint64_t size = TAR_BLOCK;
+    if (name.size() > 100)
+        size += TAR_BLOCK + tar_padded(name.size() + 1);
+    if (existing.size() > 100)
+        size += TAR_BLOCK + tar_padded(existing.size() + 1);
+    return size;
+}
+
+bool TarOutput::_writeHeader(const std::string &name, uint64_t size, char type, const std::string &linkName) {
+    char header[TAR_BLOCK] = {};
+    std::memcpy(header, name.data(), std::min<size_t>(name.size(), 100));
+    std::snprintf(header + 100, 8, "%07o", 0644);
+    std::snprintf(header + 108, 8, "%07o", 0);
+    std::snprintf(header + 116, 8, "%07o", 0);
+    std::snprintf(header + 124, 12, "%011llo", static_cast<unsigned long long>(size));
+    std::snprintf(header + 136, 12, "%011llo", static_cast<unsigned long long>(std::time(nullptr)));
+    header[156] = type;
+    std::memcpy(header + 157, linkName.data(), std::min<size_t>(linkName.size(), 100));
+    std::memcpy(header + 257, "ustar", 6); // magic with NUL
+    std::memcpy(header + 263, "00", 2);    // version
+
+    // checksum is computed with its own field as spaces
+    std::memset(header + 148, ' ', 8);
+    unsigned int sum = 0;
+    for (unsigned char c : header)
+        sum += c;
+    std::snprintf(header + 148, 8, "%06o", sum);
+    header[155] = ' ';
+    return _put(header, sizeof(header));
+}
+
+bool TarOutput::_writeLongName(const std::string &value, char type) {
+    static const char zeros[TAR_BLOCK] = {};
+    if (value.size() <= 100)
+        return true;
+    // an entry whose data is the full name, which applies to the next entry
+    return _writeHeader("././@LongLink", value.size() + 1, type) && _put(value.c_str(), value.size() + 1) &&
+           _put(zeros, tar_padded(value.size() + 1) - (value.size() + 1));
+}
+
+bool TarOutput::_writeEntry(const std::string &name, const uint8_t *data, size_t len) {
+    static const char zeros[TAR_BLOCK] = {};
+    if (len > 077777777777ULL)
+        return false; // does not fit the 11 octal digits of the size field
+
+    return _writeLongName(name, 'L') && _writeHeader(name, len, '0') && _put(data, len) &&
+           _put(zeros, tar_padded(len) - len);
+}
+
+bool TarOutput::_writeLink(const std::string &name, const std::string &existing) {
+    // hard link entry: no data, extracted as another name for @existing
+    return _writeLongName(existing, 'K') && _writeLongName(name, 'L') && _writeHeader(name, 0, '1', existing);
+}
+
+bool TarOutput::_writeTrailer() {
+    static const char zeros[2 * TAR_BLOCK] = {};
+    return _put(zeros, sizeof(zeros));
+}
+
+/*---- ZipOutput ----*/
+
+ZipOutput::ZipOutput(std::string path, uint64_t shardSize) : ArchiveOutput(std::move(path), shardSize) {
+    std::time_t now = std::time(nullptr);
+    std::tm local = *std::localtime(&now);
+    _dosTime = static_cast<uint16_t>(local.tm_hour << 11 | local.tm_min << 5 | local.tm_sec / 2);
+    _dosDate = static_cast<uint16_t>((local.tm_year - 80) << 9 | (local.tm_mon + 1) << 5 | local.tm_mday);
+}
+
+void ZipOutput::_reset() {
+    _entries.clear();
+    _entryIndex.clear();
+    _centralSize = 0;
+}
+
+uint64_t ZipOutput::_entrySize(const std::string &name, size_t len) const {
+    return ZIP_LOCAL_HEADER + name.size() + len + ZIP_CENTRAL_HEADER + name.size() + ZIP_ZIP64_OFFSET_EXTRA;
+}
+
+uint64_t ZipOutput::_trailerSize() const {
+    return _centralSize + ZIP_END_RECORDS;
+}
+
+bool ZipOutput::_writeEntry(const std::string &name, const uint8_t *data, size_t len) {
+    if (len >= 0xFFFFFFFFULL || name.size() > 0xFFFF)
+        return false; // entries are small images; no Zip64 sizes
+    return _writeStored(name, PngChecksum::crc32(0, data, len), data, len);
+}
+
+uint64_t ZipOutput::_linkSize(const std::string &name, const std::string &existing) const {
+    return _entrySize(name, _entries[_entryIndex.at(existing)].size);
+}
+
+bool ZipOutput::_writeLink(const std::string &name, const std::string &existing) {
+    // zip has no links: the stored bytes are copied from the archive itself
+    if (name.size() > 0xFFFF)
+        return false;
+    const Entry &source = _entries[_entryIndex.at(existing)];
+    uint32_t crc = source.crc;
+    std::vector<uint8_t> data(source.size);
+    if (!_get(source.offset + ZIP_LOCAL_HEADER + source.name.size(), data.data(), data.size()))
+        return false;
+    return _writeStored(name, crc, data.data(), data.size());
+}
+
+bool ZipOutput::_writeStored(const std::string &name, uint32_t crc, const uint8_t *data, size_t len) {
+    Entry entry{_offset, crc, static_cast<uint32_t>(len), name};
+    std::vector<uint8_t> header;
+    header.reserve(ZIP_LOCAL_HEADER + name.size());
+    put_le32(header, 0x04034B50);
+    put_le16(header, 20);      // version needed: 2.0
+    put_le16(header, 0x0800);  // names are UTF-8
+    put_le16(header, 0);       // stored
+    put_le16(header, _dosTime);
+    put_le16(header, _dosDate);
+    put_le32(header, entry.crc);
+    put_le32(header, entry.size); // compressed size
+    put_le32(header, entry.size);
+    put_le16(header, static_cast<uint16_t>(name.size()));
+    put_le16(header, 0);       // no extra field
+    header.insert(header.end(), name.begin(), name.end());
+    if (!_put(header.data(), header.size()) || !_put(data, len))
+        return false;
+    _centralSize += ZIP_CENTRAL_HEADER + name.size() + (entry.offset >= 0xFFFFFFFFULL ? ZIP_ZIP64_OFFSET_EXTRA : 0);
+    _entryIndex[name] = _entries.size();
+    _entries.push_back(std::move(entry));
+    return true;
+}
+
+bool ZipOutput::_writeTrailer() {
+    uint64_t cdOffset = _offset;
+    std::vector<uint8_t> record;
+    for (const Entry &e : _entries) {
+        bool zip64Offset = e.offset >= 0xFFFFFFFFULL;
+        record.clear();
+        put_le32(record, 0x02014B50);
+        put_le16(record, 3 << 8 | 45); // made by: Unix, 4.5
+        put_le16(record, zip64Offset ? 45 : 20);
+        put_le16(record, 0x0800);
+        put_le16(record, 0);
+        put_le16(record, _dosTime);
+        put_le16(record, _dosDate);
+        put_le32(record, e.crc);
+        put_le32(record, e.size);
+        put_le32(record, e.size);
+        put_le16(record, static_cast<uint16_t>(e.name.size()));
+        put_le16(record, zip64Offset ? ZIP_ZIP64_OFFSET_EXTRA : 0);
+        put_le16(record, 0);           // no comment
+        put_le16(record, 0);           // disk number
+        put_le16(record, 0);           // internal attributes
+        put_le32(record, 0100644u << 16); // external attributes: regular file, rw-r--r--
+        put_le32(record, zip64Offset ? 0xFFFFFFFFu : static_cast<uint32_t>(e.offset));
+        record.insert(record.end(), e.name.begin(), e.name.end());
+        if (zip64Offset) {
+            put_le16(record, 0x0001);
+            put_le16(record, 8);
+            put_le64(record, e.offset);
+        }
+        if (!_put(record.data(), record.size()))
+            return false;
+    }
+    uint64_t cdSize = _offset - cdOffset;
+    uint64_t count = _entries.size();
+
+    record.clear();
+    bool zip64 = count > 0xFFFF || cdOffset >= 0xFFFFFFFFULL || cdSize >= 0xFFFFFFFFULL;
+    if (zip64) {
+        uint64_t zip64EndOffset = _offset;
+        put_le32(record, 0x06064B50);
+        put_le64(record, 44);  // size of the rest of this record
+        put_le16(record, 3 << 8 | 45);
+        put_le16(record, 45);
+        put_le32(record, 0);
+        put_le32(record, 0);
+        put_le64(record, count);
+        put_le64(record, count);
+        put_le64(record, cdSize);
+        put_le64(record, cdOffset);
+
+        put_le32(record, 0x07064B50);
+        put_le32(record, 0);
+        put_le64(record, zip64EndOffset);
+        put_le32(record, 1);
+    }
+    put_le32(record, 0x06054B50);
+    put_le16(record, 0);
+    put_le16(record, 0);
+    put_le16(record, zip64 ? 0xFFFF : static_cast<uint16_t>(count));
+    put_le16(record, zip64 ? 0xFFFF : static_cast<uint16_t>(count));
+    put_le32(record, zip64 ? 0xFFFFFFFFu : static_cast<uint32_t>(cdSize));
+    put_le32(record, zip64 ? 0xFFFFFFFFu : static_cast<uint32_t>(cdOffset));
+    put_le16(record, 0);   // no comment
+    return _put(record.data(), record.size());
+}
@@ -0,0 +1,155 @@
+//
+// Bulk output streamed into tar or zip archives instead of one file per image.
+//
+
+#ifndef ARCHIVE_OUTPUT_HPP
+#define ARCHIVE_OUTPUT_HPP
+
+#include "BulkOutput.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/* Writes every image into one archive file with large sequential writes,
+ * instead of creating and closing a file per image.
+ *
+ * With a @shardSize, a new archive is started whenever the next entry
+ * would make the current one larger than that; shards are then named
+ * <stem>-00000<ext>, <stem>-00001<ext>, ... next to @path.
+ *
+ * Duplicates can be stored by reference to an entry of the same archive
+ * (shard); link() refuses targets in earlier shards. */
+class ArchiveOutput : public BulkOutput {
+public:
+    enum class Format { Tar, Zip };
+
+    /** @return Zip for *.zip, Tar for anything else */
+    static Format formatFor(const std::string &path);
+
+    /** Creates the writer for @format. Throws std::runtime_error if the
+     * (first) archive cannot be created. @shardSize 0 means one archive. */
+    static std::unique_ptr<ArchiveOutput> create(Format format, const std::string &path, uint64_t shardSize);
+
+    ~ArchiveOutput() override;
+
+    bool write(const std::string &name, const uint8_t *data, size_t len, const std::string &hash) override;
+
+    bool link(const std::string &name, const std::string &existing, const std::string &hash) override;
+
+    bool finish() override;
+
+    /** @return the archive files written so far */
+    [[nodiscard]] const std::vector<std::string> &files() const { return _files; }
+
+protected:
+    ArchiveOutput(std::string path, uint64_t shardSize);
+
+    /** bytes the entry adds to the archive, including its share of the trailer */
+    [[nodiscard]] virtual uint64_t _entrySize(const std::string &name, size_t len) const = 0;
+
+    /** bytes the trailer adds to the current archive when it is closed */
+    [[nodiscard]] virtual uint64_t _trailerSize() const = 0;
+
+    virtual bool _writeEntry(const std::string &name, const uint8_t *data, size_t len) = 0;
+
+    /** bytes a duplicate of @existing, an entry of the current archive, adds */
+    [[nodiscard]] virtual uint64_t _linkSize(const std::string &name, const std::string &existing) const = 0;
+
+    virtual bool _writeLink(const std::string &name, const std::string &existing) = 0;
+
+    virtual bool _writeTrailer() = 0;
+
+    /** forget per-archive state when a new shard starts */
+    virtual void _reset() = 0;
+
+    bool _put(const void *data, size_t len);
+
+    /** reads back @len bytes written at @offset of the current archive */
+    bool _get(uint64_t offset, void *data, size_t len);
+
+    uint64_t _offset = 0; // bytes written to the current archive
+
+private:
+    std::string _path;
+    uint64_t _shardSize;
+    std::FILE *_file = nullptr;
+    std::vector<std::string> _files;
+    size_t _entries = 0; // in the current archive
+    std::unordered_set<std::string> _names; // entries in the current archive
+
+    [[nodiscard]] bool _fits(uint64_t entrySize) const;
+
+    bool _open();
+
+    bool _close();
+};
+
+/* POSIX ustar; names longer than 100 bytes get a GNU long name entry. */
+class TarOutput : public ArchiveOutput {
+public:
+    TarOutput(std::string path, uint64_t shardSize);
+
+protected:
+    [[nodiscard]] uint64_t _entrySize(const std::string &name, size_t len) const override;
+
+    [[nodiscard]] uint64_t _trailerSize() const override;
+
+    bool _writeEntry(const std::string &name, const uint8_t *data, size_t len) override;
+
+    [[nodiscard]] uint64_t _linkSize(const std::string &name, const std::string &existing) const override;
+
+    bool _writeLink(const std::string &name, const std::string &existing) override;
+
+    bool _writeTrailer() override;
+
+    void _reset() override {}
+
+private:
+    bool _writeHeader(const std::string &name, uint64_t size, char type, const std::string &linkName = {});
+
+    /* GNU long name ('L') or long link name ('K') entry if @value exceeds its 100 byte field */
+    bool _writeLongName(const std::string &value, char type);
+};
+
+/* Zip with stored entries. The central directory is written at the end
+ * and switches to Zip64 records once there are more than 65535 entries
+ * or the archive passes 4 GiB. */
+class ZipOutput : public ArchiveOutput {
+public:
+    ZipOutput(std::string path, uint64_t shardSize);
+
+protected:
+    [[nodiscard]] uint64_t _entrySize(const std::string &name, size_t len) const override;
+
+    [[nodiscard]] uint64_t _trailerSize() const override;
+
+    bool _writeEntry(const std::string &name, const uint8_t *data, size_t len) override;
+
+    [[nodiscard]] uint64_t _linkSize(const std::string &name, const std::string &existing) const override;
+
+    bool _writeLink(const std::string &name, const std::string &existing) override;
+
+    bool _writeTrailer() override;
+
+    void _reset() override;
+
+private:
+    struct Entry {
+        uint64_t offset;
+        uint32_t crc;
+        uint32_t size;
+        std::string name;
+    };
+    std::vector<Entry> _entries;
+    std::unordered_map<std::string, size_t> _entryIndex; // name -> position in _entries
+    uint64_t _centralSize = 0; // central directory bytes for _entries
+    uint16_t _dosTime, _dosDate;
+
+    bool _writeStored(const std::string &name, uint32_t crc, const uint8_t *data, size_t len);
+};
+
+#endif //ARCHIVE_OUTPUT_HPP
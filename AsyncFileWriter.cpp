@@ -0,0 +1,287 @@
+//
+// Whole-file writes in the background: io_uring on Linux, a few I/O threads elsewhere.
+//
+
+#include "AsyncFileWriter.hpp"
+#include "BoundedQueue.hpp"
+#include "IoUring.hpp"
+#include "QrToPng.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    long processId() {
+#if defined(_WIN32)
+        return ::_getpid();
+#else
+        return static_cast<long>(::getpid());
+#endif
+    }
+
+    /* like AtomicFile's temp names, <dir>/.<name>.<pid>.a<n>.tmp; the 'a' keeps the two counters apart */
+    std::string tempPathFor(const std::string &target) {
+        static std::atomic<unsigned long> counter{0};
+        fs::path path(target);
+        std::string name = "." + path.filename().string() + "." + std::to_string(processId()) + ".a" +
+                           std::to_string(counter++) + ".tmp";
+        return (path.parent_path() / name).string();
+    }
+
+    struct Request {
+        std::string path;
+        std::vector<uint8_t> data;
+        AsyncFileWriter::Callback done;
+    };
+
+    /* Blocking writes on a few threads; the portable backend. */
+    class ThreadFileWriter : public AsyncFileWriter {
+    public:
+        explicit ThreadFileWriter(unsigned threads) : _queue(64) {
+            for (unsigned i = 0; i < threads; i++)
+                _threads.emplace_back([this] { _run(); });
+        }
+
+        ~ThreadFileWriter() override {
+            _queue.close();
+            for (auto &t : _threads)
+                t.join();
+        }
+
+        void write(std::string path, std::vector<uint8_t> data, Callback done) override {
+            if (!_queue.push(Request{std::move(path), std::move(data), std::move(done)}))
+                std::terminate(); // closed only by the destructor
+        }
+
+        [[nodiscard]] const char *backend() const override { return "threads"; }
+
+    private:
+        BoundedQueue<Request> _queue;
+        std::vector<std::thread> _threads;
+
+        void _run() {
+            Request request;
+            while (_queue.pop(request)) {
+                std::string tmp = tempPathFor(request.path);
+                bool ok = false;
+                if (std::FILE *f = std::fopen(tmp.c_str(), "wb")) {
+                    ok = std::fwrite(request.data.data(), 1, request.data.size(), f) == request.data.size();
+                    ok = std::fclose(f) == 0 && ok;
+                }
+                std::error_code ec;
+                if (ok)
+                    fs::rename(tmp, request.path, ec);
+                if (!ok || ec) {
+                    fs::remove(tmp, ec);
+                    ok = false;
+                }
+                request.done(ok);
+            }
+        }
+    };
+
+#if defined(__linux__)
+    /* Every file is a chain of openat -> write... -> close -> renameat
+     * requests on one ring; each completion submits the next step. One
+     * thread reaps completions, callers submit the first step themselves,
+     * so a write() costs one io_uring_enter and no thread switch. */
+    class UringFileWriter : public AsyncFileWriter {
+    public:
+        explicit UringFileWriter(unsigned maxInFlight) : _ring(maxInFlight) {
+            if (!_ring.supports(IORING_OP_OPENAT) || !_ring.supports(IORING_OP_WRITE) ||
+                !_ring.supports(IORING_OP_CLOSE))
+                throw std::runtime_error("io_uring lacks openat / write / close");
+            _maxInFlight = _ring.entries();
+            _reaper = std::thread([this] { _reap(); });
+        }
+
+        ~UringFileWriter() override {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _changed.wait(lock, [this] { return _inFlight == 0; });
+            _stopping = true;
+            io_uring_sqe *sqe = _ring.sqe(); // wakes the reaper, which then sees _stopping
+            sqe->opcode = IORING_OP_NOP;
+            sqe->user_data = 0;
+            _ring.submit();
+            lock.unlock();
+            _reaper.join();
+        }
+
+        // must not be called from a completion callback: that would wait for itself when full
+        void write(std::string path, std::vector<uint8_t> data, Callback done) override {
+            auto *op = new Op;
+            op->path = std::move(path);
+            op->tmp = tempPathFor(op->path);
+            op->data = std::move(data);
+            op->done = std::move(done);
+
+            std::unique_lock<std::mutex> lock(_mutex);
+            _changed.wait(lock, [this] { return _inFlight < _maxInFlight; });
+            _inFlight++;
+            _prepare(op);
+            _ring.submit();
+        }
+
+        [[nodiscard]] const char *backend() const override { return "io_uring"; }
+
+    private:
+        enum class Stage { Open, Write, Close, Rename };
+
+        struct Op {
+            std::string path, tmp;
+            std::vector<uint8_t> data;
+            Callback done;
+            Stage stage = Stage::Open;
+            int fd = -1;
+            size_t written = 0;
+            bool ok = true;     // false once a step failed: then only clean up
+        };
+
+        IoUring _ring;
+        std::mutex _mutex;      // guards the submission side and the counters
+        std::condition_variable _changed;
+        unsigned _inFlight = 0;
+        unsigned _maxInFlight = 0;
+        bool _stopping = false;
+        std::thread _reaper;
+
+        // queues the request for @op's current stage; every op has exactly one in the ring
+        void _prepare(Op *op) {
+            io_uring_sqe *sqe = _ring.sqe(); // never full: at most one entry per op in flight
+            sqe->user_data = reinterpret_cast<uint64_t>(op);
+            switch (op->stage) {
+                case Stage::Open:
+                    sqe->opcode = IORING_OP_OPENAT;
+                    sqe->fd = AT_FDCWD;
+                    sqe->addr = reinterpret_cast<uint64_t>(op->tmp.c_str());
+                    sqe->len = 0644;
+                    sqe->open_flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+                    break;
+                case Stage::Write:
+                    sqe->opcode = IORING_OP_WRITE;
+                    sqe->fd = op->fd;
+                    sqe->addr = reinterpret_cast<uint64_t>(op->data.data() + op->written);
+                    sqe->len = static_cast<uint32_t>(std::min<size_t>(op->data.size() - op->written, 1u << 30));
+                    sqe->off = op->written;
+                    break;
+                case Stage::Close:
+                    sqe->opcode = IORING_OP_CLOSE;
+                    sqe->fd = op->fd;
+                    break;
+                case Stage::Rename:
+                    sqe->opcode = IORING_OP_RENAMEAT;
+                    sqe->fd = AT_FDCWD;
+                    sqe->addr = reinterpret_cast<uint64_t>(op->tmp.c_str());
+                    sqe->len = static_cast<uint32_t>(AT_FDCWD);
+                    sqe->addr2 = reinterpret_cast<uint64_t>(op->path.c_str());
+                    break;
+            }
+        }
+
+        // @return true if @op needs another request
+        bool _advance(Op *op, int result) {
+            switch (op->stage) {
+                case Stage::Open:
+                    if (result < 0)
+                        return false;
+                    op->fd = result;
+                    op->stage = op->data.empty() ? Stage::Close : Stage::Write;
+                    return true;
+                case Stage::Write:
+                    if (result <= 0) {
+                        op->ok = false;
+                        op->stage = Stage::Close;
+                        return true;
+                    }
+                    op->written += static_cast<size_t>(result);
+                    if (op->written == op->data.size())
+                        op->stage = Stage::Close;
+                    return true;
+                case Stage::Close:
+                    op->fd = -1;
+                    if (result < 0 || !op->ok) {
+                        op->ok = false;
+                        return false;
+                    }
+                    if (_ring.supports(IORING_OP_RENAMEAT)) {
+                        op->stage = Stage::Rename;
+                        return true;
+                    }
+                    op->ok = ::rename(op->tmp.c_str(), op->path.c_str()) == 0; // before 5.11
+                    return false;
+                case Stage::Rename:
+                    op->ok = result >= 0;
+                    return false;
+            }
+            return false;
+        }
+
+        void _finish(Op *op) {
+            if (op->stage == Stage::Open)
+                op->ok = false;
+            if (!op->ok)
+                ::unlink(op->tmp.c_str());
+            op->done(op->ok);
+            delete op;
+
+            std::lock_guard<std::mutex> lock(_mutex);
+            _inFlight--;
+            _changed.notify_all();
+        }
+
+        void _reap() {
+            while (true) {
+                int rc = _ring.wait(1);
+                if (rc < 0 && rc != -EINTR)
+                    std::terminate(); // the ring is unusable; writes in flight would never finish
+                io_uring_cqe cqe;
+                while (_ring.popCompletion(cqe)) {
+                    if (cqe.user_data == 0) {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        if (_stopping)
+                            return;
+                        continue;
+                    }
+                    auto *op = reinterpret_cast<Op *>(cqe.user_data);
+                    if (_advance(op, cqe.res)) {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _prepare(op);
+                        _ring.submit();
+                    } else {
+                        _finish(op);
+                    }
+                }
+                // entries the kernel did not take (-EAGAIN, a partial submission) go again
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_ring.unsubmitted() > 0)
+                    _ring.submit();
+            }
+        }
+    };
+#endif
+}
+
+std::unique_ptr<AsyncFileWriter> AsyncFileWriter::create() {
+#if defined(__linux__)
+    try {
+        return std::make_unique<UringFileWriter>(64);
+    } catch (const std::exception &) {
+        // no io_uring (old kernel, containers that filter it): fall back to threads
+    }
+#endif
+    return std::make_unique<ThreadFileWriter>(2);
+}
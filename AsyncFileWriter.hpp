@@ -0,0 +1,40 @@
+//
+// Whole-file writes in the background: io_uring on Linux, a few I/O threads elsewhere.
+//
+
+#ifndef ASYNC_FILE_WRITER_HPP
+#define ASYNC_FILE_WRITER_HPP
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Writes complete files without blocking the caller. Each file is
+ * written to a temp file next to it and renamed over the target, like
+ * QrToPng::writeToPNG(), so readers never see a partial image.
+ *
+ * The completion callback runs on a background thread and should only
+ * hand the result over (e.g. resume a coroutine on a thread pool): while
+ * it runs, no other completion is processed. */
+class AsyncFileWriter {
+public:
+    using Callback = std::function<void(bool ok)>;
+
+    virtual ~AsyncFileWriter() = default;
+
+    /** Starts writing @data to @path and returns. @done is called once the
+     * file is complete (true) or has failed (false, nothing is left behind).
+     * Blocks only if the maximum number of writes is already in flight. */
+    virtual void write(std::string path, std::vector<uint8_t> data, Callback done) = 0;
+
+    /** @return "io_uring" or "threads" */
+    [[nodiscard]] virtual const char *backend() const = 0;
+
+    /** io_uring if the kernel offers the operations needed, I/O threads otherwise.
+     * The destructor waits for writes in flight. */
+    static std::unique_ptr<AsyncFileWriter> create();
+};
+
+#endif //ASYNC_FILE_WRITER_HPP
@@ -0,0 +1,181 @@
+//
+// Files written through a temp file that is renamed into place once complete.
+//
+
+#include "AtomicFile.hpp"
+#include "ByteSink.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#if defined(__GNUC__) && __GNUC__ < 9
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#else
+#include <filesystem>
+namespace fs = std::filesystem;
+#endif
+
+#if defined(_WIN32)
+#include <io.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+    /* Small wrappers so the temp file handling below reads the same on
+     * POSIX and on Windows (MinGW). */
+#if defined(_WIN32)
+    int openExclusive(const fs::path &path) {
+        return ::_wopen(path.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE);
+    }
+    bool syncFile(int fd) { return ::_commit(fd) == 0; }
+    bool closeFile(int fd) { return ::_close(fd) == 0; }
+    bool syncDirectory(const fs::path &) { return true; } // renames are durable once MoveFileEx returns
+    void copyMode(int, const fs::path &) {} // only the read-only flag, which would make the rename fail anyway
+    // _wrename fails if @target exists
+    bool renameNoReplace(const fs::path &from, const fs::path &target) {
+        return ::_wrename(from.c_str(), target.c_str()) == 0;
+    }
+    long processId() { return ::_getpid(); }
+#else
+    int openExclusive(const fs::path &path) {
+        int fd;
+        do
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        while (fd < 0 && errno == EINTR);
+        return fd;
+    }
+    bool syncFile(int fd) { return ::fsync(fd) == 0; }
+    bool closeFile(int fd) { return ::close(fd) == 0 || errno == EINTR; }
+    bool syncDirectory(const fs::path &dir) {
+        int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        bool ok = ::fsync(fd) == 0;
+        ::close(fd);
+        return ok;
+    }
+    // an existing @target keeps its permissions when the temp file @fd is renamed over it
+    void copyMode(int fd, const fs::path &target) {
+        struct stat st{};
+        if (::stat(target.c_str(), &st) == 0)
+            ::fchmod(fd, st.st_mode & 07777);
+    }
+    // creates @target exclusively and copies @from into it, then removes @from
+    bool copyNoReplace(const fs::path &from, const fs::path &target) {
+        int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0)
+            return false;
+        struct stat st{};
+        int out = ::fstat(in, &st) == 0 ?
+                  ::open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777) : -1;
+        bool ok = out >= 0;
+        char buffer[64 * 1024];
+        while (ok) {
+            ssize_t n = ::read(in, buffer, sizeof buffer);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                ok = n == 0;
+                break;
+            }
+            for (ssize_t done = 0; ok && done < n;) {
+                ssize_t w = ::write(out, buffer + done, static_cast<size_t>(n - done));
+                if (w > 0)
+                    done += w;
+                else if (w < 0 && errno != EINTR)
+                    ok = false;
+            }
+        }
+        int error = errno;
+        ::close(in);
+        if (out >= 0) {
+            ok = ::close(out) == 0 && ok;
+            if (!ok)
+                ::unlink(target.c_str()); // ours: O_EXCL created it
+        }
+        if (ok)
+            ::unlink(from.c_str());
+        errno = error;
+        return ok;
+    }
+    // Moves @from to @target, failing with EEXIST instead of replacing it as rename() would:
+    // renameat2(RENAME_NOREPLACE) where the kernel and file system have it, else link() + unlink(),
+    // else (no hard links: FAT, exFAT, some network and FUSE mounts) an exclusive create and a copy.
+    bool renameNoReplace(const fs::path &from, const fs::path &target) {
+#if defined(RENAME_NOREPLACE)
+        if (::renameat2(AT_FDCWD, from.c_str(), AT_FDCWD, target.c_str(), RENAME_NOREPLACE) == 0)
+            return true;
+        if (errno != EINVAL && errno != ENOSYS)
+            return false;
+#endif
+        if (::link(from.c_str(), target.c_str()) == 0) {
+            ::unlink(from.c_str());
+            return true;
+        }
+        if (errno != EPERM && errno != ENOTSUP && errno != EOPNOTSUPP && errno != EXDEV && errno != ENOSYS)
+            return false;
+        return copyNoReplace(from, target);
+    }
+    long processId() { return static_cast<long>(::getpid()); }
+#endif
+
+    /* <dir>/.<name>.<pid>.<n>.tmp: same directory as the target, so the
+     * final rename never crosses file systems, and hidden on POSIX. */
+    fs::path tempPathFor(const fs::path &target) {
+        static std::atomic<unsigned long> counter{0};
+        std::string name = "." + target.filename().string() + "." + std::to_string(processId()) + "." +
+                           std::to_string(counter++) + ".tmp";
+        return target.parent_path() / name;
+    }
+}
+
+bool AtomicFile::write(const std::string &path, bool overwrite, bool sync,
+                       const std::function<bool(ByteSink &)> &fill) {
+    fs::path target(path);
+    fs::path tmp = tempPathFor(target);
+    int fd = openExclusive(tmp);
+    if (fd < 0)
+        return false;
+    if (overwrite)
+        copyMode(fd, target);
+
+    bool written = false;
+    std::error_code ec;
+    try {
+        FdSink out(fd);
+        written = fill(out) && (!sync || syncFile(fd));
+    }
+    catch (const std::runtime_error &e) {
+        std::cerr << "Failed to write " << tmp.string() << ": " << e.what() << std::endl;
+    }
+    catch (...) {
+        // e.g. std::length_error for an oversized image: leave no descriptor or temp file behind
+        closeFile(fd);
+        fs::remove(tmp, ec);
+        throw;
+    }
+    written = closeFile(fd) && written;
+
+    if (written) {
+        if (overwrite)
+            fs::rename(tmp, target, ec);
+        else if (!renameNoReplace(tmp, target))
+            ec = std::error_code(errno, std::generic_category());
+    }
+    if (!written || ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+
+    if (sync)
+        syncDirectory(target.parent_path());
+    return true;
+}
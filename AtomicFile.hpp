@@ -0,0 +1,28 @@
+//
+// Files written through a temp file that is renamed into place once complete.
+//
+
+#ifndef ATOMIC_FILE_HPP
+#define ATOMIC_FILE_HPP
+
+#include <functional>
+#include <string>
+
+class ByteSink;
+
+namespace AtomicFile {
+    /** Writes @path through a fresh temp file next to it, which @fill writes
+     * to through the ByteSink it is given, and which is renamed to @path once
+     * @fill returned true. Readers see either the old file or the complete
+     * new one, never a partial write, and a failed write leaves no temp file
+     * behind. With @overwrite an existing file is replaced and keeps its
+     * mode; without it the rename fails instead, even if the file only
+     * appeared while @fill ran. With @sync the file and its directory are
+     * flushed to disk before this returns.
+     * @return false if @fill returned false or the file could not be
+     * written; exceptions other than std::runtime_error from @fill are
+     * rethrown after the temp file is removed */
+    bool write(const std::string &path, bool overwrite, bool sync, const std::function<bool(ByteSink &)> &fill);
+}
+
+#endif //ATOMIC_FILE_HPP
@@ -0,0 +1,243 @@
+/*
+ * Banded parallel PNG output
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "BandedPngOut.hpp"
+#include "PngChecksum.hpp"
+#include "TinyPngOut.hpp"
+
+using std::uint8_t;
+using std::uint16_t;
+using std::uint32_t;
+using std::uint64_t;
+using std::size_t;
+
+
+BandedPngOut::BandedPngOut(uint32_t w, uint32_t h, ByteSink &out, unsigned int numThreads) :
+		width(w),
+		height(h),
+		threads(numThreads),
+		output(out) {
+
+	if (width == 0 || height == 0)
+		throw std::domain_error("Zero width or height");
+
+	uint64_t lineSz = static_cast<uint64_t>(width) * 3 + 1;
+	if (lineSz > UINT32_MAX || bandIdatLength(lineSz) + 2 > static_cast<uint32_t>(INT32_MAX))
+		throw std::length_error("Image too large");
+	lineSize = static_cast<uint32_t>(lineSz);
+	rowsPerBand = std::min(bandRows(lineSize), height);
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+
+uint64_t BandedPngOut::encodedSize(uint32_t w, uint32_t h) {
+	if (w == 0 || h == 0)
+		throw std::domain_error("Zero width or height");
+	uint64_t lineSz = static_cast<uint64_t>(w) * 3 + 1;
+	if (lineSz > UINT32_MAX)
+		throw std::length_error("Image too large");
+	uint32_t rows = std::min(bandRows(static_cast<uint32_t>(lineSz)), h);
+	uint32_t fullBands = h / rows;
+	uint32_t lastRows = h % rows;
+
+	// Signature, IHDR chunk, zlib header, trailer IDAT chunk, IEND chunk
+	uint64_t result = 8 + 25 + 2 + (12 + 9) + 12;
+	result += fullBands * (12 + bandIdatLength(lineSz * rows));
+	if (lastRows > 0)
+		result += 12 + bandIdatLength(lineSz * lastRows);
+	return result;
+}
+
+
+void BandedPngOut::write(const RowSource &rows) {
+	const uint32_t numBands = (height + rowsPerBand - 1) / rowsPerBand;
+	const uint32_t window = threads * 2;
+
+	// Signature and IHDR chunk
+	uint8_t header[] = {
+		0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A,
+		0x00, 0x00, 0x00, 0x0D,
+		0x49, 0x48, 0x44, 0x52,
+		0, 0, 0, 0,  // 'width' placeholder
+		0, 0, 0, 0,  // 'height' placeholder
+		0x08, 0x02, 0x00, 0x00, 0x00,
+		0, 0, 0, 0,  // IHDR CRC-32 placeholder
+	};
+	putBigUint32(width, &header[16]);
+	putBigUint32(height, &header[20]);
+	putBigUint32(PngChecksum::crc32(0, &header[12], 17), &header[29]);
+	output.write(header, sizeof(header));
+	if (!textChunks.empty())
+		output.write(textChunks.data(), textChunks.size());
+
+	struct Band {
+		std::vector<uint8_t> raw;    // Filter bytes and pixels, exactly as DEFLATE input
+		std::vector<uint8_t> chunk;  // Complete IDAT chunk
+		uint32_t adler = 1;
+		bool ready = false;
+	};
+	std::vector<Band> slots(window);
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	uint32_t nextToEncode = 0;
+	uint32_t written = 0;
+	bool failed = false;
+	std::exception_ptr error;
+
+	auto encodeBand = [&](uint32_t index, Band &band) {
+		uint32_t firstRow = index * rowsPerBand;
+		uint32_t numRows = std::min(rowsPerBand, height - firstRow);
+		size_t rawSize = static_cast<size_t>(numRows) * lineSize;
+		band.raw.resize(rawSize);
+		for (uint32_t i = 0; i < numRows; i++) {
+			uint8_t *line = &band.raw[static_cast<size_t>(i) * lineSize];
+			line[0] = 0;  // Filter method None
+			rows(firstRow + i, line + 1);
+		}
+		band.adler = PngChecksum::adler32(1, band.raw.data(), rawSize);
+
+		// The zlib header goes at the start of the first band's chunk
+		size_t prefix = index == 0 ? 2 : 0;
+		size_t payload = prefix + static_cast<size_t>(bandIdatLength(rawSize));
+		band.chunk.resize(8 + payload + 4);
+		uint8_t *p = band.chunk.data();
+		putBigUint32(static_cast<uint32_t>(payload), p);
+		std::memcpy(p + 4, "IDAT", 4);
+		p += 8;
+		if (index == 0) {
+			*p++ = 0x08;
+			*p++ = 0x1D;
+		}
+		// Non-final stored blocks; the final empty block is in the trailer chunk
+		for (size_t off = 0; off < rawSize; ) {
+			uint16_t size = static_cast<uint16_t>(std::min<size_t>(DEFLATE_MAX_BLOCK_SIZE, rawSize - off));
+			p[0] = 0;
+			p[1] = static_cast<uint8_t>(size >> 0);
+			p[2] = static_cast<uint8_t>(size >> 8);
+			p[3] = static_cast<uint8_t>((size >> 0) ^ 0xFF);
+			p[4] = static_cast<uint8_t>((size >> 8) ^ 0xFF);
+			std::memcpy(p + 5, &band.raw[off], size);
+			p += 5 + size;
+			off += size;
+		}
+		putBigUint32(PngChecksum::crc32(0, band.chunk.data() + 4, 4 + payload), p);
+	};
+
+	auto worker = [&]() {
+		while (true) {
+			uint32_t index;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [&]() {
+					return failed || nextToEncode >= numBands || nextToEncode < written + window;
+				});
+				if (failed || nextToEncode >= numBands)
+					return;
+				index = nextToEncode++;
+			}
+			Band &band = slots[index % window];
+			try {
+				encodeBand(index, band);
+			} catch (...) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!failed)
+					error = std::current_exception();
+				failed = true;
+				changed.notify_all();
+				return;
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			band.ready = true;
+			changed.notify_all();
+		}
+	};
+
+	std::vector<std::thread> pool;
+	unsigned int poolSize = std::min<uint32_t>(threads, numBands);
+	for (unsigned int i = 0; i < poolSize; i++)
+		pool.emplace_back(worker);
+
+	// Write finished bands in order while the pool keeps encoding ahead
+	uint32_t adler = 1;
+	try {
+		for (uint32_t i = 0; i < numBands; i++) {
+			Band &band = slots[i % window];
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [&]() { return failed || band.ready; });
+				if (failed)
+					break;
+			}
+			output.write(band.chunk.data(), band.chunk.size());
+			uint64_t rawSize = band.raw.size();
+			adler = PngChecksum::adler32Combine(adler, band.adler, rawSize);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			band.ready = false;
+			written = i + 1;
+			changed.notify_all();
+		}
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!failed)
+			error = std::current_exception();
+		failed = true;
+		changed.notify_all();
+	}
+	for (std::thread &t : pool)
+		t.join();
+	if (error)
+		std::rethrow_exception(error);
+
+	uint8_t footer[] = {
+		// Trailer IDAT chunk: final empty stored block and zlib Adler-32
+		0x00, 0x00, 0x00, 0x09,
+		0x49, 0x44, 0x41, 0x54,
+		0x01, 0x00, 0x00, 0xFF, 0xFF,
+		0, 0, 0, 0,  // DEFLATE Adler-32 placeholder
+		0, 0, 0, 0,  // IDAT CRC-32 placeholder
+		// IEND chunk
+		0x00, 0x00, 0x00, 0x00,
+		0x49, 0x45, 0x4E, 0x44,
+		0xAE, 0x42, 0x60, 0x82,
+	};
+	putBigUint32(adler, &footer[13]);
+	putBigUint32(PngChecksum::crc32(0, &footer[4], 13), &footer[17]);
+	output.write(footer, sizeof(footer));
+	output.flush();
+}
+
+
+void BandedPngOut::addText(const std::string &keyword, const std::string &text) {
+	std::vector<uint8_t> chunk = TinyPngOut::textChunk(keyword, text);
+	textChunks.insert(textChunks.end(), chunk.begin(), chunk.end());
+}
+
+
+uint32_t BandedPngOut::bandRows(uint32_t lineSize) {
+	return std::max<uint32_t>(1, BAND_TARGET_SIZE / lineSize);
+}
+
+
+uint64_t BandedPngOut::bandIdatLength(uint64_t rawBytes) {
+	uint64_t numBlocks = (rawBytes + DEFLATE_MAX_BLOCK_SIZE - 1) / DEFLATE_MAX_BLOCK_SIZE;
+	return numBlocks * 5 + rawBytes;
+}
+
+
+void BandedPngOut::putBigUint32(uint32_t val, uint8_t array[4]) {
+	for (int i = 0; i < 4; i++)
+		array[i] = static_cast<uint8_t>(val >> ((3 - i) * 8));
+}
@@ -0,0 +1,92 @@
+/*
+ * Banded parallel PNG output
+ *
+ * Splits an image into bands of rows, encodes the bands on several threads
+ * and writes them in order, one IDAT chunk per band. Like TinyPngOut, the
+ * zlib stream uses stored (uncompressed) DEFLATE blocks; every band ends on
+ * a block boundary, so bands are independent apart from the Adler-32, which
+ * is combined from the per-band checksums.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "ByteSink.hpp"
+
+
+class BandedPngOut final {
+
+	/*---- Types ----*/
+
+	/*
+	 * Fills 'row' with the width*3 bytes (RGB8.8.8) of pixel row 'y'. Called
+	 * concurrently from several threads, each time with a different row.
+	 */
+	public: using RowSource = std::function<void(std::uint32_t y, std::uint8_t row[])>;
+
+
+
+	/*---- Fields ----*/
+
+	private: std::uint32_t width;   // Measured in pixels
+	private: std::uint32_t height;  // Measured in pixels
+	private: std::uint32_t lineSize;  // Measured in bytes, equal to (width * 3 + 1)
+	private: std::uint32_t rowsPerBand;
+	private: unsigned int threads;
+	private: ByteSink &output;
+	private: std::vector<std::uint8_t> textChunks;  // Written between IHDR and the image data
+
+
+
+	/*---- Public constructor and methods ----*/
+
+	/*
+	 * Creates a banded PNG writer with the given width and height (both non-zero) and sink.
+	 * 'numThreads' == 0 uses one thread per hardware core.
+	 * Throws an exception if a single row is too large to form a band.
+	 */
+	public: explicit BandedPngOut(std::uint32_t w, std::uint32_t h, ByteSink &out, unsigned int numThreads = 0);
+
+
+	/*
+	 * Renders every row through 'rows' and writes the complete PNG file to the sink.
+	 * At most two bands per thread are held in memory at any time. Exceptions thrown
+	 * by 'rows' stop the encoding and are rethrown here; the output is then incomplete.
+	 */
+	public: void write(const RowSource &rows);
+
+
+	/*
+	 * Adds a tEXt chunk, written before the image data; see TinyPngOut::addText().
+	 * Must be called before write().
+	 */
+	public: void addText(const std::string &keyword, const std::string &text);
+
+
+	/*
+	 * Returns the exact size in bytes of the PNG file written for the given dimensions,
+	 * not counting text chunks.
+	 */
+	public: static std::uint64_t encodedSize(std::uint32_t w, std::uint32_t h);
+
+
+
+	/*---- Private helpers ----*/
+
+	private: static std::uint32_t bandRows(std::uint32_t lineSize);
+
+	private: static std::uint64_t bandIdatLength(std::uint64_t rawBytes);
+
+	private: static void putBigUint32(std::uint32_t val, std::uint8_t array[4]);
+
+
+	// Raw (filtered) bytes per band, before the stored-block overhead
+	private: static constexpr std::uint32_t BAND_TARGET_SIZE = 4 << 20;
+
+	private: static constexpr std::uint16_t DEFLATE_MAX_BLOCK_SIZE = 65535;
+
+};
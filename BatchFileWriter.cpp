@@ -0,0 +1,329 @@
+//
+// Many small files written with few system calls: io_uring request chains, or one by one.
+//
+
+#include "BatchFileWriter.hpp"
+#include "IoUring.hpp"
+#include "QrToPng.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    bool syncToDevice(std::FILE *f) {
+        if (std::fflush(f) != 0)
+            return false;
+#if defined(_WIN32)
+        return ::_commit(::_fileno(f)) == 0;
+#else
+        return ::fsync(::fileno(f)) == 0;
+#endif
+    }
+
+    /* fopen / fwrite / fclose per file; the portable backend. */
+    class SyncFileWriter : public BatchFileWriter {
+    public:
+        SyncFileWriter(bool replace, bool fsync) : _replace(replace), _fsync(fsync) {}
+
+        bool write(const std::string &path, const uint8_t *data, size_t len, Callback done) override {
+            std::error_code ec;
+            if (fs::exists(path, ec)) {
+                if (!_replace)
+                    return false;
+                fs::remove(path, ec);
+            }
+            std::FILE *f = std::fopen(path.c_str(), "wb");
+            if (!f)
+                return false;
+            bool ok = std::fwrite(data, 1, len, f) == len;
+            if (ok && _fsync)
+                ok = syncToDevice(f);
+            ok = std::fclose(f) == 0 && ok;
+            if (!ok) {
+                fs::remove(path, ec);
+                return false;
+            }
+            done(true);
+            return true;
+        }
+
+        void drain() override {}
+
+        [[nodiscard]] const char *backend() const override { return "sync"; }
+
+    private:
+        bool _replace;
+        bool _fsync;
+    };
+
+#if defined(__linux__)
+    /* Every file is one chain of linked requests:
+     *
+     *     [unlinkat] -> openat into file slot K -> write(_fixed) -> [fsync] -> close slot K
+     *
+     * so it needs no system call of its own: the chains of several files
+     * are submitted together, and their completions are reaped from the
+     * shared ring without entering the kernel while any are ready. The
+     * image is copied into a registered buffer, sized after the first image
+     * of the run, or into a plain heap copy if none is free or it is larger.
+     *
+     * write() and fsync are hard links: even if they fail, the chain goes
+     * on and closes the file. Only a failed open cancels the rest. */
+    class UringFileWriter : public BatchFileWriter {
+    public:
+        UringFileWriter(unsigned depth, bool replace, bool fsync) :
+                _ring(std::max(1u, depth) * MAX_CHAIN), _replace(replace), _fsync(fsync) {
+            depth = std::max(1u, depth);
+            if (!_ring.supports(IORING_OP_OPENAT) || !_ring.supports(IORING_OP_WRITE) ||
+                !_ring.supports(IORING_OP_CLOSE) || !_ring.supports(IORING_OP_UNLINKAT))
+                throw std::runtime_error("io_uring lacks openat / write / close / unlinkat");
+            if (_ring.registerFileSlots(depth) < 0)
+                throw std::runtime_error("io_uring cannot open into file slots");
+
+            _slots.resize(depth);
+            for (unsigned i = depth; i-- > 0;)
+                _free.push_back(i);
+            _submitBatch = std::max(1u, depth / 8);
+        }
+
+        ~UringFileWriter() override {
+            drain();
+        }
+
+        bool write(const std::string &path, const uint8_t *data, size_t len, Callback done) override {
+            if (len > (1u << 30))
+                return false; // one write request; far beyond any image
+            if (!_buffersRegistered)
+                _registerBuffers(len);
+            while (_free.empty())
+                _reap(true);
+            unsigned index = _free.back();
+            _free.pop_back();
+
+            Slot &slot = _slots[index];
+            slot.path = path;
+            slot.len = len;
+            slot.done = std::move(done);
+            slot.ok = true;
+            slot.opened = false;
+            slot.pending = 0;
+            slot.buffer = -1;
+            bool fixed = len <= _bufferSize && !_freeBuffers.empty();
+            uint8_t *bytes;
+            if (fixed) {
+                slot.buffer = static_cast<int>(_freeBuffers.back());
+                _freeBuffers.pop_back();
+                bytes = _buffers.get() + static_cast<size_t>(slot.buffer) * _bufferSize;
+                std::memcpy(bytes, data, len);
+                slot.heap = std::vector<uint8_t>();
+            } else {
+                slot.heap.assign(data, data + len);
+                bytes = slot.heap.data();
+            }
+
+            io_uring_sqe *sqe;
+            if (_replace) {
+                sqe = _prepare(index, Stage::Unlink, IOSQE_IO_HARDLINK); // usually ENOENT, which is fine
+                sqe->opcode = IORING_OP_UNLINKAT;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = reinterpret_cast<uint64_t>(slot.path.c_str());
+            }
+            sqe = _prepare(index, Stage::Open, IOSQE_IO_LINK);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uint64_t>(slot.path.c_str());
+            sqe->len = 0644;
+            sqe->open_flags = O_WRONLY | O_CREAT | O_EXCL; // no O_CLOEXEC: a slot is no descriptor, the kernel rejects it
+            sqe->file_index = index + 1;
+
+            sqe = _prepare(index, Stage::Write, IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK);
+            sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            sqe->fd = static_cast<int>(index);
+            sqe->addr = reinterpret_cast<uint64_t>(bytes);
+            sqe->len = static_cast<uint32_t>(len);
+            sqe->off = 0;
+            if (fixed)
+                sqe->buf_index = static_cast<uint16_t>(slot.buffer);
+
+            if (_fsync) {
+                sqe = _prepare(index, Stage::Sync, IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK);
+                sqe->opcode = IORING_OP_FSYNC;
+                sqe->fd = static_cast<int>(index);
+            }
+
+            sqe = _prepare(index, Stage::Close, 0);
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->file_index = index + 1;
+
+            if (++_unsubmitted >= _submitBatch)
+                _submit(0);
+            else
+                _reap(false);
+            return true;
+        }
+
+        void drain() override {
+            while (_free.size() < _slots.size())
+                _reap(true);
+        }
+
+        [[nodiscard]] const char *backend() const override { return "io_uring"; }
+
+    private:
+        enum class Stage : uint64_t { Unlink, Open, Write, Sync, Close };
+
+        static constexpr unsigned MAX_CHAIN = 5;                        // requests per file
+        static constexpr size_t MAX_BUFFER_SIZE = 4 << 20;             // larger images go from the heap
+        static constexpr size_t REGISTERED_MEMORY = size_t(32) << 20;  // for all buffers together
+
+        struct Slot {
+            std::string path;
+            std::vector<uint8_t> heap;  // the image, if not in the registered buffer
+            size_t len = 0;
+            Callback done;
+            unsigned pending = 0;       // completions still to come
+            int buffer = -1;            // registered buffer holding the image, if any
+            bool ok = true;
+            bool opened = false;
+        };
+
+        IoUring _ring;
+        bool _replace;
+        bool _fsync;
+        bool _buffersRegistered = false;
+        std::unique_ptr<uint8_t[]> _buffers;
+        size_t _bufferSize = 0;
+        std::vector<unsigned> _freeBuffers;
+        std::vector<Slot> _slots;
+        std::vector<unsigned> _free;    // slot indices
+        unsigned _unsubmitted = 0;      // files queued since the last submit
+        unsigned _submitBatch = 1;
+
+        // one buffer per slot, each 1.25 times the first image rounded up to a power of two
+        void _registerBuffers(size_t imageSize) {
+            _buffersRegistered = true;
+            if (!_ring.supports(IORING_OP_WRITE_FIXED))
+                return;
+            size_t size = 16 * 1024;
+            while (size < imageSize + imageSize / 4 && size < MAX_BUFFER_SIZE)
+                size *= 2;
+            if (size < imageSize)
+                return;
+            // the buffers are pinned and count against RLIMIT_MEMLOCK: if that is low, take fewer
+            auto count = static_cast<unsigned>(std::min<size_t>(_slots.size(), REGISTERED_MEMORY / size));
+            for (; count > 0; count /= 2) {
+                std::unique_ptr<uint8_t[]> memory(new uint8_t[count * size]);
+                std::vector<iovec> iovecs(count);
+                for (unsigned i = 0; i < count; i++)
+                    iovecs[i] = iovec{memory.get() + i * size, size};
+                if (_ring.registerBuffers(iovecs.data(), count) == 0) {
+                    _buffers = std::move(memory);
+                    _bufferSize = size;
+                    for (unsigned i = count; i-- > 0;)
+                        _freeBuffers.push_back(i);
+                    return;
+                }
+            }
+        }
+
+        io_uring_sqe *_prepare(unsigned index, Stage stage, uint8_t flags) {
+            io_uring_sqe *sqe = _ring.sqe(); // never full: MAX_CHAIN entries per slot
+            sqe->flags = flags;
+            sqe->user_data = (static_cast<uint64_t>(index) << 3) | static_cast<uint64_t>(stage);
+            _slots[index].pending++;
+            return sqe;
+        }
+
+        void _submit(unsigned waitFor) {
+            while (true) {
+                int rc = _ring.submit(waitFor);
+                if (rc >= 0 && _ring.unsubmitted() == 0)
+                    break;
+                if (rc < 0 && rc != -EAGAIN && rc != -EBUSY)
+                    std::terminate(); // the ring is unusable; files in flight would never complete
+                // completions are backed up, or only part of the chains went in: make room and retry
+                io_uring_cqe cqe;
+                while (_ring.popCompletion(cqe))
+                    _complete(cqe);
+            }
+            _unsubmitted = 0;
+        }
+
+        // @wait: block until at least one completion is ready; only while files are in flight
+        void _reap(bool wait) {
+            if (wait) {
+                if (_unsubmitted > 0) {
+                    _submit(1);
+                } else {
+                    int rc = _ring.wait(1);
+                    if (rc < 0 && rc != -EINTR)
+                        std::terminate();
+                }
+            }
+            io_uring_cqe cqe;
+            while (_ring.popCompletion(cqe))
+                _complete(cqe);
+        }
+
+        void _complete(const io_uring_cqe &cqe) {
+            unsigned index = static_cast<unsigned>(cqe.user_data >> 3);
+            Slot &slot = _slots[index];
+            switch (static_cast<Stage>(cqe.user_data & 7)) {
+                case Stage::Unlink:
+                    break;
+                case Stage::Open:
+                    slot.opened = cqe.res >= 0;
+                    slot.ok = slot.ok && slot.opened;
+                    break;
+                case Stage::Write:
+                    slot.ok = slot.ok && cqe.res >= 0 && static_cast<size_t>(cqe.res) == slot.len;
+                    break;
+                case Stage::Sync:
+                case Stage::Close:
+                    slot.ok = slot.ok && cqe.res >= 0;
+                    break;
+            }
+            if (--slot.pending > 0)
+                return;
+
+            // an existing file that made the open fail (no replace) is not ours to remove
+            if (!slot.ok && slot.opened)
+                ::unlink(slot.path.c_str());
+            Callback done = std::move(slot.done);
+            bool ok = slot.ok;
+            if (slot.buffer >= 0)
+                _freeBuffers.push_back(static_cast<unsigned>(slot.buffer));
+            _free.push_back(index);
+            done(ok);
+        }
+    };
+#endif
+}
+
+std::unique_ptr<BatchFileWriter> BatchFileWriter::create(bool batched, unsigned depth, bool replace, bool fsync) {
+#if defined(__linux__)
+    if (batched) {
+        try {
+            return std::make_unique<UringFileWriter>(depth, replace, fsync);
+        } catch (const std::exception &) {
+            // no io_uring, or a kernel before 5.19: write one by one
+        }
+    }
+#else
+    (void) batched;
+    (void) depth;
+#endif
+    return std::make_unique<SyncFileWriter>(replace, fsync);
+}
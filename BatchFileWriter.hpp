@@ -0,0 +1,50 @@
+//
+// Many small files written with few system calls: io_uring request chains, or one by one.
+//
+
+#ifndef BATCH_FILE_WRITER_HPP
+#define BATCH_FILE_WRITER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+/* Writes whole files for a single thread, e.g. the writer stage of a
+ * bulk run. Unlike AsyncFileWriter there is no background thread: with
+ * io_uring, write() queues the file's requests and hands a batch of
+ * files to the kernel in one system call, and completions are collected
+ * by later write() calls and by drain(). Callbacks therefore run on the
+ * caller's thread, inside those calls.
+ *
+ * Files are written in place, not through a temp file; a file whose
+ * write fails is removed. */
+class BatchFileWriter {
+public:
+    using Callback = std::function<void(bool ok)>;
+
+    virtual ~BatchFileWriter() = default;
+
+    /** Starts writing @len bytes from @data to @path. The bytes are copied,
+     * so the caller may reuse @data at once.
+     * @return false if the write failed already, @done is then not called;
+     * otherwise @done is called once the file is complete (true) or failed */
+    virtual bool write(const std::string &path, const uint8_t *data, size_t len, Callback done) = 0;
+
+    /** Waits until every write started so far has completed. */
+    virtual void drain() = 0;
+
+    /** @return "io_uring" or "sync" */
+    [[nodiscard]] virtual const char *backend() const = 0;
+
+    /** @batched io_uring with up to @depth files in flight, if the kernel
+     * supports it (Linux 5.19+); otherwise, or if not @batched, every file
+     * is written before write() returns.
+     * @replace: replace existing files (removed first, so hard links to them
+     * keep the old content); else a write to an existing file fails.
+     * @fsync: flush each file to the device before it counts as complete */
+    static std::unique_ptr<BatchFileWriter> create(bool batched, unsigned depth, bool replace, bool fsync);
+};
+
+#endif //BATCH_FILE_WRITER_HPP
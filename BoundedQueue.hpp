@@ -0,0 +1,79 @@
+//
+// Bounded blocking queue connecting the stages of the bulk pipelines.
+//
+
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/* A multi-producer, multi-consumer FIFO holding at most @capacity items.
+ * push() blocks while the queue is full, which is what gives a pipeline
+ * backpressure: a slow stage stalls the stages feeding it instead of
+ * letting them buffer without bound. */
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : _capacity(capacity > 0 ? capacity : 1) {}
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /** Waits for room, then appends @item.
+     * @return false (dropping @item) if the queue was closed */
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _notFull.wait(lock, [this] { return _closed || _items.size() < _capacity; });
+        if (_closed)
+            return false;
+        _items.push_back(std::move(item));
+        _notEmpty.notify_one();
+        return true;
+    }
+
+    /** Waits for an item and moves it into @item.
+     * @return false once the queue is closed and drained */
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _notEmpty.wait(lock, [this] { return _closed || !_items.empty(); });
+        if (_items.empty())
+            return false;
+        item = std::move(_items.front());
+        _items.pop_front();
+        _notFull.notify_one();
+        return true;
+    }
+
+    /** Like pop(), but returns false right away instead of waiting. */
+    bool tryPop(T &item) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_items.empty())
+            return false;
+        item = std::move(_items.front());
+        _items.pop_front();
+        _notFull.notify_one();
+        return true;
+    }
+
+    /** No more pushes; consumers drain what is left and then see pop() fail. */
+    void close() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _notFull.notify_all();
+        _notEmpty.notify_all();
+    }
+
+private:
+    const size_t _capacity;
+    std::mutex _mutex;
+    std::condition_variable _notFull;
+    std::condition_variable _notEmpty;
+    std::deque<T> _items;
+    bool _closed = false;
+};
+
+#endif //BOUNDED_QUEUE_HPP
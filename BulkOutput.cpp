@@ -0,0 +1,194 @@
+//
+// Destinations for the images produced by bulk generation.
+//
+
+#include "BulkOutput.hpp"
+#include "ContentHash.hpp"
+#include "QrToPng.h"
+
+#include <cstdio>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+    // size and modification time, which the index compares to tell a file
+    // changed since it was recorded; @return false if @path cannot be read
+    bool fileStamp(const std::string &path, uint64_t &size, int64_t &mtime) {
+        std::error_code ec;
+        size = fs::file_size(path, ec);
+        if (ec)
+            return false;
+        auto time = fs::last_write_time(path, ec);
+        if (ec)
+            return false;
+        mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+        return true;
+    }
+}
+
+DirectoryOutput::DirectoryOutput(std::string dir, bool overwriteExistingFiles) :
+        _dir(std::move(dir)), _overwriteExistingFiles(overwriteExistingFiles),
+        _files(BatchFileWriter::create(false, 0, overwriteExistingFiles, false)) {
+    std::error_code ec;
+    if (_dir.empty())
+        _dir = ".";
+    fs::create_directories(_dir, ec);
+    if (!fs::is_directory(_dir))
+        throw std::runtime_error("Cannot create directory " + _dir);
+    // a missing or damaged index only costs the embedded hash checks
+    _loadIndex(_path(INDEX_NAME), _previous);
+}
+
+const char *DirectoryOutput::setBatchedWrites(bool batched, unsigned depth, bool fsync) {
+    _files = BatchFileWriter::create(batched, depth, _overwriteExistingFiles, fsync);
+    return _files->backend();
+}
+
+bool DirectoryOutput::write(const std::string &name, const uint8_t *data, size_t len, const std::string &hash) {
+    // the writer removes an existing file first: writing in place would also change every hard link to it
+    _inFlight.insert(name);
+    bool started = _files->write(_path(name), data, len, [this, name, hash, len](bool ok) {
+        _inFlight.erase(name);
+        uint64_t size;
+        int64_t mtime;
+        if (ok && fileStamp(_path(name), size, mtime))
+            _record(name, hash, size, mtime);
+        else if (!ok)
+            _failedWrites.push_back(FailedWrite{name, len});
+    });
+    if (!started)
+        _inFlight.erase(name);
+    return started;
+}
+
+bool DirectoryOutput::link(const std::string &name, const std::string &existing, const std::string &hash) {
+    if (_inFlight.count(existing))
+        _files->drain(); // the link needs the complete file
+    std::string path = _path(name);
+    std::error_code ec;
+    if (fs::exists(path, ec)) {
+        if (!_overwriteExistingFiles)
+            return false;
+        fs::remove(path, ec);
+    }
+    fs::create_hard_link(_path(existing), path, ec);
+    if (ec) {
+        // e.g. a file system without hard links: a copy still saves the encoding
+        ec.clear();
+        fs::copy_file(_path(existing), path, ec);
+        if (ec)
+            return false;
+    }
+    uint64_t size;
+    int64_t mtime;
+    if (!fileStamp(path, size, mtime))
+        return false;
+    _record(name, hash, size, mtime);
+    return true;
+}
+
+bool DirectoryOutput::isCurrent(const std::string &name, const std::string &hash) {
+    std::string path = _path(name);
+    uint64_t size;
+    int64_t mtime;
+    if (!fileStamp(path, size, mtime))
+        return false;
+
+    auto it = _previous.find(name);
+    if (it != _previous.end() && it->second.size == size && it->second.mtime == mtime)
+        return it->second.hash == hash;
+
+    // not indexed (or changed since): the file itself says what it holds
+    if (ContentHash::readEmbedded(path) != hash)
+        return false;
+    _record(name, hash, size, mtime);
+    return true;
+}
+
+bool DirectoryOutput::finish() {
+    _files->drain();
+    std::lock_guard<std::mutex> lock(_currentMutex);
+    if (!_partialIndex.empty())
+        return _writeIndex(_partialIndex, _current);
+    if (_current.empty())
+        return true;
+
+    for (auto &entry : _previous)
+        _current.emplace(entry.first, entry.second); // keeps this run's entries
+    return _writeIndex(_path(INDEX_NAME), _current);
+}
+
+std::vector<BulkOutput::FailedWrite> DirectoryOutput::takeFailedWrites() {
+    return std::exchange(_failedWrites, {});
+}
+
+bool DirectoryOutput::mergeIndex(const std::string &path) {
+    std::lock_guard<std::mutex> lock(_currentMutex);
+    return _loadIndex(path, _current);
+}
+
+std::string DirectoryOutput::_path(const std::string &name) const {
+    return (fs::path(_dir) / name).string();
+}
+
+void DirectoryOutput::_record(const std::string &name, const std::string &hash, uint64_t size, int64_t mtime) {
+    if (hash.empty())
+        return;
+    std::lock_guard<std::mutex> lock(_currentMutex);
+    _current[name] = IndexEntry{hash, size, mtime};
+}
+
+bool DirectoryOutput::_loadIndex(const std::string &path, std::unordered_map<std::string, IndexEntry> &into) {
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    std::string line;
+    // an index of another version (1 had no mtime) is ignored: its files get the embedded hash check
+    if (!std::getline(in, line) || line.compare(0, std::strlen(INDEX_HEADER), INDEX_HEADER) != 0)
+        return true;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        size_t hashEnd = line.find(' ');
+        size_t sizeEnd = hashEnd == std::string::npos ? hashEnd : line.find(' ', hashEnd + 1);
+        size_t mtimeEnd = sizeEnd == std::string::npos ? sizeEnd : line.find(' ', sizeEnd + 1);
+        if (mtimeEnd == std::string::npos)
+            continue;
+        char *end = nullptr;
+        unsigned long long size = std::strtoull(line.c_str() + hashEnd + 1, &end, 10);
+        if (end != line.c_str() + sizeEnd)
+            continue;
+        long long mtime = std::strtoll(line.c_str() + sizeEnd + 1, &end, 10);
+        if (end != line.c_str() + mtimeEnd)
+            continue;
+        into[line.substr(mtimeEnd + 1)] = IndexEntry{line.substr(0, hashEnd), size, mtime};
+    }
+    return true;
+}
+
+bool DirectoryOutput::_writeIndex(const std::string &path, const std::unordered_map<std::string, IndexEntry> &entries) {
+    std::string tmp = path + ".tmp";
+    std::FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+    std::setvbuf(f, nullptr, _IOFBF, 1 << 20);
+    bool ok = std::fprintf(f, "%s: hash size mtime name\n", INDEX_HEADER) > 0;
+    for (const auto &entry : entries)
+        ok = std::fprintf(f, "%s %llu %lld %s\n", entry.second.hash.c_str(),
+                          static_cast<unsigned long long>(entry.second.size),
+                          static_cast<long long>(entry.second.mtime), entry.first.c_str()) > 0 && ok;
+    ok = std::fclose(f) == 0 && ok;
+
+    std::error_code ec;
+    if (ok)
+        fs::rename(tmp, path, ec);
+    if (!ok || ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,136 @@
+//
+// Destinations for the images produced by bulk generation.
+//
+
+#ifndef BULK_OUTPUT_HPP
+#define BULK_OUTPUT_HPP
+
+#include "BatchFileWriter.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/* Receives finished images from the writer stage, one at a time and
+ * always from the same thread. Only isCurrent() is called from the
+ * encoder threads, concurrently. */
+class BulkOutput {
+public:
+    virtual ~BulkOutput() = default;
+
+    struct FailedWrite {
+        std::string name;
+        uint64_t size;
+    };
+
+    /** Stores @len bytes as @name, a plain file name without directories.
+     * @hash is the image's content hash (see ContentHash). An output may
+     * complete the write later; a failure then shows up in takeFailedWrites().
+     * @return false if the image could not be stored */
+    virtual bool write(const std::string &name, const uint8_t *data, size_t len, const std::string &hash) = 0;
+
+    /** Stores @name as a duplicate of @existing, an image already stored in this
+     * run (or found current), without its bytes.
+     * @return false if the output cannot reference @existing; the caller then writes the image */
+    virtual bool link(const std::string & /*name*/, const std::string & /*existing*/, const std::string & /*hash*/) {
+        return false;
+    }
+
+    /** @return true if @name already holds the image with @hash from an earlier run,
+     * so it needs neither rendering nor writing */
+    virtual bool isCurrent(const std::string & /*name*/, const std::string & /*hash*/) { return false; }
+
+    /** Called once after the last write. @return false if completing the output failed */
+    virtual bool finish() { return true; }
+
+    /** @return the images accepted by write() that could not be stored after
+     * all, each reported once; outputs that write synchronously have none */
+    virtual std::vector<FailedWrite> takeFailedWrites() { return {}; }
+};
+
+/* One file per image in a directory, which is created if needed.
+ *
+ * The hash of every image is recorded in a sidecar index, INDEX_NAME in
+ * the directory, with the file's size and modification time, so the next
+ * run can tell unchanged files without opening them. Files not in the
+ * index, or whose size or time differ from it, are checked by their
+ * embedded hash.
+ * Duplicates are hard links to the first file with the same content.
+ *
+ * Files are written by a BatchFileWriter, one by one unless
+ * setBatchedWrites() switches to io_uring.
+ *
+ * Several processes can share one directory if each writes a partial
+ * index (setPartialIndex) and one of them merges those afterwards
+ * (mergeIndex), as the bulk coordinator does. */
+class DirectoryOutput : public BulkOutput {
+public:
+    /** Throws std::runtime_error if @dir cannot be created. */
+    DirectoryOutput(std::string dir, bool overwriteExistingFiles);
+
+    bool write(const std::string &name, const uint8_t *data, size_t len, const std::string &hash) override;
+
+    bool link(const std::string &name, const std::string &existing, const std::string &hash) override;
+
+    bool isCurrent(const std::string &name, const std::string &hash) override;
+
+    /** Waits for the files in flight and writes the updated index. */
+    bool finish() override;
+
+    std::vector<FailedWrite> takeFailedWrites() override;
+
+    /** Writes files through io_uring with up to @depth in flight, if the kernel
+     * supports it. @fsync: flush every file to the device, batched or not.
+     * Call before the first write().
+     * @return the backend now in use, "io_uring" or "sync" */
+    const char *setBatchedWrites(bool batched, unsigned depth, bool fsync);
+
+    /** Makes finish() write only the entries of this run, to @path, and
+     * leave INDEX_NAME alone. */
+    void setPartialIndex(std::string path) { _partialIndex = std::move(path); }
+
+    /** Adds the entries of a partial index at @path; they replace older
+     * ones when finish() writes the index.
+     * @return false if @path cannot be read */
+    bool mergeIndex(const std::string &path);
+
+    static constexpr const char *INDEX_NAME = ".qrgen-index";
+
+private:
+    static constexpr const char *INDEX_HEADER = "# qrgen index 2";
+
+    struct IndexEntry {
+        std::string hash;
+        uint64_t size;
+        int64_t mtime; // nanoseconds since the file clock's epoch
+    };
+
+    std::string _dir;
+    bool _overwriteExistingFiles;
+    std::string _partialIndex;
+    std::unordered_set<std::string> _inFlight;  // names written but not complete yet
+    std::vector<FailedWrite> _failedWrites;
+
+    std::unordered_map<std::string, IndexEntry> _previous; // as loaded, read-only during the run
+    std::mutex _currentMutex;
+    std::unordered_map<std::string, IndexEntry> _current;   // written or verified in this run
+
+    // last, so it is destroyed first: it waits for completions that use the members above
+    std::unique_ptr<BatchFileWriter> _files;
+
+    [[nodiscard]] std::string _path(const std::string &name) const;
+
+    void _record(const std::string &name, const std::string &hash, uint64_t size, int64_t mtime);
+
+    /* @return false if @path cannot be opened; damaged lines are skipped */
+    static bool _loadIndex(const std::string &path, std::unordered_map<std::string, IndexEntry> &into);
+
+    static bool _writeIndex(const std::string &path, const std::unordered_map<std::string, IndexEntry> &entries);
+};
+
+#endif //BULK_OUTPUT_HPP
@@ -0,0 +1,332 @@
+//
+// Manifest-driven bulk generation as a pipeline of concurrent stages.
+//
+
+#include "BulkRunner.hpp"
+#include "BoundedQueue.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+namespace {
+    struct Result {
+        uint64_t index = 0;
+        uint64_t line = 0;
+        std::string name;
+        std::vector<uint8_t> image;
+        std::string error; // empty on success
+        std::string hash;
+        bool unchanged = false;   // the output already holds this image
+        bool first = false;       // the first entry with its hash, in _firstByHash
+        std::string duplicateOf;  // not rendered: same hash as this earlier entry
+        std::string text;         // kept for duplicates, in case the output cannot link
+        bool linked = false;
+    };
+
+    // only the first few failures are printed, the rest are counted
+    constexpr uint64_t MAX_REPORTED_ERRORS = 100;
+
+    // duplicates that may wait in the writer for one image still being
+    // rendered; past that they are rendered themselves
+    constexpr uint64_t MAX_WAITING_DUPLICATES = 64;
+}
+
+BulkRunner::BulkRunner(BulkOptions options, BulkOutput &output) : _options(std::move(options)), _output(output) {
+    if (_options.jobs == 0)
+        _options.jobs = std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::string BulkRunner::outputName(std::string_view name, uint64_t index, const char *extension) {
+    std::string out;
+    out.reserve(name.size() + 8);
+    for (char c : name) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '/' || c == '\\' || c == ':' || u < 0x20 || u == 0x7F)
+            out.push_back('_');
+        else
+            out.push_back(c);
+    }
+    if (out.empty() || out == "." || out == "..")
+        out = std::to_string(index);
+
+    // "code0.png" stays as it is rather than becoming "code0.png.png"
+    size_t extLen = std::char_traits<char>::length(extension);
+    bool hasExtension = out.size() > extLen &&
+            std::equal(out.end() - extLen, out.end(), extension, [](char a, char b) {
+                return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+            });
+    return hasExtension ? out : out + extension;
+}
+
+std::vector<uint8_t> BulkRunner::_takeBuffer() {
+    std::lock_guard<std::mutex> lock(_freeMutex);
+    if (_freeBuffers.empty())
+        return {};
+    std::vector<uint8_t> buffer = std::move(_freeBuffers.back());
+    _freeBuffers.pop_back();
+    return buffer;
+}
+
+void BulkRunner::_returnBuffer(std::vector<uint8_t> buffer) {
+    std::lock_guard<std::mutex> lock(_freeMutex);
+    // every buffer in flight can come back, more are never needed
+    if (_freeBuffers.size() < 2 * _options.queueDepth + _options.jobs)
+        _freeBuffers.push_back(std::move(buffer));
+}
+
+void BulkRunner::_releaseFirst(std::unordered_map<std::string, First>::iterator first) {
+    First &f = first->second;
+    if (f.recent == _recentHashes.end() && f.duplicates == 0 && f.state != FirstState::Pending)
+        _firstByHash.erase(first);
+}
+
+BulkStats BulkRunner::run() {
+    MappedFile manifest(_options.manifestPath);
+    ManifestReader reader(manifest.view(), _options.format);
+
+    BoundedQueue<ManifestRow> rows(_options.queueDepth);
+    BoundedQueue<Result> results(_options.queueDepth);
+
+    std::atomic<uint64_t> parsed{0}, written{0}, failed{0}, bytes{0};
+    std::atomic<uint64_t> reported{0};
+    auto report = [&reported](uint64_t line, const std::string &name, const std::string &error) {
+        if (reported++ >= MAX_REPORTED_ERRORS)
+            return;
+        if (line == 0) // known by name only
+            std::cerr << "qrgen: " << name << ": " << error << std::endl;
+        else
+            std::cerr << "qrgen: line " << line << (name.empty() ? "" : " (" + name + ")") << ": " << error << std::endl;
+    };
+    // images the output accepted but failed to store afterwards were counted as written
+    auto collectFailedWrites = [&] {
+        for (const BulkOutput::FailedWrite &failure : _output.takeFailedWrites()) {
+            written--;
+            bytes -= failure.size;
+            failed++;
+            report(0, failure.name, "cannot write " + failure.name);
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    // stage 1: parse
+    std::thread parser([&] {
+        ManifestRow row;
+        while (reader.next(row)) {
+            parsed++;
+            if (!rows.push(std::move(row)))
+                break;
+            row = ManifestRow();
+        }
+        rows.close();
+    });
+
+    // stage 2: encode, rasterize and compress
+    std::atomic<unsigned> encodersLeft{_options.jobs};
+    std::vector<std::thread> encoders;
+    for (unsigned i = 0; i < _options.jobs; i++) {
+        encoders.emplace_back([&] {
+            ManifestRow row;
+            while (rows.pop(row)) {
+                Result result;
+                result.index = row.index;
+                result.line = row.line;
+                result.name = outputName(row.name(), row.index, _options.render.extension());
+                if (row.error.empty()) {
+                    // the hash is far cheaper than rendering, so it decides first
+                    result.hash = _options.render.contentHash(row.text());
+                    result.unchanged = _options.skipUnchanged && _output.isCurrent(result.name, result.hash);
+                    if (_options.dedup && _options.dedupWindow > 0) {
+                        std::lock_guard<std::mutex> lock(_firstMutex);
+                        auto first = _firstByHash.find(result.hash);
+                        if (first == _firstByHash.end()) {
+                            First f;
+                            f.name = result.name;
+                            _recentHashes.push_front(result.hash);
+                            f.recent = _recentHashes.begin();
+                            _firstByHash.emplace(result.hash, std::move(f));
+                            result.first = true;
+                            if (_recentHashes.size() > _options.dedupWindow) {
+                                auto oldest = _firstByHash.find(_recentHashes.back());
+                                _recentHashes.pop_back();
+                                oldest->second.recent = _recentHashes.end();
+                                _releaseFirst(oldest);
+                            }
+                        } else {
+                            if (first->second.recent != _recentHashes.end())
+                                _recentHashes.splice(_recentHashes.begin(), _recentHashes, first->second.recent);
+                            bool mayWait = first->second.state != FirstState::Pending ||
+                                           first->second.duplicates < MAX_WAITING_DUPLICATES;
+                            if (!result.unchanged && mayWait) {
+                                result.duplicateOf = first->second.name;
+                                first->second.duplicates++;
+                            }
+                        }
+                    }
+                    if (!result.duplicateOf.empty()) {
+                        result.text = std::string(row.text());
+                    } else if (!result.unchanged) {
+                        result.image = _takeBuffer();
+                        if (!renderQr(row.text(), _options.render, result.image, &result.error) && result.error.empty())
+                            result.error = "encoding failed";
+                    }
+                } else {
+                    result.error = row.error;
+                }
+                if (!results.push(std::move(result)))
+                    break;
+            }
+            if (--encodersLeft == 0)
+                results.close();
+        });
+    }
+
+    // stage 3: write
+    std::atomic<uint64_t> unchanged{0}, linked{0};
+    std::thread writer([&] {
+        auto account = [&](Result &result) {
+            if (!result.error.empty()) {
+                failed++;
+                report(result.line, result.name, result.error);
+            } else if (result.unchanged) {
+                unchanged++;
+            } else if (result.linked) {
+                linked++;
+            } else {
+                written++;
+                bytes += result.image.size();
+            }
+            _returnBuffer(std::move(result.image));
+        };
+
+        auto storeDuplicate = [&](Result &result, bool firstStored) {
+            if (!firstStored) {
+                result.error = "same image as " + result.duplicateOf + ", which failed";
+            } else if (result.name == result.duplicateOf) {
+                result.unchanged = true; // listed twice, already stored
+            } else if (_output.link(result.name, result.duplicateOf, result.hash)) {
+                result.linked = true;
+            } else {
+                // the output cannot reference the first image: render this one after all
+                result.image = _takeBuffer();
+                if (!renderQr(result.text, _options.render, result.image, &result.error)) {
+                    if (result.error.empty())
+                        result.error = "encoding failed";
+                } else if (!_output.write(result.name, result.image.data(), result.image.size(), result.hash)) {
+                    result.error = "cannot write " + result.name;
+                }
+            }
+            account(result);
+            std::lock_guard<std::mutex> lock(_firstMutex);
+            auto first = _firstByHash.find(result.hash);
+            first->second.duplicates--;
+            _releaseFirst(first);
+        };
+
+        // Encoders finish out of order, so a duplicate can arrive before the
+        // entry it refers to has been stored; it then waits for that entry.
+        // At most MAX_WAITING_DUPLICATES wait per hash (the encoders render
+        // any further ones), and only hashes whose first entry is in flight
+        // have any, so this stays bounded by the queue sizes times that cap.
+        std::unordered_map<std::string, std::vector<Result>> waiting; // content hash -> duplicates
+
+        Result result;
+        while (results.pop(result)) {
+            if (!result.duplicateOf.empty()) {
+                FirstState state;
+                {
+                    std::lock_guard<std::mutex> lock(_firstMutex);
+                    state = _firstByHash.at(result.hash).state; // kept while this duplicate is pending
+                }
+                if (state == FirstState::Pending)
+                    waiting[result.hash].push_back(std::move(result));
+                else
+                    storeDuplicate(result, state == FirstState::Stored);
+                continue;
+            }
+
+            if (result.error.empty() && !result.unchanged &&
+                !_output.write(result.name, result.image.data(), result.image.size(), result.hash))
+                result.error = "cannot write " + result.name;
+            bool ok = result.error.empty();
+            account(result);
+            collectFailedWrites();
+
+            if (result.first) {
+                {
+                    std::lock_guard<std::mutex> lock(_firstMutex);
+                    auto entry = _firstByHash.find(result.hash);
+                    entry->second.state = ok ? FirstState::Stored : FirstState::Failed;
+                    _releaseFirst(entry);
+                }
+                auto duplicates = waiting.find(result.hash);
+                if (duplicates != waiting.end()) {
+                    for (Result &duplicate : duplicates->second)
+                        storeDuplicate(duplicate, ok);
+                    waiting.erase(duplicates);
+                }
+            }
+        }
+        for (auto &duplicates : waiting) {
+            for (Result &duplicate : duplicates.second)
+                storeDuplicate(duplicate, false);
+        }
+    });
+
+    // progress, until the writer has seen everything
+    auto printProgress = [&](bool final) {
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        uint64_t done = written + unchanged + linked + failed;
+        std::fprintf(stderr, "\r%llu/%llu done, %llu failed, %.0f items/s%s",
+                     static_cast<unsigned long long>(done), static_cast<unsigned long long>(parsed.load()),
+                     static_cast<unsigned long long>(failed.load()), secs > 0 ? done / secs : 0.0,
+                     final ? "\n" : "   ");
+        std::fflush(stderr);
+    };
+    std::atomic<bool> finished{false};
+    std::thread progress;
+    if (_options.progress) {
+        progress = std::thread([&] {
+            while (!finished) {
+                for (int i = 0; i < 10 && !finished; i++)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                if (!finished)
+                    printProgress(false);
+            }
+        });
+    }
+
+    parser.join();
+    for (auto &t : encoders)
+        t.join();
+    writer.join();
+    finished = true;
+    if (progress.joinable())
+        progress.join();
+
+    if (!_output.finish()) {
+        std::cerr << "qrgen: failed to complete the output" << std::endl;
+        failed++;
+    }
+    collectFailedWrites();
+
+    BulkStats stats;
+    stats.rows = parsed;
+    stats.written = written;
+    stats.unchanged = unchanged;
+    stats.linked = linked;
+    stats.failed = failed;
+    stats.bytes = bytes;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (_options.progress)
+        printProgress(true);
+    if (reported > MAX_REPORTED_ERRORS)
+        std::cerr << "qrgen: " << (reported - MAX_REPORTED_ERRORS) << " more errors not shown" << std::endl;
+    return stats;
+}
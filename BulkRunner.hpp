@@ -0,0 +1,102 @@
+//
+// Manifest-driven bulk generation as a pipeline of concurrent stages.
+//
+
+#ifndef BULK_RUNNER_HPP
+#define BULK_RUNNER_HPP
+
+#include "BulkOutput.hpp"
+#include "Manifest.hpp"
+#include "QrRender.hpp"
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct BulkOptions {
+    std::string manifestPath;
+    ManifestReader::Format format = ManifestReader::Format::Csv;
+    QrRenderSettings render;
+    unsigned jobs = 0;          // encoder threads, 0 = one per core
+    size_t queueDepth = 256;    // max items waiting between two stages
+    bool progress = true;       // report progress on stderr
+    bool skipUnchanged = true;  // leave outputs alone that already hold their image
+    bool dedup = true;          // encode identical images once, link the duplicates
+    size_t dedupWindow = 65536; // distinct images remembered for dedup, most recent first
+};
+
+struct BulkStats {
+    uint64_t rows = 0;      // manifest entries read
+    uint64_t written = 0;   // images stored
+    uint64_t unchanged = 0; // outputs already up to date, skipped
+    uint64_t linked = 0;    // duplicates stored as links to an identical image
+    uint64_t failed = 0;    // entries that could not be parsed, encoded or stored
+    uint64_t bytes = 0;     // image bytes stored
+    double seconds = 0;
+
+    [[nodiscard]] double itemsPerSecond() const { return seconds > 0 ? static_cast<double>(rows) / seconds : 0; }
+};
+
+/* Runs parse -> encode/rasterize/compress -> write over a manifest.
+ *
+ * One thread parses the memory-mapped manifest, @jobs threads render
+ * images with renderQr(), and one thread hands them to the BulkOutput.
+ * The stages are joined by BoundedQueues of @queueDepth items, so memory
+ * use depends on the queue depth and not on the manifest size, and a
+ * slow disk throttles parsing instead of piling up images.
+ *
+ * Every entry's content hash (ContentHash) is computed before rendering:
+ * entries whose output already holds that hash are skipped, and entries
+ * with the hash of an earlier entry are not rendered again but stored as
+ * links to it, where the output supports that. Only the last @dedupWindow
+ * distinct hashes are remembered, so dedup state stays bounded too; a
+ * duplicate of an older image is rendered again. */
+class BulkRunner {
+public:
+    BulkRunner(BulkOptions options, BulkOutput &output);
+
+    /** Processes the whole manifest.
+     * Throws std::runtime_error if the manifest cannot be read. */
+    BulkStats run();
+
+    /** File name for a manifest entry: its name with path separators and
+     * control characters replaced, or its index if it has no usable name.
+     * @extension is appended unless the name already ends with it, in any case. */
+    static std::string outputName(std::string_view name, uint64_t index, const char *extension);
+
+private:
+    BulkOptions _options;
+    BulkOutput &_output;
+
+    // rendered images go back here once written, so buffers are reused
+    std::mutex _freeMutex;
+    std::vector<std::vector<uint8_t>> _freeBuffers;
+
+    // The first entry with a content hash, shared by the encoders (which
+    // mark later entries with the hash as its duplicates) and the writer
+    // (which stores it, then links the duplicates). An entry is kept while
+    // its hash is among the last dedupWindow ones, or while duplicates of
+    // it have not been handled by the writer yet.
+    enum class FirstState { Pending, Stored, Failed };
+    struct First {
+        std::string name;
+        FirstState state = FirstState::Pending;
+        uint64_t duplicates = 0;                 // marked but not handled yet
+        std::list<std::string>::iterator recent; // in _recentHashes, or its end() once evicted
+    };
+    std::mutex _firstMutex;
+    std::unordered_map<std::string, First> _firstByHash; // content hash -> first entry
+    std::list<std::string> _recentHashes;                // most recent first
+
+    std::vector<uint8_t> _takeBuffer();
+
+    void _returnBuffer(std::vector<uint8_t> buffer);
+
+    // with _firstMutex held: drops the entry once nothing can refer to it any more
+    void _releaseFirst(std::unordered_map<std::string, First>::iterator first);
+};
+
+#endif //BULK_RUNNER_HPP
@@ -0,0 +1,110 @@
+/*
+ * Byte sinks for TinyPngOut
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include "ByteSink.hpp"
+
+#if defined(_WIN32)
+#include <io.h>
+#define SINK_WRITE_FD(fd, buf, len) ::_write((fd), (buf), static_cast<unsigned int>(len))
+#else
+#include <unistd.h>
+#define SINK_WRITE_FD(fd, buf, len) ::write((fd), (buf), (len))
+#endif
+
+using std::uint8_t;
+using std::size_t;
+
+
+OstreamSink::OstreamSink(std::ostream &out) :
+	output(out) {}
+
+
+void OstreamSink::write(const uint8_t data[], size_t len) {
+	output.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(len));
+}
+
+
+void OstreamSink::flush() {
+	output.flush();
+}
+
+
+
+VectorSink::VectorSink(std::vector<uint8_t> &out) :
+	output(out) {}
+
+
+void VectorSink::write(const uint8_t data[], size_t len) {
+	output.insert(output.end(), data, data + len);
+}
+
+
+
+SpanSink::SpanSink(uint8_t buf[], size_t cap) :
+		data(buf),
+		capacity(cap),
+		filled(0) {
+	if (data == nullptr && capacity > 0)
+		throw std::invalid_argument("Null pointer");
+}
+
+
+void SpanSink::write(const uint8_t buf[], size_t len) {
+	if (len > capacity - filled)
+		throw std::length_error("Buffer too small");
+	std::memcpy(data + filled, buf, len);
+	filled += len;
+}
+
+
+size_t SpanSink::size() const {
+	return filled;
+}
+
+
+
+FileSink::FileSink(std::FILE *f) :
+		file(f) {
+	if (file == nullptr)
+		throw std::invalid_argument("Null file");
+}
+
+
+void FileSink::write(const uint8_t data[], size_t len) {
+	if (std::fwrite(data, 1, len, file) != len)
+		throw std::runtime_error("File write failed");
+}
+
+
+void FileSink::flush() {
+	if (std::fflush(file) != 0)
+		throw std::runtime_error("File flush failed");
+}
+
+
+
+FdSink::FdSink(int fileDesc) :
+		fd(fileDesc) {
+	if (fd < 0)
+		throw std::invalid_argument("Invalid file descriptor");
+}
+
+
+void FdSink::write(const uint8_t data[], size_t len) {
+	while (len > 0) {
+		// Keep single calls well below INT_MAX, which some platforms cannot return
+		size_t n = len < (size_t{1} << 30) ? len : (size_t{1} << 30);
+		auto written = SINK_WRITE_FD(fd, data, n);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			throw std::runtime_error("File descriptor write failed");
+		}
+		data += written;
+		len -= static_cast<size_t>(written);
+	}
+}
@@ -0,0 +1,127 @@
+/*
+ * Byte sinks for TinyPngOut
+ *
+ * TinyPngOut collects its output in an internal buffer and hands it to a sink
+ * in large chunks, so the sink only sees a handful of calls per image.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <vector>
+
+
+/*
+ * Destination for encoded bytes. Implementations must accept any chunk length.
+ */
+class ByteSink {
+
+	public: virtual ~ByteSink() = default;
+
+
+	/*
+	 * Appends 'len' bytes to the destination. Throws std::runtime_error
+	 * if the bytes could not be written (except OstreamSink, see below).
+	 */
+	public: virtual void write(const std::uint8_t data[], std::size_t len) = 0;
+
+
+	/*
+	 * Pushes data held by the sink itself (e.g. stdio buffers) to its destination.
+	 * Called once by TinyPngOut after the last byte of the PNG file.
+	 */
+	public: virtual void flush() {}
+
+};
+
+
+
+/*
+ * Writes to a std::ostream. Errors are reported through the stream state
+ * rather than exceptions, like writing to the stream directly would.
+ */
+class OstreamSink final : public ByteSink {
+
+	private: std::ostream &output;
+
+	public: explicit OstreamSink(std::ostream &out);
+
+	public: void write(const std::uint8_t data[], std::size_t len) override;
+
+	public: void flush() override;
+
+};
+
+
+
+/*
+ * Appends to a std::vector. The vector is not cleared first,
+ * so a caller can reuse its capacity across images.
+ */
+class VectorSink final : public ByteSink {
+
+	private: std::vector<std::uint8_t> &output;
+
+	public: explicit VectorSink(std::vector<std::uint8_t> &out);
+
+	public: void write(const std::uint8_t data[], std::size_t len) override;
+
+};
+
+
+
+/*
+ * Writes into a caller-provided memory block of fixed capacity. Throws
+ * std::length_error instead of writing past the end; size TinyPngOut
+ * output with TinyPngOut::encodedSize() to avoid that.
+ */
+class SpanSink final : public ByteSink {
+
+	private: std::uint8_t *data;
+	private: std::size_t capacity;
+	private: std::size_t filled;
+
+	public: explicit SpanSink(std::uint8_t buf[], std::size_t cap);
+
+	public: void write(const std::uint8_t buf[], std::size_t len) override;
+
+	// Number of bytes written so far.
+	public: std::size_t size() const;
+
+};
+
+
+
+/*
+ * Writes to a stdio stream with fwrite(). The stream is not closed.
+ */
+class FileSink final : public ByteSink {
+
+	private: std::FILE *file;
+
+	public: explicit FileSink(std::FILE *f);
+
+	public: void write(const std::uint8_t data[], std::size_t len) override;
+
+	public: void flush() override;
+
+};
+
+
+
+/*
+ * Writes to a file descriptor with write(), retrying on partial writes
+ * and EINTR. The descriptor is not closed.
+ */
+class FdSink final : public ByteSink {
+
+	private: int fd;
+
+	public: explicit FdSink(int fileDesc);
+
+	public: void write(const std::uint8_t data[], std::size_t len) override;
+
+};
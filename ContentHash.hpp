@@ -0,0 +1,53 @@
+//
+// Stable content hashes for generated images, used to skip unchanged outputs.
+//
+
+#ifndef CONTENT_HASH_HPP
+#define CONTENT_HASH_HPP
+
+#include "QrCode.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/* SHA-256 over a sequence of fields. Every field is length-prefixed, so
+ * ("ab", "c") and ("a", "bc") hash differently. The hash of an image
+ * covers everything that determines its bytes, which makes it usable as
+ * the image's identity: equal hashes mean identical files. */
+class ContentHash {
+public:
+    ContentHash();
+
+    ContentHash &add(std::string_view field);
+
+    ContentHash &add(int64_t value);
+
+    /** @return the digest as 64 lowercase hex digits. Nothing can be added afterwards. */
+    std::string hex();
+
+    /** Hash of the image rendered from @payload with the given settings.
+     * Pass 0 for settings the format does not use (size and module pixels
+     * for SVG, the border for PNG), so they don't change the hash. */
+    static std::string forImage(std::string_view format, std::string_view payload, qrcodegen::QrCode::Ecc ecc,
+                                int size, int modulePixels, int svgBorder);
+
+    /** Reads the hash embedded in a PNG tEXt chunk or SVG comment by the writers.
+     * @return the hash, empty if the file doesn't exist or carries none */
+    static std::string readEmbedded(const std::string &path);
+
+    /* tEXt keyword in PNG files, comment prefix in SVG files */
+    static constexpr const char *KEYWORD = "qrgen-hash";
+
+private:
+    uint32_t _state[8];
+    uint64_t _length = 0;   // bytes added so far
+    uint8_t _block[64];
+    size_t _blockFilled = 0;
+
+    void _update(const uint8_t *data, size_t len);
+
+    void _compress(const uint8_t *block);
+};
+
+#endif //CONTENT_HASH_HPP
@@ -0,0 +1,417 @@
+//
+// Splits a bulk run over several qrgen worker processes and merges their results.
+//
+
+#include "Coordinator.hpp"
+#include "ContentHash.hpp"
+#include "MappedFile.hpp"
+#include "QrToPng.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <sys/wait.h>
+#endif
+
+namespace {
+    // only the first few unparsable manifest entries are printed
+    constexpr uint64_t MAX_REPORTED_ERRORS = 100;
+
+    // FNV-1a: the shard of a name must not depend on the platform or the run
+    uint64_t nameHash(const std::string &name) {
+        uint64_t h = 0xCBF29CE484222325ULL;
+        for (char c : name) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 0x100000001B3ULL;
+        }
+        return h;
+    }
+
+    void appendJsonString(std::string &out, std::string_view s) {
+        out.push_back('"');
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                out.push_back('\\');
+                out.push_back(c);
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            } else {
+                out.push_back(c);
+            }
+        }
+        out.push_back('"');
+    }
+
+    std::string shellQuote(const std::string &arg) {
+#if defined(_WIN32)
+        std::string out = "\"";
+        for (char c : arg) {
+            if (c == '"')
+                out += "\\\"";
+            else
+                out.push_back(c);
+        }
+        return out + "\"";
+#else
+        std::string out = "'";
+        for (char c : arg) {
+            if (c == '\'')
+                out += "'\\''";
+            else
+                out.push_back(c);
+        }
+        return out + "'";
+#endif
+    }
+
+    std::string replaceAll(std::string s, const std::string &from, const std::string &to) {
+        for (size_t pos = s.find(from); pos != std::string::npos; pos = s.find(from, pos + to.size()))
+            s.replace(pos, from.size(), to);
+        return s;
+    }
+
+    // @return the exit code of the command, -1 if it did not exit normally
+    int runCommand(const std::string &command) {
+        int rc = std::system(command.c_str());
+#if defined(_WIN32)
+        return rc;
+#else
+        return rc != -1 && WIFEXITED(rc) ? WEXITSTATUS(rc) : -1;
+#endif
+    }
+
+    std::string absolute(const std::string &path) {
+        std::error_code ec;
+        fs::path p = fs::absolute(path, ec);
+        return ec ? path : p.lexically_normal().string();
+    }
+}
+
+Coordinator::Coordinator(CoordinatorOptions options) : _options(std::move(options)) {
+    _options.workers = std::max(1u, _options.workers);
+    if (_options.shards == 0)
+        _options.shards = _options.workers;
+
+    // workers may run elsewhere, in another working directory
+    _options.manifestPath = absolute(_options.manifestPath);
+    if (_options.archive.empty())
+        _options.outDir = absolute(_options.outDir.empty() ? "." : _options.outDir);
+    else
+        _options.archive = absolute(_options.archive);
+    if (_options.workDir.empty())
+        _options.workDir = _options.archive.empty() ? (fs::path(_options.outDir) / ".qrgen-work").string()
+                                                    : _options.archive + ".qrgen-work";
+    _options.workDir = absolute(_options.workDir);
+}
+
+std::string Coordinator::shardArchive(const std::string &archive, unsigned shard) {
+    fs::path p(archive);
+    std::string name = p.stem().string() + "." + std::to_string(shard) + p.extension().string();
+    return (p.parent_path() / name).string();
+}
+
+bool Coordinator::writeStats(const std::string &path, const BulkStats &stats) {
+    std::FILE *f = std::fopen(path.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = std::fprintf(f, "rows %llu\nwritten %llu\nunchanged %llu\nlinked %llu\nfailed %llu\nbytes %llu\nseconds %.3f\n",
+                           static_cast<unsigned long long>(stats.rows), static_cast<unsigned long long>(stats.written),
+                           static_cast<unsigned long long>(stats.unchanged), static_cast<unsigned long long>(stats.linked),
+                           static_cast<unsigned long long>(stats.failed), static_cast<unsigned long long>(stats.bytes),
+                           stats.seconds) > 0;
+    return std::fclose(f) == 0 && ok;
+}
+
+bool Coordinator::readStats(const std::string &path, BulkStats &stats) {
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    std::string key;
+    double value;
+    int found = 0;
+    while (in >> key >> value) {
+        auto count = static_cast<uint64_t>(value);
+        if (key == "rows") stats.rows = count;
+        else if (key == "written") stats.written = count;
+        else if (key == "unchanged") stats.unchanged = count;
+        else if (key == "linked") stats.linked = count;
+        else if (key == "failed") stats.failed = count;
+        else if (key == "bytes") stats.bytes = count;
+        else if (key == "seconds") stats.seconds = value;
+        else continue;
+        found++;
+    }
+    return found == 7;
+}
+
+uint64_t Coordinator::_split(std::vector<Shard> &shards) const {
+    MappedFile manifest(_options.manifestPath);
+    ManifestReader reader(manifest.view(), _options.format);
+
+    struct Writer {
+        std::FILE *file = nullptr;
+        ContentHash hash;
+    };
+    std::vector<Writer> writers(shards.size());
+    auto closeAll = [&writers] {
+        bool ok = true;
+        for (auto &w : writers) {
+            if (w.file)
+                ok = std::fclose(w.file) == 0 && ok;
+            w.file = nullptr;
+        }
+        return ok;
+    };
+    for (size_t i = 0; i < shards.size(); i++) {
+        writers[i].file = std::fopen(shards[i].manifest.c_str(), "wb");
+        if (!writers[i].file) {
+            closeAll();
+            throw std::runtime_error("Cannot write " + shards[i].manifest);
+        }
+        std::setvbuf(writers[i].file, nullptr, _IOFBF, 1 << 16);
+        writers[i].hash.add("qrgen-shard-1");
+    }
+
+    uint64_t unparsable = 0;
+    bool ok = true;
+    ManifestRow row;
+    std::string line;
+    while (reader.next(row)) {
+        if (!row.error.empty()) {
+            if (unparsable++ < MAX_REPORTED_ERRORS)
+                std::cerr << "qrgen: manifest line " << row.line << ": " << row.error << std::endl;
+            continue;
+        }
+        // the final name, so entries without one keep their global index
+        std::string name = BulkRunner::outputName(row.name(), row.index, "");
+        size_t shard = nameHash(name) % shards.size();
+        line = "{\"name\":";
+        appendJsonString(line, name);
+        line += ",\"text\":";
+        appendJsonString(line, row.text());
+        line += "}\n";
+        ok = std::fwrite(line.data(), 1, line.size(), writers[shard].file) == line.size() && ok;
+        writers[shard].hash.add(line);
+        shards[shard].rows++;
+    }
+    if (!closeAll() || !ok)
+        throw std::runtime_error("Cannot write the shard manifests in " + _options.workDir);
+
+    for (size_t i = 0; i < shards.size(); i++) {
+        shards[i].command = _workerCommand(shards[i], true);
+        shards[i].hash = writers[i].hash.add(_workerCommand(shards[i], false)).hex();
+    }
+    return unparsable;
+}
+
+std::string Coordinator::_workerCommand(const Shard &shard, bool withTuning) const {
+    std::string cmd = shellQuote(_options.workerProgram);
+    auto arg = [&cmd](const std::string &a) {
+        cmd.push_back(' ');
+        cmd += shellQuote(a);
+    };
+    arg("--manifest");
+    arg(shard.manifest);
+    arg("--manifest-format");
+    arg("ndjson");
+    arg("--stats-file");
+    arg(shard.stats);
+    arg("--quiet");
+    for (const auto &a : _options.workerArgs)
+        arg(a);
+    if (withTuning) {
+        for (const auto &a : _options.tuningArgs)
+            arg(a);
+    }
+    if (_options.archive.empty()) {
+        arg("--out-dir");
+        arg(_options.outDir);
+        arg("--index-file");
+        arg(shard.index);
+    } else {
+        arg("--archive");
+        arg(shardArchive(_options.archive, shard.number));
+    }
+    return cmd;
+}
+
+bool Coordinator::_runShard(const Shard &shard, BulkStats &stats) const {
+    std::error_code ec;
+    fs::remove(shard.stats, ec); // left over from an interrupted run
+    fs::remove(shard.index, ec);
+
+    std::string command = shard.command;
+    if (!_options.launcher.empty()) {
+        // placeholders first, so none are looked for inside the worker command
+        std::string launcher = replaceAll(_options.launcher, "{shards}", std::to_string(_options.shards));
+        launcher = replaceAll(launcher, "{shard}", std::to_string(shard.number));
+        command = replaceAll(launcher, "{cmd}", command);
+    }
+    command += " > " + shellQuote(shard.log) + " 2>&1";
+
+    int rc = runCommand(command);
+    // exit code 1 with stats: the worker ran, but some entries failed
+    bool ran = (rc == 0 || rc == 1) && readStats(shard.stats, stats);
+    if (!ran) {
+        std::cerr << "qrgen: shard " << shard.number << " failed (exit code " << rc << "), see " << shard.log
+                  << std::endl;
+    }
+    return ran;
+}
+
+BulkStats Coordinator::run() {
+    auto start = std::chrono::steady_clock::now();
+
+    std::error_code ec;
+    fs::create_directories(_options.workDir, ec);
+    if (!fs::is_directory(_options.workDir))
+        throw std::runtime_error("Cannot create directory " + _options.workDir);
+
+    std::vector<Shard> shards(_options.shards);
+    for (unsigned i = 0; i < _options.shards; i++) {
+        Shard &s = shards[i];
+        s.number = i;
+        std::string base = (fs::path(_options.workDir) / ("shard-" + std::to_string(i))).string();
+        s.manifest = base + ".ndjson";
+        s.stats = base + ".stats";
+        s.log = base + ".log";
+        s.index = base + ".index";
+    }
+
+    BulkStats total;
+    total.failed = _split(shards);
+    total.rows = total.failed;
+
+    // journal: "shard hash rows written unchanged linked failed bytes", the last line of a shard counts
+    std::string journalPath = (fs::path(_options.workDir) / JOURNAL_NAME).string();
+    std::map<unsigned, std::pair<std::string, BulkStats>> journal;
+    {
+        std::ifstream in(journalPath);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream fields(line);
+            unsigned number;
+            std::string hash;
+            BulkStats s;
+            unsigned long long rows, written, unchanged, linked, failed, bytes;
+            if (fields >> number >> hash >> rows >> written >> unchanged >> linked >> failed >> bytes) {
+                s.rows = rows, s.written = written, s.unchanged = unchanged;
+                s.linked = linked, s.failed = failed, s.bytes = bytes;
+                journal[number] = {hash, s};
+            }
+        }
+    }
+
+    std::mutex mutex; // guards total, the journal file and _failed
+    auto add = [](BulkStats &to, const BulkStats &s) {
+        to.rows += s.rows;
+        to.written += s.written;
+        to.unchanged += s.unchanged;
+        to.linked += s.linked;
+        to.failed += s.failed;
+        to.bytes += s.bytes;
+    };
+
+    std::vector<Shard *> pending;
+    for (auto &s : shards) {
+        auto it = journal.find(s.number);
+        if (it != journal.end() && it->second.first == s.hash) {
+            s.done = true;
+            _resumed++;
+            add(_resumedStats, it->second.second);
+        } else if (s.rows > 0 || !_options.archive.empty()) {
+            pending.push_back(&s); // an empty shard still owes its (empty) archive
+        }
+    }
+    if (_options.progress && _resumed > 0)
+        std::cerr << "qrgen: " << _resumed << " of " << shards.size() << " shards already done" << std::endl;
+
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)> journalFile(std::fopen(journalPath.c_str(), "ab"), &std::fclose);
+    if (!journalFile)
+        throw std::runtime_error("Cannot write " + journalPath);
+    if (std::ftell(journalFile.get()) == 0)
+        std::fputs("# qrgen journal 1: shard hash rows written unchanged linked failed bytes\n", journalFile.get());
+
+    std::atomic<size_t> next{0};
+    unsigned finished = 0;
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < std::min<size_t>(_options.workers, pending.size()); w++) {
+        workers.emplace_back([&] {
+            for (size_t i; (i = next++) < pending.size();) {
+                const Shard &shard = *pending[i];
+                BulkStats s;
+                bool ran = _runShard(shard, s);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                finished++;
+                if (!ran) {
+                    _failed++;
+                    continue;
+                }
+                add(total, s);
+                if (s.failed == 0) {
+                    // flushed right away: a crash later must not lose this shard
+                    std::fprintf(journalFile.get(), "%u %s %llu %llu %llu %llu %llu %llu\n", shard.number,
+                                 shard.hash.c_str(), static_cast<unsigned long long>(s.rows),
+                                 static_cast<unsigned long long>(s.written),
+                                 static_cast<unsigned long long>(s.unchanged),
+                                 static_cast<unsigned long long>(s.linked), static_cast<unsigned long long>(s.failed),
+                                 static_cast<unsigned long long>(s.bytes));
+                    std::fflush(journalFile.get());
+                } else {
+                    _failed++;
+                }
+                if (_options.progress)
+                    std::fprintf(stderr, "shard %u done (%u/%zu): %llu rows, %llu written, %llu failed in %.2f s\n",
+                                 shard.number, finished, pending.size(), static_cast<unsigned long long>(s.rows),
+                                 static_cast<unsigned long long>(s.written), static_cast<unsigned long long>(s.failed),
+                                 s.seconds);
+            }
+        });
+    }
+    for (auto &t : workers)
+        t.join();
+    journalFile.reset();
+
+    bool merged = true;
+    if (_options.archive.empty()) {
+        // one index for the directory again, as if a single process had written it
+        DirectoryOutput output(_options.outDir, true);
+        std::vector<std::string> indexes;
+        for (const Shard &s : shards) {
+            // also indexes of shards finished by a run that died before merging them
+            if (output.mergeIndex(s.index))
+                indexes.push_back(s.index);
+        }
+        if (!indexes.empty() && !output.finish()) {
+            std::cerr << "qrgen: cannot update the index in " << _options.outDir << std::endl;
+            merged = false;
+        }
+        if (merged) {
+            for (const auto &path : indexes)
+                fs::remove(path, ec);
+        }
+    }
+    // the job is complete: the next run is a new one and checks every output again
+    if (_failed == 0 && merged)
+        fs::remove(journalPath, ec);
+
+    total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return total;
+}
@@ -0,0 +1,106 @@
+//
+// Splits a bulk run over several qrgen worker processes and merges their results.
+//
+
+#ifndef COORDINATOR_HPP
+#define COORDINATOR_HPP
+
+#include "BulkRunner.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct CoordinatorOptions {
+    std::string manifestPath;
+    ManifestReader::Format format = ManifestReader::Format::Csv;
+    std::string workerProgram;      // the qrgen executable the workers run
+    std::vector<std::string> workerArgs; // render / bulk options passed through to every worker
+    std::vector<std::string> tuningArgs; // passed through as well, but don't change the output (-j, --queue)
+    std::string outDir = ".";       // used unless @archive is set
+    std::string archive;            // one archive per shard, see shardArchive()
+    std::string workDir;            // shard manifests, logs and the journal; empty = next to the output
+    unsigned workers = 1;           // shards running at the same time
+    unsigned shards = 0;            // 0 = one per worker
+    std::string launcher;           // command template, empty = run locally, see Coordinator
+    bool progress = true;           // a line per finished shard on stderr
+};
+
+/* Runs a bulk job as a set of independent qrgen processes.
+ *
+ * The manifest is split into @shards shard manifests by a hash of each
+ * entry's output name, so a name always lands in the same shard. Each
+ * shard is one worker invocation of
+ *
+ *   qrgen --manifest SHARD.ndjson --stats-file SHARD.stats [-d DIR | -a ARCHIVE] ...
+ *
+ * and at most @workers of them run at once. The command is run through
+ * the shell; a @launcher template wraps it, e.g. "ssh node{shard} {cmd}"
+ * ({cmd} is the quoted worker command, {shard} the shard number, {shards}
+ * the shard count). Remote workers must see the same paths, which are
+ * all absolute.
+ *
+ * The work directory keeps a journal of finished shards. A shard is
+ * recorded once its worker succeeded, together with a hash of its
+ * manifest and the worker options, so running the same job again after
+ * a crash or an interruption skips finished shards and only runs the
+ * rest. The journal is crash-resume state only: it is removed once every
+ * shard succeeded and their results were merged, so a later run checks
+ * all outputs again. Workers into a directory write partial indexes,
+ * which are merged into its DirectoryOutput index at the end. */
+class Coordinator {
+public:
+    explicit Coordinator(CoordinatorOptions options);
+
+    /** Runs all unfinished shards. The stats add up the shards run now;
+     * the ones finished by an interrupted earlier run are in resumedStats().
+     * Throws std::runtime_error if the manifest or work directory cannot be used. */
+    BulkStats run();
+
+    [[nodiscard]] unsigned shardsResumed() const { return _resumed; }
+
+    /** @return the stats the journal recorded for the resumed shards */
+    [[nodiscard]] const BulkStats &resumedStats() const { return _resumedStats; }
+
+    [[nodiscard]] unsigned shardsFailed() const { return _failed; }
+
+    /** @return the archive written by shard @shard of a job into @archive: <stem>.<shard><ext> */
+    static std::string shardArchive(const std::string &archive, unsigned shard);
+
+    /** Stats file written by a worker (--stats-file) and read by the coordinator.
+     * @return false if the file could not be written / read */
+    static bool writeStats(const std::string &path, const BulkStats &stats);
+
+    static bool readStats(const std::string &path, BulkStats &stats);
+
+    static constexpr const char *JOURNAL_NAME = "journal";
+
+private:
+    struct Shard {
+        unsigned number = 0;
+        std::string manifest;   // paths in the work directory
+        std::string stats;
+        std::string log;
+        std::string index;
+        std::string hash;       // of the shard manifest and the worker options
+        std::string command;
+        uint64_t rows = 0;
+        bool done = false;      // finished in an earlier run
+    };
+
+    CoordinatorOptions _options;
+    unsigned _resumed = 0;
+    BulkStats _resumedStats;
+    unsigned _failed = 0;
+
+    /* writes the shard manifests, @return the rows that could not be parsed */
+    uint64_t _split(std::vector<Shard> &shards) const;
+
+    /* @withTuning false: the part of the command that decides the shard's output */
+    [[nodiscard]] std::string _workerCommand(const Shard &shard, bool withTuning) const;
+
+    /* runs the worker for @shard, @return true if it finished and left its stats */
+    bool _runShard(const Shard &shard, BulkStats &stats) const;
+};
+
+#endif //COORDINATOR_HPP
@@ -0,0 +1,182 @@
+//
+// Minimal io_uring instance on the raw system calls, for the asynchronous file writers.
+//
+
+#include "IoUring.hpp"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    int ioUringSetup(unsigned entries, io_uring_params *params) {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+    }
+
+    int ioUringRegister(int fd, unsigned opcode, const void *arg, unsigned count) {
+        return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+    }
+
+    // the rings are shared with the kernel: head / tail need acquire / release ordering
+    unsigned loadAcquire(const unsigned *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+
+    void storeRelease(unsigned *p, unsigned v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+    template<typename T>
+    T *at(void *base, uint32_t offset) { return reinterpret_cast<T *>(static_cast<char *>(base) + offset); }
+}
+
+IoUring::IoUring(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    _fd = ioUringSetup(entries, &params);
+    if (_fd < 0)
+        throw std::runtime_error(std::string("io_uring_setup: ") + std::strerror(errno));
+
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap)
+        _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+
+    _sqRing = ::mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_sqRing == MAP_FAILED) {
+        _sqRing = nullptr;
+        _unmap();
+        throw std::runtime_error("io_uring: cannot map the submission ring");
+    }
+    if (singleMap) {
+        _cqRing = _sqRing;
+    } else {
+        _cqRing = ::mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+        if (_cqRing == MAP_FAILED) {
+            _cqRing = nullptr;
+            _unmap();
+            throw std::runtime_error("io_uring: cannot map the completion ring");
+        }
+    }
+    _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        _unmap();
+        throw std::runtime_error("io_uring: cannot map the submission entries");
+    }
+    _sqes = static_cast<io_uring_sqe *>(sqes);
+
+    _sqHead = at<unsigned>(_sqRing, params.sq_off.head);
+    _sqTail = at<unsigned>(_sqRing, params.sq_off.tail);
+    _sqArray = at<unsigned>(_sqRing, params.sq_off.array);
+    _sqMask = *at<unsigned>(_sqRing, params.sq_off.ring_mask);
+    _sqEntries = *at<unsigned>(_sqRing, params.sq_off.ring_entries);
+    _sqLocalTail = *_sqTail;
+
+    _cqHead = at<unsigned>(_cqRing, params.cq_off.head);
+    _cqTail = at<unsigned>(_cqRing, params.cq_off.tail);
+    _cqMask = *at<unsigned>(_cqRing, params.cq_off.ring_mask);
+    _cqes = at<io_uring_cqe>(_cqRing, params.cq_off.cqes);
+
+    _probe();
+}
+
+IoUring::~IoUring() {
+    _unmap();
+}
+
+io_uring_sqe *IoUring::sqe() {
+    if (_sqLocalTail - loadAcquire(_sqHead) >= _sqEntries)
+        return nullptr;
+    unsigned index = _sqLocalTail & _sqMask;
+    _sqArray[index] = index;
+    _sqLocalTail++;
+    io_uring_sqe *entry = &_sqes[index];
+    std::memset(entry, 0, sizeof(*entry));
+    return entry;
+}
+
+int IoUring::submit(unsigned waitFor) {
+    storeRelease(_sqTail, _sqLocalTail);
+    while (true) {
+        // counted from the kernel's head, so entries a failed call did not take are retried
+        int rc = ioUringEnter(_fd, unsubmitted(), waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (rc >= 0 || errno != EINTR)
+            return rc >= 0 ? rc : -errno;
+        // interrupted: the entries taken meanwhile are no longer counted, wait again
+    }
+}
+
+unsigned IoUring::unsubmitted() const {
+    return _sqLocalTail - loadAcquire(_sqHead);
+}
+
+int IoUring::wait(unsigned count) {
+    int rc = ioUringEnter(_fd, 0, count, IORING_ENTER_GETEVENTS);
+    return rc >= 0 ? 0 : -errno;
+}
+
+bool IoUring::popCompletion(io_uring_cqe &cqe) {
+    unsigned head = *_cqHead;
+    if (head == loadAcquire(_cqTail))
+        return false;
+    cqe = _cqes[head & _cqMask];
+    storeRelease(_cqHead, head + 1);
+    return true;
+}
+
+int IoUring::registerBuffers(const iovec *buffers, unsigned count) {
+    return ioUringRegister(_fd, IORING_REGISTER_BUFFERS, buffers, count) < 0 ? -errno : 0;
+}
+
+int IoUring::registerFileSlots(unsigned count) {
+#if defined(IORING_RSRC_REGISTER_SPARSE)
+    io_uring_rsrc_register slots;
+    std::memset(&slots, 0, sizeof(slots));
+    slots.nr = count;
+    slots.flags = IORING_RSRC_REGISTER_SPARSE;
+    return ioUringRegister(_fd, IORING_REGISTER_FILES2, &slots, sizeof(slots)) < 0 ? -errno : 0;
+#else
+    (void) count; // built against kernel headers older than 5.19
+    return -EINVAL;
+#endif
+}
+
+void IoUring::_probe() {
+    // 5.6+; older kernels fail the call and get no optional operations
+    constexpr unsigned MAX_OPS = 256;
+    std::vector<char> buffer(sizeof(io_uring_probe) + MAX_OPS * sizeof(io_uring_probe_op), 0);
+    auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+    if (ioUringRegister(_fd, IORING_REGISTER_PROBE, probe, MAX_OPS) < 0)
+        return;
+    _supported.assign(probe->last_op + 1u, false);
+    for (unsigned i = 0; i < probe->ops_len && i < MAX_OPS; i++) {
+        if (probe->ops[i].op < _supported.size() && (probe->ops[i].flags & IO_URING_OP_SUPPORTED))
+            _supported[probe->ops[i].op] = true;
+    }
+}
+
+void IoUring::_unmap() {
+    if (_sqes)
+        ::munmap(_sqes, _sqesSize);
+    if (_cqRing && _cqRing != _sqRing)
+        ::munmap(_cqRing, _cqRingSize);
+    if (_sqRing)
+        ::munmap(_sqRing, _sqRingSize);
+    if (_fd >= 0)
+        ::close(_fd);
+    _sqes = nullptr;
+    _sqRing = _cqRing = nullptr;
+    _fd = -1;
+}
+
+#endif //__linux__
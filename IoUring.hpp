@@ -0,0 +1,102 @@
+//
+// Minimal io_uring instance on the raw system calls, for the asynchronous file writers.
+//
+
+#ifndef IO_URING_HPP
+#define IO_URING_HPP
+
+#if defined(__linux__)
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <cstddef>
+#include <vector>
+
+/* One submission / completion queue pair, mapped from the kernel without
+ * liburing. Entries are prepared with sqe(), handed over with submit()
+ * and their results read with popCompletion().
+ *
+ * Not thread-safe by itself: sqe() + submit() must be serialized by the
+ * caller, and completions must be popped from one thread at a time. The
+ * two sides may run on different threads. */
+class IoUring {
+public:
+    /** Sets up a ring with room for @entries submissions.
+     * Throws std::runtime_error if the kernel has no usable io_uring
+     * (too old, or disabled e.g. by a seccomp policy). */
+    explicit IoUring(unsigned entries);
+
+    ~IoUring();
+
+    IoUring(const IoUring &) = delete;
+
+    IoUring &operator=(const IoUring &) = delete;
+
+    /** @return a zeroed submission entry, nullptr if the queue is full */
+    io_uring_sqe *sqe();
+
+    /** Hands the entries from sqe() to the kernel and waits until at least
+     * @waitFor completions are ready. Entries an earlier call left behind
+     * (-EAGAIN, -EBUSY, or a partial submission) are handed over again.
+     * @return the number of entries submitted, or -errno */
+    int submit(unsigned waitFor = 0);
+
+    /** @return the entries from sqe() the kernel has not taken yet */
+    [[nodiscard]] unsigned unsubmitted() const;
+
+    /** Waits until at least @count completions are ready, without submitting
+     * anything, so it can run on the completion thread while another thread
+     * submits. @return 0, or -errno (-EINTR if interrupted by a signal) */
+    int wait(unsigned count = 1);
+
+    /** @return false if no completion is ready, otherwise copies the oldest into @cqe and frees its slot */
+    bool popCompletion(io_uring_cqe &cqe);
+
+    /** Registers @count buffers for IORING_OP_WRITE_FIXED / READ_FIXED, which
+     * then name one by its position (sqe->buf_index) and skip mapping it on
+     * every request. @return 0, or -errno (-ENOMEM beyond RLIMIT_MEMLOCK) */
+    int registerBuffers(const iovec *buffers, unsigned count);
+
+    /** Registers @count empty file slots: IORING_OP_OPENAT opens into one with
+     * sqe->file_index = slot + 1, and the requests linked after it use the file
+     * with IOSQE_FIXED_FILE and sqe->fd = slot, so a whole open / write / close
+     * chain can be submitted at once. @return 0, or -errno (kernels before 5.19) */
+    int registerFileSlots(unsigned count);
+
+    /** @return true if the kernel implements @op (an IORING_OP_* value) */
+    [[nodiscard]] bool supports(unsigned op) const { return op < _supported.size() && _supported[op]; }
+
+    [[nodiscard]] unsigned entries() const { return _sqEntries; }
+
+private:
+    int _fd = -1;
+
+    void *_sqRing = nullptr;
+    void *_cqRing = nullptr;
+    size_t _sqRingSize = 0;
+    size_t _cqRingSize = 0;
+    io_uring_sqe *_sqes = nullptr;
+    size_t _sqesSize = 0;
+
+    unsigned *_sqHead = nullptr;
+    unsigned *_sqTail = nullptr;
+    unsigned *_sqArray = nullptr;
+    unsigned _sqMask = 0;
+    unsigned _sqEntries = 0;
+    unsigned _sqLocalTail = 0;      // entries handed out by sqe(), published by submit()
+
+    unsigned *_cqHead = nullptr;
+    unsigned *_cqTail = nullptr;
+    unsigned _cqMask = 0;
+    io_uring_cqe *_cqes = nullptr;
+
+    std::vector<bool> _supported;   // by opcode
+
+    void _probe();
+
+    void _unmap();
+};
+
+#endif //__linux__
+
+#endif //IO_URING_HPP
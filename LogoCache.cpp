@@ -0,0 +1,188 @@
+//
+// A decoded logo, kept premultiplied and downscaled, with its scaled copies cached.
+//
+
+#include "LogoCache.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+    struct Tap {
+        int index;
+        float weight;
+    };
+
+    // for every destination pixel along one axis, the source pixels it is made of
+    std::vector<std::vector<Tap>> contributions(int src, int dst, LogoCache::Filter filter) {
+        std::vector<std::vector<Tap>> taps(dst);
+        double scale = static_cast<double>(src) / dst;
+        for (int i = 0; i < dst; i++) {
+            std::vector<Tap> &t = taps[i];
+            auto add = [&t](int index, double weight) {
+                if (!t.empty() && t.back().index == index)
+                    t.back().weight += static_cast<float>(weight); // clamped at the edge
+                else
+                    t.push_back(Tap{index, static_cast<float>(weight)});
+            };
+            switch (filter) {
+                case LogoCache::Filter::Nearest:
+                    add(std::min(src - 1, static_cast<int>((i + 0.5) * scale)), 1.0);
+                    break;
+                case LogoCache::Filter::Box: {
+                    double lo = i * scale, hi = (i + 1) * scale;
+                    for (int k = static_cast<int>(lo); k < src && k < hi; k++) {
+                        double w = std::min(hi, k + 1.0) - std::max(lo, static_cast<double>(k));
+                        if (w > 0)
+                            add(k, w);
+                    }
+                    break;
+                }
+                case LogoCache::Filter::Bilinear: {
+                    double center = (i + 0.5) * scale, radius = std::max(1.0, scale);
+                    auto first = static_cast<int>(std::floor(center - radius));
+                    auto last = static_cast<int>(std::ceil(center + radius));
+                    for (int k = first; k <= last; k++) {
+                        double w = 1.0 - std::fabs(k + 0.5 - center) / radius;
+                        if (w > 0)
+                            add(std::clamp(k, 0, src - 1), w);
+                    }
+                    break;
+                }
+            }
+            float sum = 0;
+            for (const Tap &tap : t)
+                sum += tap.weight;
+            for (Tap &tap : t)
+                tap.weight /= sum;
+        }
+        return taps;
+    }
+
+    /* Separable resampling of a @srcW x @srcH image to @w x @h. @row(y, out)
+     * fills out with row y as premultiplied A, R, G, B floats (0 to 255) per
+     * pixel. Rows are scaled horizontally as they are needed and kept in a
+     * ring just deep enough for one output row, so a large source is never
+     * held in full as floats. */
+    template<class RowSource>
+    LogoCache::Image resample(int srcW, int srcH, int w, int h, LogoCache::Filter filter, RowSource row) {
+        std::vector<std::vector<Tap>> xs = contributions(srcW, w, filter);
+        std::vector<std::vector<Tap>> ys = contributions(srcH, h, filter);
+        size_t depth = 1;
+        for (const auto &taps : ys)
+            depth = std::max(depth, taps.size());
+
+        std::vector<float> source(static_cast<size_t>(srcW) * 4);
+        std::vector<float> ring(depth * w * 4);
+        std::vector<int> ringRow(depth, -1);
+        auto horizontal = [&](int y) -> const float * {
+            size_t slot = static_cast<size_t>(y) % depth;
+            float *out = &ring[slot * w * 4];
+            if (ringRow[slot] != y) {
+                row(y, source.data());
+                for (int x = 0; x < w; x++) {
+                    float a = 0, r = 0, g = 0, b = 0;
+                    for (const Tap &tap : xs[x]) {
+                        const float *p = &source[static_cast<size_t>(tap.index) * 4];
+                        a += tap.weight * p[0];
+                        r += tap.weight * p[1];
+                        g += tap.weight * p[2];
+                        b += tap.weight * p[3];
+                    }
+                    out[4 * x] = a;
+                    out[4 * x + 1] = r;
+                    out[4 * x + 2] = g;
+                    out[4 * x + 3] = b;
+                }
+                ringRow[slot] = y;
+            }
+            return out;
+        };
+
+        LogoCache::Image image;
+        image.width = w;
+        image.height = h;
+        image.pixels.resize(static_cast<size_t>(w) * h);
+        std::vector<float> sum(static_cast<size_t>(w) * 4);
+        for (int y = 0; y < h; y++) {
+            std::fill(sum.begin(), sum.end(), 0.0f);
+            for (const Tap &tap : ys[y]) {
+                const float *src = horizontal(tap.index);
+                for (size_t i = 0; i < sum.size(); i++)
+                    sum[i] += tap.weight * src[i];
+            }
+            uint32_t *dst = &image.pixels[static_cast<size_t>(y) * w];
+            for (int x = 0; x < w; x++) {
+                auto channel = [](float v, uint32_t max) {
+                    return std::min(max, static_cast<uint32_t>(std::clamp(v + 0.5f, 0.0f, 255.0f)));
+                };
+                uint32_t a = channel(sum[4 * x], 255);
+                dst[x] = a << 24 | channel(sum[4 * x + 1], a) << 16 | channel(sum[4 * x + 2], a) << 8 |
+                         channel(sum[4 * x + 3], a);
+            }
+        }
+        return image;
+    }
+}
+
+LogoCache::LogoCache(const uint8_t *pixels, int w, int h, int rowstride, int channels) : _width(w), _height(h) {
+    if (!pixels || w <= 0 || h <= 0 || (channels != 3 && channels != 4))
+        throw std::invalid_argument("logo must be a non-empty RGB or RGBA image");
+
+    int masterW = w, masterH = h;
+    if (std::max(w, h) > MAX_MASTER_SIDE) {
+        double scale = static_cast<double>(MAX_MASTER_SIDE) / std::max(w, h);
+        masterW = std::max(1, static_cast<int>(std::lround(w * scale)));
+        masterH = std::max(1, static_cast<int>(std::lround(h * scale)));
+    }
+    _master = resample(w, h, masterW, masterH, Filter::Box, [&](int y, float *out) {
+        const uint8_t *p = pixels + static_cast<ptrdiff_t>(y) * rowstride;
+        for (int x = 0; x < w; x++, p += channels, out += 4) {
+            float a = channels == 4 ? p[3] : 255.0f;
+            out[0] = a;
+            out[1] = p[0] * a / 255.0f;
+            out[2] = p[1] * a / 255.0f;
+            out[3] = p[2] * a / 255.0f;
+        }
+    });
+}
+
+std::shared_ptr<const LogoCache::Image> LogoCache::scaled(int w, int h, Filter filter) const {
+    w = std::max(1, w);
+    h = std::max(1, h);
+    auto find = [&]() -> std::shared_ptr<const Image> {
+        for (auto it = _cache.begin(); it != _cache.end(); ++it) {
+            if (it->width == w && it->height == h && it->filter == filter) {
+                _cache.splice(_cache.begin(), _cache, it);
+                return it->image;
+            }
+        }
+        return nullptr;
+    };
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (auto image = find())
+            return image;
+    }
+
+    // scaled without the lock, so other sizes are served meanwhile
+    auto image = std::make_shared<const Image>(resample(_master.width, _master.height, w, h, filter,
+            [this](int y, float *out) {
+                const uint32_t *p = &_master.pixels[static_cast<size_t>(y) * _master.width];
+                for (int x = 0; x < _master.width; x++, out += 4) {
+                    out[0] = static_cast<float>(p[x] >> 24);
+                    out[1] = static_cast<float>((p[x] >> 16) & 0xFF);
+                    out[2] = static_cast<float>((p[x] >> 8) & 0xFF);
+                    out[3] = static_cast<float>(p[x] & 0xFF);
+                }
+            }));
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (auto cached = find()) // another thread was quicker
+        return cached;
+    _cache.push_front(Entry{w, h, filter, image});
+    if (_cache.size() > MAX_CACHED)
+        _cache.pop_back();
+    return image;
+}
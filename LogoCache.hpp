@@ -0,0 +1,64 @@
+//
+// A decoded logo, kept premultiplied and downscaled, with its scaled copies cached.
+//
+
+#ifndef LOGO_CACHE_HPP
+#define LOGO_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* Photos picked as logos can be far larger than any logo is ever drawn,
+ * so only a master copy of at most MAX_MASTER_SIDE pixels per side is
+ * kept, in premultiplied ARGB32 (the QrRaster / Cairo pixel format). Every
+ * size the preview or an export asks for is scaled from that master once
+ * and then served from a small cache, so redraws never rescale.
+ *
+ * scaled() may be called from several threads. */
+class LogoCache {
+public:
+    enum class Filter {
+        Nearest,
+        Bilinear, // widened to the scale factor when shrinking, so no pixel is skipped
+        Box       // area average
+    };
+
+    struct Image {
+        int width = 0, height = 0;
+        std::vector<uint32_t> pixels; // premultiplied ARGB32, width pixels per row
+    };
+
+    static constexpr int MAX_MASTER_SIDE = 2048;
+    static constexpr size_t MAX_CACHED = 8;
+
+    /** Builds the master from straight (not premultiplied) RGB or RGBA
+     * bytes: @channels 3 or 4, @rowstride bytes per row. Throws
+     * std::invalid_argument for an empty image or other channel counts. */
+    LogoCache(const uint8_t *pixels, int w, int h, int rowstride, int channels);
+
+    /** @return the size of the original image, for its aspect ratio */
+    [[nodiscard]] int width() const { return _width; }
+    [[nodiscard]] int height() const { return _height; }
+
+    /** @return the logo scaled to @w x @h with @filter, from the cache if
+     * it was asked for before */
+    std::shared_ptr<const Image> scaled(int w, int h, Filter filter) const;
+
+private:
+    struct Entry {
+        int width, height;
+        Filter filter;
+        std::shared_ptr<const Image> image;
+    };
+
+    int _width, _height;
+    Image _master;
+    mutable std::mutex _mutex;
+    mutable std::list<Entry> _cache; // most recently used first
+};
+
+#endif //LOGO_CACHE_HPP
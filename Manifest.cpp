@@ -0,0 +1,335 @@
+//
+// Zero-copy reader for bulk generation manifests (CSV and NDJSON).
+//
+
+#include "Manifest.hpp"
+
+namespace {
+    bool ends_with(const std::string &s, const char *suffix) {
+        std::string_view sv(suffix);
+        return s.size() >= sv.size() && s.compare(s.size() - sv.size(), sv.size(), sv) == 0;
+    }
+
+    void append_utf8(std::string &out, uint32_t cp) {
+        if (cp < 0x80) {
+            out.push_back(static_cast<char>(cp));
+        } else if (cp < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    bool parse_hex4(std::string_view s, size_t pos, uint32_t &value) {
+        if (pos + 4 > s.size())
+            return false;
+        value = 0;
+        for (size_t i = pos; i < pos + 4; i++) {
+            char c = s[i];
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f') value |= static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') value |= static_cast<uint32_t>(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    /* Parses the JSON string starting at the quote at @pos in @line. The view
+     * points into @line unless there were escapes, then it is copied to @copy.
+     * @return position after the closing quote, or npos if malformed */
+    size_t json_string(std::string_view line, size_t pos, std::string_view &view, std::string &copy, bool &owned) {
+        size_t start = ++pos;
+        owned = false;
+        while (pos < line.size() && line[pos] != '"' && line[pos] != '\\')
+            pos++;
+        if (pos < line.size() && line[pos] == '"') {
+            view = line.substr(start, pos - start);
+            return pos + 1;
+        }
+        // slow path: escapes
+        owned = true;
+        copy.assign(line.data() + start, pos - start);
+        while (pos < line.size()) {
+            char c = line[pos++];
+            if (c == '"')
+                return pos;
+            if (c != '\\') {
+                copy.push_back(c);
+                continue;
+            }
+            if (pos >= line.size())
+                break;
+            char e = line[pos++];
+            switch (e) {
+                case '"': copy.push_back('"'); break;
+                case '\\': copy.push_back('\\'); break;
+                case '/': copy.push_back('/'); break;
+                case 'b': copy.push_back('\b'); break;
+                case 'f': copy.push_back('\f'); break;
+                case 'n': copy.push_back('\n'); break;
+                case 'r': copy.push_back('\r'); break;
+                case 't': copy.push_back('\t'); break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!parse_hex4(line, pos, cp))
+                        return std::string_view::npos;
+                    pos += 4;
+                    uint32_t low;
+                    if (cp >= 0xD800 && cp < 0xDC00 && pos + 1 < line.size() && line[pos] == '\\' &&
+                        line[pos + 1] == 'u' && parse_hex4(line, pos + 2, low) && low >= 0xDC00 && low < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        pos += 6;
+                    }
+                    append_utf8(copy, cp);
+                    break;
+                }
+                default:
+                    return std::string_view::npos;
+            }
+        }
+        return std::string_view::npos;
+    }
+
+    /* skips a JSON value that is not a string (number, true, false, null,
+     * or a nested array/object) @return position after it */
+    size_t json_skip_value(std::string_view line, size_t pos) {
+        int depth = 0;
+        bool inString = false;
+        for (; pos < line.size(); pos++) {
+            char c = line[pos];
+            if (inString) {
+                if (c == '\\') pos++;
+                else if (c == '"') inString = false;
+                continue;
+            }
+            if (c == '"') inString = true;
+            else if (c == '[' || c == '{') depth++;
+            else if (c == ']' || c == '}') {
+                if (depth == 0) return pos;
+                depth--;
+            } else if (c == ',' && depth == 0) return pos;
+        }
+        return pos;
+    }
+
+    size_t skip_ws(std::string_view s, size_t pos) {
+        while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\r'))
+            pos++;
+        return pos;
+    }
+}
+
+ManifestReader::ManifestReader(std::string_view data, Format format) : _data(data), _format(format) {
+    // UTF-8 byte order mark
+    if (_data.size() >= 3 && _data.compare(0, 3, "\xEF\xBB\xBF") == 0)
+        _pos = 3;
+}
+
+ManifestReader::Format ManifestReader::formatFor(const std::string &path) {
+    if (ends_with(path, ".ndjson") || ends_with(path, ".jsonl") || ends_with(path, ".json"))
+        return Format::Ndjson;
+    return Format::Csv;
+}
+
+bool ManifestReader::next(ManifestRow &row) {
+    row.error.clear();
+    row._name = row._text = std::string_view();
+    row._nameOwned = row._textOwned = false;
+    bool found = _format == Format::Csv ? _nextCsv(row) : _nextNdjson(row);
+    if (found)
+        row.index = _index++;
+    return found;
+}
+
+void ManifestReader::_skipLine() {
+    while (_pos < _data.size() && _data[_pos] != '\n')
+        _pos++;
+    if (_pos < _data.size()) {
+        _pos++;
+        _line++;
+    }
+}
+
+bool ManifestReader::_csvField(std::string_view &view, std::string &copy, bool &owned) {
+    owned = false;
+    if (_pos >= _data.size() || _data[_pos] != '"') {
+        size_t start = _pos;
+        while (_pos < _data.size() && _data[_pos] != ',' && _data[_pos] != '\n')
+            _pos++;
+        size_t end = _pos;
+        if (end > start && _data[end - 1] == '\r')
+            end--;
+        view = _data.substr(start, end - start);
+        return true;
+    }
+
+    size_t start = ++_pos;
+    while (_pos < _data.size()) {
+        char c = _data[_pos];
+        if (c == '\n')
+            _line++;
+        if (c != '"') {
+            if (owned) copy.push_back(c);
+            _pos++;
+            continue;
+        }
+        if (_pos + 1 < _data.size() && _data[_pos + 1] == '"') {
+            // "" escape: from here on the field needs its own copy
+            if (!owned) {
+                copy.assign(_data.data() + start, _pos - start);
+                owned = true;
+            }
+            copy.push_back('"');
+            _pos += 2;
+            continue;
+        }
+        if (!owned)
+            view = _data.substr(start, _pos - start);
+        _pos++;
+        // anything between the closing quote and the separator is ignored
+        while (_pos < _data.size() && _data[_pos] != ',' && _data[_pos] != '\n')
+            _pos++;
+        return true;
+    }
+    return false;
+}
+
+bool ManifestReader::_nextCsv(ManifestRow &row) {
+    while (_pos < _data.size()) {
+        row.line = _line;
+        // blank lines are not entries
+        if (_data[_pos] == '\n' || (_data[_pos] == '\r' && _pos + 1 < _data.size() && _data[_pos + 1] == '\n')) {
+            _skipLine();
+            continue;
+        }
+
+        std::string_view first, second;
+        bool firstOwned, secondOwned;
+        if (!_csvField(first, row._nameCopy, firstOwned)) {
+            row.error = "unterminated quoted field";
+            return true;
+        }
+        bool twoFields = _pos < _data.size() && _data[_pos] == ',';
+        if (twoFields) {
+            _pos++;
+            if (!_csvField(second, row._textCopy, secondOwned)) {
+                row.error = "unterminated quoted field";
+                return true;
+            }
+        }
+        bool extraFields = _pos < _data.size() && _data[_pos] == ',';
+        _skipLine();
+
+        bool header = !_started && twoFields && !firstOwned && !secondOwned && first == "name" &&
+                      (second == "text" || second == "data" || second == "payload");
+        _started = true;
+        if (header)
+            continue;
+
+        if (twoFields) {
+            row._name = first;
+            row._nameOwned = firstOwned;
+            row._text = second;
+            row._textOwned = secondOwned;
+        } else {
+            // single column: it is the text; its copy (if any) went to _nameCopy
+            row._text = first;
+            if (firstOwned) {
+                row._textCopy.swap(row._nameCopy);
+                row._textOwned = true;
+            }
+        }
+        if (extraFields)
+            row.error = "too many fields";
+        return true;
+    }
+    return false;
+}
+
+bool ManifestReader::_nextNdjson(ManifestRow &row) {
+    while (_pos < _data.size()) {
+        row.line = _line;
+        size_t end = _data.find('\n', _pos);
+        if (end == std::string_view::npos)
+            end = _data.size();
+        std::string_view line = _data.substr(_pos, end - _pos);
+        _pos = end;
+        _skipLine();
+
+        size_t pos = skip_ws(line, 0);
+        if (pos == line.size())
+            continue; // blank line
+        if (line[pos] != '{') {
+            row.error = "expected a JSON object";
+            return true;
+        }
+        pos = skip_ws(line, pos + 1);
+
+        std::string_view key, value;
+        std::string keyCopy, valueCopy;
+        while (pos < line.size() && line[pos] != '}') {
+            bool keyOwned, valueOwned;
+            if (line[pos] != '"' || (pos = json_string(line, pos, key, keyCopy, keyOwned)) == std::string_view::npos) {
+                row.error = "malformed JSON key";
+                return true;
+            }
+            if (keyOwned)
+                key = keyCopy;
+            pos = skip_ws(line, pos);
+            if (pos >= line.size() || line[pos] != ':') {
+                row.error = "expected ':'";
+                return true;
+            }
+            pos = skip_ws(line, pos + 1);
+
+            bool isName = key == "name" || key == "id" || key == "file";
+            bool isText = key == "text" || key == "data" || key == "payload";
+            if (pos < line.size() && line[pos] == '"') {
+                std::string &copy = isName ? row._nameCopy : isText ? row._textCopy : valueCopy;
+                pos = json_string(line, pos, value, copy, valueOwned);
+                if (pos == std::string_view::npos) {
+                    row.error = "malformed JSON string";
+                    return true;
+                }
+                if (isName) {
+                    row._name = value;
+                    row._nameOwned = valueOwned;
+                } else if (isText) {
+                    row._text = value;
+                    row._textOwned = valueOwned;
+                }
+            } else {
+                if (isText) {
+                    row.error = "\"" + std::string(key) + "\" must be a string";
+                    return true;
+                }
+                size_t valueStart = pos;
+                pos = json_skip_value(line, pos);
+                if (isName) {
+                    // numeric ids are used as they are written
+                    size_t valueEnd = pos;
+                    while (valueEnd > valueStart && (line[valueEnd - 1] == ' ' || line[valueEnd - 1] == '\t'))
+                        valueEnd--;
+                    row._name = line.substr(valueStart, valueEnd - valueStart);
+                    row._nameOwned = false;
+                }
+            }
+            pos = skip_ws(line, pos);
+            if (pos < line.size() && line[pos] == ',')
+                pos = skip_ws(line, pos + 1);
+        }
+        if (pos >= line.size())
+            row.error = "unterminated JSON object";
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,74 @@
+//
+// Zero-copy reader for bulk generation manifests (CSV and NDJSON).
+//
+
+#ifndef MANIFEST_HPP
+#define MANIFEST_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/* One manifest entry. @name and @text point into the manifest buffer
+ * unless the field contained escapes, in which case the unescaped copy
+ * lives in the row itself. Use name() / text(), which pick the right one. */
+struct ManifestRow {
+    uint64_t index = 0;   // 0-based entry number, header rows not counted
+    uint64_t line = 0;    // 1-based line the entry starts on, for messages
+    std::string error;    // non-empty if the entry could not be parsed
+
+    [[nodiscard]] std::string_view name() const { return _nameOwned ? std::string_view(_nameCopy) : _name; }
+
+    [[nodiscard]] std::string_view text() const { return _textOwned ? std::string_view(_textCopy) : _text; }
+
+private:
+    friend class ManifestReader;
+    std::string_view _name, _text;
+    std::string _nameCopy, _textCopy;
+    bool _nameOwned = false, _textOwned = false;
+};
+
+/* Splits a manifest into rows without copying it.
+ *
+ * CSV: one entry per record, "name,text" or just "text" (the name is then
+ * empty). Quoted fields with "" escapes and embedded newlines are
+ * supported. A first record of "name,text" / "name,data" is a header and
+ * skipped.
+ *
+ * NDJSON: one JSON object per line. "name" (or "id", "file") and "text"
+ * (or "data", "payload") string members are used, others ignored. */
+class ManifestReader {
+public:
+    enum class Format { Csv, Ndjson };
+
+    ManifestReader(std::string_view data, Format format);
+
+    /** .ndjson / .jsonl / .json are NDJSON, anything else is CSV. */
+    static Format formatFor(const std::string &path);
+
+    /** Reads the next entry into @row, reusing its buffers.
+     * Malformed entries are returned with @row.error set; reading can go on.
+     * @return false at the end of the manifest */
+    bool next(ManifestRow &row);
+
+private:
+    std::string_view _data;
+    Format _format;
+    size_t _pos = 0;
+    uint64_t _line = 1;
+    uint64_t _index = 0;
+    bool _started = false;
+
+    bool _nextCsv(ManifestRow &row);
+
+    bool _nextNdjson(ManifestRow &row);
+
+    /* parses one CSV field at _pos into @view, unescaping into @copy if quoted with ""
+     * @return false if a quoted field is not terminated */
+    bool _csvField(std::string_view &view, std::string &copy, bool &owned);
+
+    /* skips to the start of the next line */
+    void _skipLine();
+};
+
+#endif //MANIFEST_HPP
@@ -0,0 +1,87 @@
+//
+// Read-only memory mapping of a whole file.
+//
+
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const std::string &path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Cannot open " + path);
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    _file = file;
+    _size = static_cast<size_t>(size.QuadPart);
+    if (_size == 0)
+        return; // empty files cannot be mapped, and need not be
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        throw std::runtime_error("Cannot map " + path);
+    }
+    _mapping = mapping;
+    _data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!_data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Cannot map " + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (_data)
+        UnmapViewOfFile(_data);
+    if (_mapping)
+        CloseHandle(static_cast<HANDLE>(_mapping));
+    if (_file)
+        CloseHandle(static_cast<HANDLE>(_file));
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    _size = static_cast<size_t>(st.st_size);
+    if (_size > 0) {
+        void *p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Cannot map " + path);
+        }
+        ::madvise(p, _size, MADV_SEQUENTIAL);
+        _data = static_cast<const char *>(p);
+    }
+    ::close(fd); // the mapping stays valid
+}
+
+MappedFile::~MappedFile() {
+    if (_data)
+        ::munmap(const_cast<char *>(_data), _size);
+}
+
+#endif
@@ -0,0 +1,40 @@
+//
+// Read-only memory mapping of a whole file.
+//
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/* Maps a file read-only for sequential parsing without copying it into
+ * the heap. Pages are backed by the file, so even a multi-gigabyte
+ * manifest does not grow the process's private memory. */
+class MappedFile {
+public:
+    /** Maps @path. Throws std::runtime_error if it cannot be opened or mapped. */
+    explicit MappedFile(const std::string &path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    [[nodiscard]] const char *data() const { return _data; }
+
+    [[nodiscard]] size_t size() const { return _size; }
+
+    [[nodiscard]] std::string_view view() const { return {_data, _size}; }
+
+private:
+    const char *_data = nullptr;
+    size_t _size = 0;
+#if defined(_WIN32)
+    void *_file = nullptr;
+    void *_mapping = nullptr;
+#endif
+};
+
+#endif //MAPPED_FILE_HPP
@@ -0,0 +1,78 @@
+//
+// Antialiased coverage mask of one module shape, stamped into 32-bit pixel buffers.
+//
+
+#include "ModuleSprite.hpp"
+
+#include <algorithm>
+
+namespace {
+    constexpr int SAMPLES = 8; // per pixel and axis, so 64 coverage samples
+
+    // (@argb * @a + @dst * (255 - @a)) / 255 for all four channels at once, two channels per 32-bit word
+    inline uint32_t blend(uint32_t dst, uint32_t argb, uint32_t a) {
+        uint32_t na = 255 - a;
+        uint32_t rb = (argb & 0xFF00FFu) * a + (dst & 0xFF00FFu) * na + 0x800080u;
+        rb = ((rb + ((rb >> 8) & 0xFF00FFu)) >> 8) & 0xFF00FFu;
+        uint32_t ag = ((argb >> 8) & 0xFF00FFu) * a + ((dst >> 8) & 0xFF00FFu) * na + 0x800080u;
+        ag = (ag + ((ag >> 8) & 0xFF00FFu)) & 0xFF00FF00u;
+        return rb | ag;
+    }
+}
+
+ModuleSprite::ModuleSprite(int size, double cornerRadius) :
+        _size(std::max(1, size)),
+        _alpha(static_cast<size_t>(_size) * _size),
+        _rows(_size) {
+    double r = std::clamp(cornerRadius, 0.0, _size / 2.0);
+    double lo = r, hi = _size - r; // centres of the corner arcs
+
+    for (int y = 0; y < _size; y++) {
+        for (int x = 0; x < _size; x++) {
+            int covered = 0;
+            for (int sy = 0; sy < SAMPLES; sy++) {
+                double py = y + (sy + 0.5) / SAMPLES;
+                double dy = py - std::clamp(py, lo, hi);
+                for (int sx = 0; sx < SAMPLES; sx++) {
+                    double px = x + (sx + 0.5) / SAMPLES;
+                    double dx = px - std::clamp(px, lo, hi);
+                    if (dx * dx + dy * dy <= r * r)
+                        covered++;
+                }
+            }
+            _alpha[static_cast<size_t>(y) * _size + x] =
+                    static_cast<uint8_t>((covered * 255 + SAMPLES * SAMPLES / 2) / (SAMPLES * SAMPLES));
+        }
+
+        Row &row = _rows[y];
+        const uint8_t *a = &_alpha[static_cast<size_t>(y) * _size];
+        row.begin = 0;
+        while (row.begin < _size && a[row.begin] == 0) row.begin++;
+        row.end = _size;
+        while (row.end > row.begin && a[row.end - 1] == 0) row.end--;
+        row.solidBegin = row.begin;
+        while (row.solidBegin < row.end && a[row.solidBegin] != 255) row.solidBegin++;
+        row.solidEnd = row.end;
+        while (row.solidEnd > row.solidBegin && a[row.solidEnd - 1] != 255) row.solidEnd--;
+    }
+}
+
+void ModuleSprite::stamp(uint32_t *pixels, int stride, int width, int height, int x, int y, uint32_t argb) const {
+    int y0 = std::max(0, -y), y1 = std::min(_size, height - y);
+    for (int sy = y0; sy < y1; sy++)
+        stampRow(pixels + static_cast<ptrdiff_t>(y + sy) * stride, width, x, sy, argb);
+}
+
+void ModuleSprite::stampRow(uint32_t *row, int width, int x, int spriteRow, uint32_t argb) const {
+    const Row &span = _rows[spriteRow];
+    const uint8_t *a = &_alpha[static_cast<size_t>(spriteRow) * _size];
+    int begin = std::max(span.begin, -x), end = std::min(span.end, width - x);
+    int solidBegin = std::clamp(span.solidBegin, begin, std::max(begin, end));
+    int solidEnd = std::clamp(span.solidEnd, solidBegin, std::max(solidBegin, end));
+
+    for (int sx = begin; sx < solidBegin; sx++)
+        row[x + sx] = blend(row[x + sx], argb, a[sx]);
+    std::fill(row + (x + solidBegin), row + (x + solidEnd), argb);
+    for (int sx = solidEnd; sx < end; sx++)
+        row[x + sx] = blend(row[x + sx], argb, a[sx]);
+}
@@ -0,0 +1,50 @@
+//
+// Antialiased coverage mask of one module shape, stamped into 32-bit pixel buffers.
+//
+
+#ifndef MODULE_SPRITE_HPP
+#define MODULE_SPRITE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Rounded and circular modules all look the same at a given module size,
+ * so the shape is rasterized once and every dark module is a copy of it:
+ * a span fill where the sprite is opaque and a blend only along its
+ * antialiased rim, instead of building and filling arcs per module.
+ *
+ * Pixels are premultiplied ARGB32 in native byte order, as in a Cairo
+ * image surface. */
+class ModuleSprite {
+public:
+    /** A @size x @size pixel square with corners rounded to @cornerRadius
+     * pixels; a radius of @size / 2 makes it a circle. */
+    ModuleSprite(int size, double cornerRadius);
+
+    [[nodiscard]] int size() const { return _size; }
+
+    /** @return the coverage of pixel (@x, @y), 0 to 255 */
+    [[nodiscard]] uint8_t alpha(int x, int y) const { return _alpha[static_cast<size_t>(y) * _size + x]; }
+
+    /** Composites the sprite in the opaque colour @argb over the @width x
+     * @height image @pixels (@stride pixels per row), with its top left
+     * corner at (@x, @y). Parts outside the image are skipped. */
+    void stamp(uint32_t *pixels, int stride, int width, int height, int x, int y, uint32_t argb) const;
+
+    /** Composites row @spriteRow of the sprite into the image row @row of
+     * @width pixels, starting at pixel @x; for renderers working row by row. */
+    void stampRow(uint32_t *row, int width, int x, int spriteRow, uint32_t argb) const;
+
+private:
+    struct Row {
+        int begin = 0, end = 0;           // pixels with any coverage
+        int solidBegin = 0, solidEnd = 0; // fully covered pixels, within [begin, end)
+    };
+
+    int _size;
+    std::vector<uint8_t> _alpha;
+    std::vector<Row> _rows;
+};
+
+#endif //MODULE_SPRITE_HPP
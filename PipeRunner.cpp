@@ -0,0 +1,327 @@
+//
+// Streaming pipe mode: payloads in on one stream, encoded images out on another.
+//
+
+#include "PipeRunner.hpp"
+#include "BoundedQueue.hpp"
+#include "QrContent.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace {
+    // stdio buffers for both streams, and the read size
+    constexpr size_t STREAM_BUFFER_SIZE = 1 << 20;
+
+    // only the first few failures are printed, the rest are counted
+    constexpr uint64_t MAX_REPORTED_ERRORS = 100;
+
+    void appendBase64(std::string &out, const uint8_t *data, size_t len) {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        out.reserve(out.size() + (len + 2) / 3 * 4);
+        size_t i = 0;
+        for (; i + 3 <= len; i += 3) {
+            uint32_t v = static_cast<uint32_t>(data[i]) << 16 | static_cast<uint32_t>(data[i + 1]) << 8 | data[i + 2];
+            out.push_back(alphabet[v >> 18]);
+            out.push_back(alphabet[(v >> 12) & 63]);
+            out.push_back(alphabet[(v >> 6) & 63]);
+            out.push_back(alphabet[v & 63]);
+        }
+        if (i < len) {
+            uint32_t v = static_cast<uint32_t>(data[i]) << 16;
+            if (i + 1 < len)
+                v |= static_cast<uint32_t>(data[i + 1]) << 8;
+            out.push_back(alphabet[v >> 18]);
+            out.push_back(alphabet[(v >> 12) & 63]);
+            out.push_back(i + 1 < len ? alphabet[(v >> 6) & 63] : '=');
+            out.push_back('=');
+        }
+    }
+
+    void appendJsonString(std::string &out, const char *data, size_t len) {
+        out.push_back('"');
+        for (size_t i = 0; i < len; i++) {
+            char c = data[i];
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20) {
+                        char escaped[8];
+                        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        out += escaped;
+                    } else {
+                        out.push_back(c);
+                    }
+            }
+        }
+        out.push_back('"');
+    }
+
+    // Returns what is available rather than waiting for a full buffer, so an
+    // interactive producer gets each result as soon as its record is complete.
+    size_t readSome(std::FILE *in, char *buffer, size_t len) {
+#if defined(_WIN32)
+        return std::fread(buffer, 1, len, in);
+#else
+        while (true) {
+            ssize_t n = ::read(fileno(in), buffer, len);
+            if (n >= 0)
+                return static_cast<size_t>(n);
+            if (errno != EINTR)
+                return 0;
+        }
+#endif
+    }
+
+    const char *formatName(PipeOptions::Emit emit) {
+        switch (emit) {
+            case PipeOptions::Emit::Svg: return "svg";
+            case PipeOptions::Emit::Bitmap: return "bitmap";
+            default: return "png";
+        }
+    }
+}
+
+PipeRunner::PipeRunner(PipeOptions options, std::FILE *in, std::FILE *out) :
+        _options(std::move(options)), _in(in), _out(out) {
+    if (_options.jobs == 0)
+        _options.jobs = std::max(1u, std::thread::hardware_concurrency());
+    if (_options.window == 0)
+        _options.window = 1;
+    _options.render.format = _options.emit == PipeOptions::Emit::Svg ? "svg" : "png";
+}
+
+std::string PipeRunner::payloadFor(const std::string &record, PipeOptions::Content content) {
+    if (content == PipeOptions::Content::Text)
+        return record;
+
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t tab = record.find('\t', start);
+        fields.push_back(record.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+        if (tab == std::string::npos)
+            break;
+        start = tab + 1;
+    }
+    auto field = [&fields](size_t i) { return i < fields.size() ? fields[i] : std::string(); };
+
+    switch (content) {
+        case PipeOptions::Content::Wifi:
+            return QrContent::wifi(field(0), field(1), fields.size() > 2 ? fields[2] : "WPA/WPA2");
+        case PipeOptions::Content::Vcard:
+            return QrContent::vcard(field(0), field(1), field(2));
+        case PipeOptions::Content::Location:
+            return QrContent::location(field(0), field(1));
+        default:
+            return record;
+    }
+}
+
+PipeRunner::Result PipeRunner::_encode(const std::string &record) const {
+    Result result;
+    std::string payload = payloadFor(record, _options.content);
+    if (payload.empty()) {
+        result.error = _options.content == PipeOptions::Content::Text ? "empty text" : "missing fields";
+        return result;
+    }
+
+    if (_options.emit == PipeOptions::Emit::Bitmap) {
+        try {
+            auto qr = qrcodegen::QrCode::encodeText(payload.c_str(), _options.render.ecc);
+            result.size = qr.getSize();
+            result.data.resize(static_cast<size_t>(result.size) * result.size);
+            uint8_t *p = result.data.data();
+            for (int y = 0; y < result.size; y++) {
+                for (int x = 0; x < result.size; x++)
+                    *p++ = qr.getModule(x, y) ? 1 : 0;
+            }
+        } catch (const std::exception &e) {
+            result.error = e.what();
+            return result;
+        }
+        result.ok = true;
+        return result;
+    }
+
+    if (!renderQr(payload, _options.render, result.data, &result.error)) {
+        if (result.error.empty())
+            result.error = "encoding failed";
+        return result;
+    }
+    if (_options.emit == PipeOptions::Emit::PngBase64) {
+        std::string text;
+        appendBase64(text, result.data.data(), result.data.size());
+        result.data.assign(text.begin(), text.end());
+    }
+    result.ok = true;
+    return result;
+}
+
+bool PipeRunner::_write(uint64_t index, const Result &result) {
+    if (_options.framing == PipeOptions::Framing::Length) {
+        uint32_t len = result.ok ? static_cast<uint32_t>(result.data.size()) : 0;
+        uint8_t prefix[4] = {static_cast<uint8_t>(len >> 24), static_cast<uint8_t>(len >> 16),
+                             static_cast<uint8_t>(len >> 8), static_cast<uint8_t>(len)};
+        return std::fwrite(prefix, 1, 4, _out) == 4 &&
+               (len == 0 || std::fwrite(result.data.data(), 1, len, _out) == len);
+    }
+
+    std::string line = "{\"index\":" + std::to_string(index);
+    if (result.ok) {
+        line += ",\"ok\":true,\"format\":\"";
+        line += formatName(_options.emit);
+        line += "\"";
+        if (_options.emit == PipeOptions::Emit::Bitmap)
+            line += ",\"size\":" + std::to_string(result.size);
+        line += ",\"data\":";
+        if (_options.emit == PipeOptions::Emit::Svg || _options.emit == PipeOptions::Emit::PngBase64) {
+            appendJsonString(line, reinterpret_cast<const char *>(result.data.data()), result.data.size());
+        } else {
+            line.push_back('"');
+            appendBase64(line, result.data.data(), result.data.size());
+            line.push_back('"');
+        }
+    } else {
+        line += ",\"ok\":false,\"error\":";
+        appendJsonString(line, result.error.data(), result.error.size());
+    }
+    line += "}\n";
+    return std::fwrite(line.data(), 1, line.size(), _out) == line.size();
+}
+
+PipeStats PipeRunner::run() {
+    std::setvbuf(_out, nullptr, _IOFBF, STREAM_BUFFER_SIZE);
+
+    BoundedQueue<std::pair<uint64_t, std::string>> records(_options.window);
+    uint64_t total = 0;
+    bool readDone = false;
+
+    // stage 1: split the input into records, staying within the window
+    std::thread reader([&] {
+        std::vector<char> buffer(STREAM_BUFFER_SIZE);
+        std::string partial;
+        uint64_t index = 0;
+        auto emit = [&](std::string record) {
+            if (_options.delimiter == '\n' && !record.empty() && record.back() == '\r')
+                record.pop_back();
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _changed.wait(lock, [&] { return _writeFailed || index < _nextToWrite + _options.window; });
+                if (_writeFailed)
+                    return false;
+            }
+            return records.push({index++, std::move(record)});
+        };
+
+        bool running = true;
+        while (running) {
+            size_t n = readSome(_in, buffer.data(), buffer.size());
+            if (n == 0)
+                break;
+            const char *p = buffer.data(), *end = p + n;
+            while (running) {
+                auto *delim = static_cast<const char *>(std::memchr(p, _options.delimiter, end - p));
+                if (!delim) {
+                    partial.append(p, end);
+                    break;
+                }
+                partial.append(p, delim);
+                running = emit(std::move(partial));
+                partial.clear();
+                p = delim + 1;
+            }
+        }
+        if (running && !partial.empty())
+            emit(std::move(partial)); // last record without a trailing delimiter
+
+        records.close();
+        std::lock_guard<std::mutex> lock(_mutex);
+        total = index;
+        readDone = true;
+        _changed.notify_all();
+    });
+
+    // stage 2: encode
+    std::vector<std::thread> encoders;
+    for (unsigned i = 0; i < _options.jobs; i++) {
+        encoders.emplace_back([&] {
+            std::pair<uint64_t, std::string> record;
+            while (records.pop(record)) {
+                Result result = _encode(record.second);
+                std::lock_guard<std::mutex> lock(_mutex);
+                _finished.emplace(record.first, std::move(result));
+                if (record.first == _nextToWrite)
+                    _changed.notify_all();
+            }
+        });
+    }
+
+    // stage 3: write in input order, on this thread
+    PipeStats stats;
+    bool flushed = true;
+    while (true) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto ready = [&] { return _finished.count(_nextToWrite) > 0 || (readDone && _nextToWrite == total); };
+        if (!ready() && !flushed) {
+            // about to wait: hand what is written so far to the consumer
+            lock.unlock();
+            std::fflush(_out);
+            flushed = true;
+            lock.lock();
+        }
+        _changed.wait(lock, ready);
+        if (readDone && _nextToWrite == total)
+            break;
+
+        auto it = _finished.find(_nextToWrite);
+        Result result = std::move(it->second);
+        _finished.erase(it);
+        uint64_t index = _nextToWrite;
+        lock.unlock();
+
+        if (!result.ok) {
+            if (stats.failed++ < MAX_REPORTED_ERRORS)
+                std::cerr << "qrgen: record " << index << ": " << result.error << std::endl;
+        }
+        bool ok = _write(index, result);
+        flushed = false;
+        stats.records++;
+
+        lock.lock();
+        _nextToWrite++;
+        if (!ok)
+            _writeFailed = true; // e.g. the consumer went away: stop reading
+        _changed.notify_all();
+        if (_writeFailed)
+            break;
+    }
+
+    bool writeFailed;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        writeFailed = _writeFailed;
+    }
+    if (writeFailed)
+        records.close();
+    reader.join();
+    for (auto &t : encoders)
+        t.join();
+    if (writeFailed || std::fflush(_out) != 0)
+        throw std::runtime_error("Cannot write the output stream");
+    if (stats.failed > MAX_REPORTED_ERRORS)
+        std::cerr << "qrgen: " << (stats.failed - MAX_REPORTED_ERRORS) << " more errors not shown" << std::endl;
+    return stats;
+}
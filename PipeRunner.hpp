@@ -0,0 +1,86 @@
+//
+// Streaming pipe mode: payloads in on one stream, encoded images out on another.
+//
+
+#ifndef PIPE_RUNNER_HPP
+#define PIPE_RUNNER_HPP
+
+#include "QrRender.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct PipeOptions {
+    /* what each input record is: the text itself, or tab-separated form
+     * fields turned into a payload by QrContent */
+    enum class Content { Text, Wifi, Vcard, Location };
+
+    /* Length: a 4-byte big-endian length, then the bytes (length 0 for a failed record).
+     * Ndjson: one {"index":..,"ok":..,"data":..} object per line. */
+    enum class Framing { Length, Ndjson };
+
+    /* Bitmap is one byte per module (1 dark, 0 light), row by row, without quiet zone. */
+    enum class Emit { Png, PngBase64, Svg, Bitmap };
+
+    char delimiter = '\n';      // '\n' (a trailing '\r' is dropped too) or '\0'
+    Content content = Content::Text;
+    Framing framing = Framing::Ndjson;
+    Emit emit = Emit::Png;
+    QrRenderSettings render;
+    unsigned jobs = 0;          // encoder threads, 0 = one per core
+    size_t window = 256;        // max records between reading and writing
+};
+
+struct PipeStats {
+    uint64_t records = 0;
+    uint64_t failed = 0;
+};
+
+/* Reads records from @in, encodes them on @jobs threads and writes one
+ * result per record to @out, in input order.
+ *
+ * Results that finish early wait in a reorder buffer until all records
+ * before them are written. Reading stays at most @window records ahead of
+ * writing, which bounds memory however slow a single record is. Output
+ * is flushed whenever the writer would otherwise wait, so results of
+ * an interactive producer come out without delay. */
+class PipeRunner {
+public:
+    PipeRunner(PipeOptions options, std::FILE *in, std::FILE *out);
+
+    /** Runs until the end of @in. Throws std::runtime_error if writing to @out fails. */
+    PipeStats run();
+
+    /** @return the payload for @record as described by @content, empty if fields are missing */
+    static std::string payloadFor(const std::string &record, PipeOptions::Content content);
+
+private:
+    struct Result {
+        bool ok = false;
+        std::vector<uint8_t> data;
+        int size = 0;           // modules per side, for bitmaps
+        std::string error;
+    };
+
+    PipeOptions _options;
+    std::FILE *_in;
+    std::FILE *_out;
+
+    // reorder buffer: finished results by record number
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::map<uint64_t, Result> _finished;
+    uint64_t _nextToWrite = 0;
+    bool _writeFailed = false;
+
+    Result _encode(const std::string &record) const;
+
+    bool _write(uint64_t index, const Result &result);
+};
+
+#endif //PIPE_RUNNER_HPP
@@ -0,0 +1,76 @@
+/*
+ * Checksums for PNG writers
+ */
+
+#include <array>
+#include "PngChecksum.hpp"
+
+using std::uint32_t;
+using std::uint64_t;
+using std::uint8_t;
+using std::size_t;
+
+
+namespace {
+
+	constexpr uint32_t ADLER_MOD = 65521;
+
+	// Largest n such that 255n(n+1)/2 + (n+1)(ADLER_MOD-1) fits in 32 bits
+	constexpr size_t ADLER_NMAX = 5552;
+
+
+	constexpr std::array<uint32_t, 256> makeCrcTable() {
+		std::array<uint32_t, 256> table{};
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int j = 0; j < 8; j++)
+				c = (c >> 1) ^ ((-(c & 1)) & UINT32_C(0xEDB88320));
+			table[i] = c;
+		}
+		return table;
+	}
+
+	constexpr std::array<uint32_t, 256> CRC_TABLE = makeCrcTable();
+
+}
+
+
+uint32_t PngChecksum::crc32(uint32_t crc, const uint8_t data[], size_t len) {
+	crc = ~crc;
+	for (size_t i = 0; i < len; i++)
+		crc = (crc >> 8) ^ CRC_TABLE[(crc ^ data[i]) & 0xFF];
+	return ~crc;
+}
+
+
+uint32_t PngChecksum::adler32(uint32_t adler, const uint8_t data[], size_t len) {
+	uint32_t s1 = adler & 0xFFFF;
+	uint32_t s2 = adler >> 16;
+	while (len > 0) {
+		// Defer the modulo until just before the sums could overflow
+		size_t n = len < ADLER_NMAX ? len : ADLER_NMAX;
+		len -= n;
+		for (; n > 0; n--, data++) {
+			s1 += *data;
+			s2 += s1;
+		}
+		s1 %= ADLER_MOD;
+		s2 %= ADLER_MOD;
+	}
+	return s2 << 16 | s1;
+}
+
+
+uint32_t PngChecksum::adler32Combine(uint32_t adler1, uint32_t adler2, uint64_t len2) {
+	// Same derivation as zlib's adler32_combine()
+	uint32_t rem = static_cast<uint32_t>(len2 % ADLER_MOD);
+	uint32_t sum1 = adler1 & 0xFFFF;
+	uint32_t sum2 = static_cast<uint32_t>((static_cast<uint64_t>(rem) * sum1) % ADLER_MOD);
+	sum1 += (adler2 & 0xFFFF) + ADLER_MOD - 1;
+	sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_MOD - rem;
+	if (sum1 >= ADLER_MOD) sum1 -= ADLER_MOD;
+	if (sum1 >= ADLER_MOD) sum1 -= ADLER_MOD;
+	if (sum2 >= (ADLER_MOD << 1)) sum2 -= (ADLER_MOD << 1);
+	if (sum2 >= ADLER_MOD) sum2 -= ADLER_MOD;
+	return sum2 << 16 | sum1;
+}
@@ -0,0 +1,34 @@
+/*
+ * Checksums for PNG writers
+ *
+ * Table-driven CRC-32 and blocked Adler-32, plus Adler-32 combination so that
+ * separately checksummed pieces of a zlib stream can be joined in order.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace PngChecksum {
+
+	/*
+	 * Returns the CRC-32 of the data so far ('crc', 0 for no data) extended by the given array.
+	 */
+	std::uint32_t crc32(std::uint32_t crc, const std::uint8_t data[], std::size_t len);
+
+
+	/*
+	 * Returns the Adler-32 of the data so far ('adler', 1 for no data) extended by the given array.
+	 */
+	std::uint32_t adler32(std::uint32_t adler, const std::uint8_t data[], std::size_t len);
+
+
+	/*
+	 * Returns the Adler-32 of the concatenation A + B, given the Adler-32 of A,
+	 * the Adler-32 of B and the length of B in bytes.
+	 */
+	std::uint32_t adler32Combine(std::uint32_t adler1, std::uint32_t adler2, std::uint64_t len2);
+
+}
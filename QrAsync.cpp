@@ -0,0 +1,110 @@
+//
+// Coroutine tasks for encoding, rendering and writing QR codes without blocking the caller.
+//
+
+#include "QrAsync.hpp"
+
+#if defined(__cpp_impl_coroutine)
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace QrAsync {
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < threads; i++) {
+        _threads.emplace_back([this] {
+            while (true) {
+                std::coroutine_handle<> handle;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _ready.wait(lock, [this] { return _stopping || !_queue.empty(); });
+                    if (_queue.empty())
+                        return; // stopping, and nothing left to run
+                    handle = _queue.front();
+                    _queue.pop_front();
+                }
+                handle.resume();
+            }
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _ready.notify_all();
+    for (auto &t : _threads)
+        t.join();
+}
+
+void ThreadPool::post(std::coroutine_handle<> handle) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.push_back(handle);
+    }
+    _ready.notify_one();
+}
+
+namespace {
+    // suspends until @io has written the file, then continues on @pool
+    struct WriteAwaiter {
+        ThreadPool &pool;
+        AsyncFileWriter &io;
+        std::string path;
+        std::vector<uint8_t> data;
+        bool ok = false;
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            // the callback runs on the writer's completion thread: hand over, don't resume there
+            io.write(std::move(path), std::move(data), [this, handle](bool written) {
+                ok = written;
+                pool.post(handle);
+            });
+        }
+
+        bool await_resume() const noexcept { return ok; }
+    };
+}
+
+Task<qrcodegen::QrCode> encode(ThreadPool &pool, std::string text, qrcodegen::QrCode::Ecc ecc) {
+    co_await pool.schedule();
+    co_return qrcodegen::QrCode::encodeText(text.c_str(), ecc);
+}
+
+Task<std::vector<uint8_t>> render(ThreadPool &pool, qrcodegen::QrCode qr, std::string text,
+                                  QrRenderSettings settings) {
+    co_await pool.schedule();
+    std::vector<uint8_t> out;
+    std::string error;
+    if (!renderQr(qr, text, settings, out, &error))
+        throw std::runtime_error(error);
+    co_return out;
+}
+
+Task<bool> write(ThreadPool &pool, AsyncFileWriter &io, std::string path, std::vector<uint8_t> data) {
+    // a named awaiter: GCC 12 destroys a temporary one twice when it owns heap memory
+    WriteAwaiter written{pool, io, std::move(path), std::move(data)};
+    co_return co_await written;
+}
+
+Task<bool> exportQr(ThreadPool &pool, AsyncFileWriter &io, std::string text, QrRenderSettings settings,
+                    std::string path) {
+    try {
+        qrcodegen::QrCode qr = co_await encode(pool, text, settings.ecc);
+        std::vector<uint8_t> image = co_await render(pool, qr, text, settings);
+        co_return co_await write(pool, io, std::move(path), std::move(image));
+    } catch (const std::exception &) {
+        co_return false;
+    }
+}
+
+} // namespace QrAsync
+
+#endif //__cpp_impl_coroutine
@@ -0,0 +1,326 @@
+//
+// Coroutine tasks for encoding, rendering and writing QR codes without blocking the caller.
+//
+
+#ifndef QR_ASYNC_HPP
+#define QR_ASYNC_HPP
+
+#include "AsyncFileWriter.hpp"
+#include "QrCode.hpp"
+#include "QrRender.hpp"
+
+/* Needs C++20 (-std=c++20); with older standards this header is empty
+ * and callers keep to the blocking QrToPng / renderQr() API. */
+#if defined(__cpp_impl_coroutine)
+
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace QrAsync {
+
+/* Fixed set of threads that resume coroutines. */
+class ThreadPool {
+public:
+    /** @threads 0 = one per core */
+    explicit ThreadPool(unsigned threads = 0);
+
+    /** Runs what is queued, then joins the threads. */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /** Resumes @handle on one of the threads. */
+    void post(std::coroutine_handle<> handle);
+
+    /** co_await pool.schedule() continues the coroutine on the pool. */
+    auto schedule() {
+        struct Awaiter {
+            ThreadPool &pool;
+
+            bool await_ready() const noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> handle) const { pool.post(handle); }
+
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _ready;
+    std::deque<std::coroutine_handle<>> _queue;
+    bool _stopping = false;
+    std::vector<std::thread> _threads;
+};
+
+template<typename T>
+class Task;
+
+namespace detail {
+    template<typename T>
+    struct Promise;
+
+    // resumes whoever awaits the finished task, on the thread that finished it
+    template<typename P>
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) const noexcept {
+            auto continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    struct PromiseBase {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    template<typename T>
+    struct Promise : PromiseBase {
+        std::optional<T> value;
+
+        Task<T> get_return_object();
+
+        FinalAwaiter<Promise> final_suspend() const noexcept { return {}; }
+
+        void return_value(T v) { value.emplace(std::move(v)); }
+
+        T result() {
+            if (error)
+                std::rethrow_exception(error);
+            return std::move(*value);
+        }
+    };
+
+    template<>
+    struct Promise<void> : PromiseBase {
+        Task<void> get_return_object();
+
+        FinalAwaiter<Promise> final_suspend() const noexcept { return {}; }
+
+        void return_void() const noexcept {}
+
+        void result() const {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    };
+}
+
+/* A lazily started coroutine producing a T. It starts when awaited,
+ * runs on the awaiting thread until it suspends itself (e.g. on
+ * ThreadPool::schedule() or write()), and resumes its awaiter when done.
+ * Exceptions propagate to the awaiter. */
+template<typename T>
+class Task {
+public:
+    using promise_type = detail::Promise<T>;
+
+    Task(Task &&other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (_handle)
+                _handle.destroy();
+            _handle = std::exchange(other._handle, nullptr);
+        }
+        return *this;
+    }
+
+    ~Task() {
+        if (_handle)
+            _handle.destroy();
+    }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() const noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) const noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+
+            T await_resume() const { return handle.promise().result(); }
+        };
+        return Awaiter{_handle};
+    }
+
+private:
+    friend struct detail::Promise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+namespace detail {
+    template<typename T>
+    Task<T> Promise<T>::get_return_object() {
+        return Task<T>(std::coroutine_handle<Promise>::from_promise(*this));
+    }
+
+    inline Task<void> Promise<void>::get_return_object() {
+        return Task<void>(std::coroutine_handle<Promise>::from_promise(*this));
+    }
+
+    struct Latch {
+        std::mutex mutex;
+        std::condition_variable changed;
+        bool done = false;
+
+        void set() {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            changed.notify_all();
+        }
+
+        void wait() {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return done; });
+        }
+    };
+
+    // coroutine that runs a task to completion and then opens a latch
+    struct Waiter {
+        struct promise_type {
+            Latch *latch = nullptr;
+
+            Waiter get_return_object() { return Waiter{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+
+            auto final_suspend() const noexcept {
+                struct Awaiter {
+                    bool await_ready() const noexcept { return false; }
+
+                    void await_suspend(std::coroutine_handle<promise_type> handle) const noexcept {
+                        handle.promise().latch->set();
+                    }
+
+                    void await_resume() const noexcept {}
+                };
+                return Awaiter{};
+            }
+
+            void return_void() const noexcept {}
+
+            void unhandled_exception() const noexcept { std::terminate(); } // the wrappers below catch
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    template<typename T>
+    Waiter waitFor(Task<T> &task, std::optional<T> &result, std::exception_ptr &error) {
+        try {
+            result.emplace(co_await std::move(task));
+        } catch (...) {
+            error = std::current_exception();
+        }
+    }
+
+    inline Waiter waitFor(Task<void> &task, std::exception_ptr &error) {
+        try {
+            co_await std::move(task);
+        } catch (...) {
+            error = std::current_exception();
+        }
+    }
+
+    inline void runAndWait(Waiter waiter) {
+        Latch latch;
+        waiter.handle.promise().latch = &latch;
+        waiter.handle.resume();
+        latch.wait();
+        waiter.handle.destroy();
+    }
+
+    // starts at once and frees itself at the end
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() const noexcept { return {}; }
+
+            std::suspend_never initial_suspend() const noexcept { return {}; }
+
+            std::suspend_never final_suspend() const noexcept { return {}; }
+
+            void return_void() const noexcept {}
+
+            void unhandled_exception() const noexcept { std::terminate(); }
+        };
+    };
+
+    inline Detached detach(Task<void> task) {
+        co_await std::move(task);
+    }
+}
+
+/** Blocks the calling thread until @task has finished.
+ * @return its result; rethrows its exception */
+template<typename T>
+T syncWait(Task<T> task) {
+    std::optional<T> result;
+    std::exception_ptr error;
+    detail::runAndWait(detail::waitFor(task, result, error));
+    if (error)
+        std::rethrow_exception(error);
+    return std::move(*result);
+}
+
+inline void syncWait(Task<void> task) {
+    std::exception_ptr error;
+    detail::runAndWait(detail::waitFor(task, error));
+    if (error)
+        std::rethrow_exception(error);
+}
+
+/** Starts @task and lets it run on its own. It must handle its own
+ * exceptions: one escaping it terminates the program. */
+inline void start(Task<void> task) {
+    detail::detach(std::move(task));
+}
+
+/** Encodes @text on @pool. Throws qrcodegen::data_too_long if it does not fit. */
+Task<qrcodegen::QrCode> encode(ThreadPool &pool, std::string text, qrcodegen::QrCode::Ecc ecc);
+
+/** Renders @qr, encoded from @text, on @pool as renderQr() would.
+ * Throws std::runtime_error if it does not fit the image size. */
+Task<std::vector<uint8_t>> render(ThreadPool &pool, qrcodegen::QrCode qr, std::string text,
+                                  QrRenderSettings settings);
+
+/** Writes @data to @path through @io; the coroutine is suspended, not
+ * blocking a thread, while the file is written and continues on @pool.
+ * @return false if the file could not be written */
+Task<bool> write(ThreadPool &pool, AsyncFileWriter &io, std::string path, std::vector<uint8_t> data);
+
+/** encode, render and write in one task: the headless equivalent of QrToPng::writeToPNG().
+ * @return false if the text does not fit or the file could not be written */
+Task<bool> exportQr(ThreadPool &pool, AsyncFileWriter &io, std::string text, QrRenderSettings settings,
+                    std::string path);
+
+} // namespace QrAsync
+
+#endif //__cpp_impl_coroutine
+
+#endif //QR_ASYNC_HPP
@@ -0,0 +1,64 @@
+//
+// Builds the payloads of the structured QR code types (Wi-Fi, vCard, location).
+//
+
+#include "QrContent.hpp"
+
+#include <sstream>
+
+namespace QrContent {
+
+    std::string escapeSemicolons(const std::string &s) {
+        std::string out;
+        out.reserve(s.size() * 2);
+        for (char c : s) {
+            if (c == '\\' || c == ';' || c == ',') {
+                out.push_back('\\');
+                out.push_back(c);
+            } else {
+                out.push_back(c);
+            }
+        }
+        return out;
+    }
+
+    std::string escapeVcard(const std::string &s) {
+        std::string out;
+        out.reserve(s.size());
+        for (char c : s) {
+            if (c == '\n') out += "\\n";
+            else out.push_back(c);
+        }
+        return out;
+    }
+
+    std::string wifi(const std::string &ssid, const std::string &password, const std::string &encryption) {
+        if (ssid.empty())
+            return std::string();
+        std::ostringstream ss;
+        if (encryption == "None")
+            ss << "WIFI:T:nopass;S:" << escapeSemicolons(ssid) << ";;";
+        else
+            ss << "WIFI:T:" << encryption << ";S:" << escapeSemicolons(ssid) << ";P:" << escapeSemicolons(password)
+               << ";;";
+        return ss.str();
+    }
+
+    std::string vcard(const std::string &name, const std::string &tel, const std::string &email) {
+        if (name.empty())
+            return std::string();
+        std::ostringstream ss;
+        ss << "BEGIN:VCARD\nVERSION:3.0\nFN:" << escapeVcard(name) << "\n";
+        if (!tel.empty()) ss << "TEL:" << escapeVcard(tel) << "\n";
+        if (!email.empty()) ss << "EMAIL:" << escapeVcard(email) << "\n";
+        ss << "END:VCARD";
+        return ss.str();
+    }
+
+    std::string location(const std::string &lat, const std::string &lon) {
+        if (lat.empty() || lon.empty())
+            return std::string();
+        return "https://www.google.com/maps?q=" + lat + "," + lon;
+    }
+
+}
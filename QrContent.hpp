@@ -0,0 +1,33 @@
+//
+// Builds the payloads of the structured QR code types (Wi-Fi, vCard, location).
+//
+
+#ifndef QR_CONTENT_HPP
+#define QR_CONTENT_HPP
+
+#include <string>
+
+/* Shared by the GUI form and the headless front ends, so a code built
+ * from the same fields carries the same text everywhere. The builders
+ * return an empty string when a required field is missing. */
+namespace QrContent {
+
+    /** Escapes \ ; and , with a backslash, as the WIFI: syntax requires. */
+    std::string escapeSemicolons(const std::string &s);
+
+    /** Escapes newlines as \n for vCard property values. */
+    std::string escapeVcard(const std::string &s);
+
+    /** WIFI:T:<encryption>;S:<ssid>;P:<password>;; ("None" encryption: T:nopass, no password).
+     * Requires the SSID. */
+    std::string wifi(const std::string &ssid, const std::string &password, const std::string &encryption);
+
+    /** vCard 3.0 with FN and, when given, TEL and EMAIL. Requires the name. */
+    std::string vcard(const std::string &name, const std::string &tel, const std::string &email);
+
+    /** Google Maps link for the coordinates. Requires both. */
+    std::string location(const std::string &lat, const std::string &lon);
+
+}
+
+#endif //QR_CONTENT_HPP
@@ -0,0 +1,76 @@
+//
+// Outlines of the dark regions of a QR code, for vector output and path fills.
+//
+
+#include "QrOutline.hpp"
+#include "QrCode.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+    // directions of boundary edges, clockwise: turning right is +1
+    enum Direction : uint8_t { EAST, SOUTH, WEST, NORTH };
+
+    struct Edge {
+        int from, to;   // vertex indices, y * (size + 1) + x
+        Direction dir;
+        bool used;
+    };
+}
+
+namespace QrOutline {
+
+std::vector<Polygon> trace(const qrcodegen::QrCode &qr) {
+    const int size = qr.getSize();
+    const int stride = size + 1; // vertices per row
+
+    // Every side between a dark module and a light one (or the edge of the
+    // symbol) is an edge, directed so that the dark module is on its right.
+    std::vector<Edge> edges;
+    std::vector<int> outgoing(2 * static_cast<size_t>(stride) * stride, -1); // at most two edges leave a vertex
+    auto add = [&](int x0, int y0, int x1, int y1, Direction dir) {
+        int from = y0 * stride + x0;
+        edges.push_back(Edge{from, y1 * stride + x1, dir, false});
+        int slot = outgoing[2 * from] < 0 ? 2 * from : 2 * from + 1;
+        outgoing[slot] = static_cast<int>(edges.size()) - 1;
+    };
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            if (!qr.getModule(x, y))
+                continue;
+            if (!qr.getModule(x, y - 1)) add(x, y, x + 1, y, EAST);
+            if (!qr.getModule(x + 1, y)) add(x + 1, y, x + 1, y + 1, SOUTH);
+            if (!qr.getModule(x, y + 1)) add(x + 1, y + 1, x, y + 1, WEST);
+            if (!qr.getModule(x - 1, y)) add(x, y + 1, x, y, NORTH);
+        }
+    }
+
+    // Follow the edges head to tail into closed loops, keeping the corners.
+    // Where two regions touch at a corner, two edges leave the vertex: the
+    // right turn stays on the region the loop came from.
+    std::vector<Polygon> polygons;
+    for (size_t start = 0; start < edges.size(); start++) {
+        if (edges[start].used)
+            continue;
+        Polygon polygon;
+        int e = static_cast<int>(start);
+        do {
+            edges[e].used = true;
+            int vertex = edges[e].to;
+            int next = outgoing[2 * vertex];
+            int other = outgoing[2 * vertex + 1];
+            if (other >= 0 && edges[next].dir != (edges[e].dir + 1) % 4)
+                next = other;
+            if (edges[next].dir != edges[e].dir)
+                polygon.push_back(Point{vertex % stride, vertex / stride});
+            e = next;
+        } while (e != static_cast<int>(start));
+        // begin with the last corner found: the top left one, for outer boundaries
+        std::rotate(polygon.begin(), polygon.end() - 1, polygon.end());
+        polygons.push_back(std::move(polygon));
+    }
+    return polygons;
+}
+
+}
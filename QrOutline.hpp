@@ -0,0 +1,38 @@
+//
+// Outlines of the dark regions of a QR code, for vector output and path fills.
+//
+
+#ifndef QR_OUTLINE_HPP
+#define QR_OUTLINE_HPP
+
+#include <vector>
+
+namespace qrcodegen {
+    class QrCode;
+}
+
+/* Instead of one square per dark module, every connected dark region
+ * becomes one polygon along its boundary, plus one polygon per hole in
+ * it, so the size of a path depends on the region boundaries and not on
+ * the number of modules. Polygons are rectilinear and in module units,
+ * with (0, 0) the top left corner of the symbol (without quiet zone). */
+namespace QrOutline {
+
+    struct Point {
+        int x, y;
+    };
+
+    /* Corners only: consecutive points differ in exactly one coordinate,
+     * and the polygon closes from the last point back to the first. */
+    using Polygon = std::vector<Point>;
+
+    /** Traces all dark regions. With y pointing down, outer boundaries run
+     * clockwise and holes counter-clockwise, so filling the polygons with
+     * either the nonzero or the even-odd rule covers exactly the dark
+     * modules. Modules touching only at a corner belong to separate
+     * polygons. */
+    std::vector<Polygon> trace(const qrcodegen::QrCode &qr);
+
+}
+
+#endif //QR_OUTLINE_HPP
@@ -0,0 +1,361 @@
+//
+// Software rasterizer for the framed, labelled QR code image the GUI exports.
+//
+
+#include "QrRaster.hpp"
+#include "ByteSink.hpp"
+#include "QrCode.hpp"
+#include "TinyPngOut.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+    constexpr uint32_t BLACK = 0xFF000000u;
+    constexpr uint32_t WHITE = 0xFFFFFFFFu;
+    constexpr size_t BAND_BYTES = 1 << 20; // pixels rendered at a time by writePng()
+
+    constexpr const char *LABEL = "SCAN ME";
+    constexpr int GLYPH_WIDTH = 5, GLYPH_HEIGHT = 7, GLYPH_ADVANCE = 6;
+
+    // 5x7 capitals, one byte per row, bit 4 leftmost
+    constexpr uint8_t FONT[26][GLYPH_HEIGHT] = {
+        {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // A
+        {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}, // B
+        {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}, // C
+        {0x1E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1E}, // D
+        {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}, // E
+        {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}, // F
+        {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}, // G
+        {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // H
+        {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}, // I
+        {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}, // J
+        {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, // K
+        {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}, // L
+        {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}, // M
+        {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, // N
+        {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // O
+        {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}, // P
+        {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}, // Q
+        {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}, // R
+        {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}, // S
+        {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // T
+        {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // U
+        {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}, // V
+        {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}, // W
+        {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}, // X
+        {0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04}, // Y
+        {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}, // Z
+    };
+
+    // premultiplied @src over @dst, @count pixels: dst = src + dst * (255 - src alpha) / 255
+    void blendOver(uint32_t *dst, const uint32_t *src, int count) {
+        int i = 0;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i full = _mm_set1_epi16(255);
+        const __m128i half = _mm_set1_epi16(128);
+        auto blendHalf = [&](__m128i s, __m128i d) { // two pixels, 16 bits per channel
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(full, a)), half);
+            t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+            return _mm_add_epi16(s, t);
+        };
+        for (; i + 4 <= count; i += 4) {
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+            __m128i lo = blendHalf(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+            __m128i hi = blendHalf(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packus_epi16(lo, hi));
+        }
+#endif
+        for (; i < count; i++) {
+            uint32_t s = src[i], d = dst[i];
+            uint32_t na = 255 - (s >> 24);
+            uint32_t rb = (d & 0xFF00FFu) * na + 0x800080u;
+            rb = ((rb + ((rb >> 8) & 0xFF00FFu)) >> 8) & 0xFF00FFu;
+            uint32_t ag = ((d >> 8) & 0xFF00FFu) * na + 0x800080u;
+            ag = (ag + ((ag >> 8) & 0xFF00FFu)) & 0xFF00FF00u;
+            dst[i] = s + (rb | ag);
+        }
+    }
+
+    void fillSpan(uint32_t *row, int width, int begin, int end, uint32_t argb) {
+        begin = std::max(begin, 0);
+        end = std::min(end, width);
+        if (begin < end)
+            std::fill(row + begin, row + end, argb);
+    }
+}
+
+QrRaster::Shape QrRaster::shapeFromName(const std::string &name) {
+    if (name == "Circle")
+        return Shape::Circle;
+    if (name == "Rounded")
+        return Shape::Rounded;
+    return Shape::Square;
+}
+
+std::pair<int, int> QrRaster::imageSize(int qrSize, const Style &style) {
+    int side = (qrSize + 2 * std::max(0, style.border)) * std::max(1, style.modulePixels) + 2 * std::max(0, style.frame);
+    return {side, side + std::max(0, style.label)};
+}
+
+QrRaster::QrRaster(const qrcodegen::QrCode &qr, const Style &style) :
+        _qr(qr),
+        _style(style),
+        _modules(qr.getSize()),
+        _sprite(std::max(1, style.modulePixels),
+                style.shape == Shape::Circle ? std::max(1, style.modulePixels) / 2.0 :
+                style.shape == Shape::Rounded ? std::max(1.0, style.modulePixels * 0.25) : 0.0) {
+    _style.modulePixels = std::max(1, _style.modulePixels);
+    _style.border = std::max(0, _style.border);
+    _style.frame = std::max(0, _style.frame);
+    _style.label = std::max(0, _style.label);
+    const int m = _style.modulePixels;
+
+    _qrPixels = (_modules + 2 * _style.border) * m;
+    _side = _qrPixels + 2 * _style.frame;
+    _width = _side;
+    _height = _side + _style.label;
+    _start = _style.frame + _style.border * m;
+    _argb = 0xFF000000u | (_style.color & 0xFFFFFFu);
+
+    _runs.resize(_modules);
+    for (int y = 0; y < _modules; y++) {
+        for (int x = 0; x < _modules;) {
+            if (!_qr.getModule(x, y)) { x++; continue; }
+            int end = x + 1;
+            while (end < _modules && _qr.getModule(end, y)) end++;
+            _runs[y].push_back(Run{x, end});
+            x = end;
+        }
+    }
+
+    // about the cap height of a 0.45 * label bold sans font, which the GUI preview uses
+    if (_style.label > 0) {
+        double fontSize = std::max(12.0, _style.label * 0.45);
+        _glyphScale = std::max(1, static_cast<int>(std::lround(fontSize * 0.72 / GLYPH_HEIGHT)));
+        _glyphScale = std::min(_glyphScale, _style.label / GLYPH_HEIGHT); // 0 if the bar is too low for text
+        int chars = static_cast<int>(std::char_traits<char>::length(LABEL));
+        _textX = (_width - (chars * GLYPH_ADVANCE - 1) * _glyphScale) / 2;
+        _textY = _side + (_style.label - GLYPH_HEIGHT * _glyphScale) / 2;
+    }
+}
+
+std::pair<int, int> QrRaster::logoSize(int w, int h) const {
+    if (w <= 0 || h <= 0)
+        return {0, 0};
+    int maxSide = std::max(1, static_cast<int>(_qrPixels * _style.logoPercent + 0.5));
+    double scale = std::min(static_cast<double>(maxSide) / w, static_cast<double>(maxSide) / h);
+    return {std::max(1, static_cast<int>(w * scale + 0.5)), std::max(1, static_cast<int>(h * scale + 0.5))};
+}
+
+void QrRaster::setLogo(const uint8_t *pixels, int w, int h, int rowstride, int channels) {
+    _logo.clear();
+    _logoColumns.clear();
+    _logoRows.clear();
+    if (!pixels || w <= 0 || h <= 0 || (channels != 3 && channels != 4))
+        return;
+    _logoW = _logoSrcW = std::min(w, _qrPixels);
+    _logoH = _logoSrcH = std::min(h, _qrPixels);
+    _logo.resize(static_cast<size_t>(_logoW) * _logoH);
+    for (int y = 0; y < _logoH; y++) {
+        const uint8_t *p = pixels + static_cast<ptrdiff_t>(y) * rowstride;
+        uint32_t *dst = &_logo[static_cast<size_t>(y) * _logoW];
+        for (int x = 0; x < _logoW; x++, p += channels) {
+            uint32_t a = channels == 4 ? p[3] : 255;
+            uint32_t r = (p[0] * a + 127) / 255, g = (p[1] * a + 127) / 255, b = (p[2] * a + 127) / 255;
+            dst[x] = a << 24 | r << 16 | g << 8 | b;
+        }
+    }
+    _placeLogo();
+}
+
+void QrRaster::setLogo(const uint32_t *pixels, int w, int h, ptrdiff_t stride) {
+    w = std::min(w, _qrPixels);
+    h = std::min(h, _qrPixels);
+    setLogo(pixels, w, h, stride, w, h);
+}
+
+void QrRaster::setLogo(const uint32_t *pixels, int w, int h, ptrdiff_t stride, int drawW, int drawH) {
+    _logo.clear();
+    _logoColumns.clear();
+    _logoRows.clear();
+    if (!pixels || w <= 0 || h <= 0 || drawW <= 0 || drawH <= 0)
+        return;
+    _logoSrcW = w;
+    _logoSrcH = h;
+    _logo.resize(static_cast<size_t>(w) * h);
+    for (int y = 0; y < h; y++)
+        std::copy_n(pixels + y * stride, w, &_logo[static_cast<size_t>(y) * w]);
+    _logoW = std::min(drawW, _qrPixels);
+    _logoH = std::min(drawH, _qrPixels);
+    if (_logoW != w || _logoH != h) {
+        _logoColumns = _logoTaps(w, _logoW);
+        _logoRows = _logoTaps(h, _logoH);
+    }
+    _placeLogo();
+}
+
+std::vector<QrRaster::LogoTap> QrRaster::_logoTaps(int src, int dst) {
+    std::vector<LogoTap> taps(dst);
+    for (int i = 0; i < dst; i++) {
+        double pos = std::clamp((i + 0.5) * src / dst - 0.5, 0.0, src - 1.0); // pixel centres
+        int index = std::min(static_cast<int>(pos), src - 1);
+        taps[i] = LogoTap{index, index == src - 1 ? 0u : static_cast<uint32_t>(std::lround((pos - index) * 256))};
+    }
+    return taps;
+}
+
+// drawn logo row @y, interpolated from the two nearest source rows
+void QrRaster::_scaleLogoRow(int y, uint32_t *out) const {
+    // (256 - w) * a + w * b per channel, two channels at a time in the 0x00FF00FF lanes
+    auto lerp = [](uint32_t a, uint32_t b, uint32_t w) {
+        uint32_t rb = ((a & 0xFF00FF) * (256 - w) + (b & 0xFF00FF) * w) >> 8 & 0xFF00FF;
+        uint32_t ag = (((a >> 8) & 0xFF00FF) * (256 - w) + ((b >> 8) & 0xFF00FF) * w) & 0xFF00FF00;
+        return ag | rb;
+    };
+    const LogoTap &ty = _logoRows[y];
+    const uint32_t *top = &_logo[static_cast<size_t>(ty.index) * _logoSrcW];
+    const uint32_t *bottom = ty.weight ? top + _logoSrcW : top;
+    for (int x = 0; x < _logoW; x++) {
+        const LogoTap &tx = _logoColumns[x];
+        int next = tx.weight ? tx.index + 1 : tx.index;
+        out[x] = lerp(lerp(top[tx.index], top[next], tx.weight), lerp(bottom[tx.index], bottom[next], tx.weight),
+                      ty.weight);
+    }
+}
+
+void QrRaster::_placeLogo() {
+    _logoX = _style.frame + (_qrPixels - _logoW) / 2;
+    _logoY = _style.frame + (_qrPixels - _logoH) / 2;
+    int pad = static_cast<int>(std::lround(std::max(2.0, std::min(_logoW, _logoH) * 0.06)));
+    _padX0 = std::max(0, _logoX - pad);
+    _padY0 = std::max(0, _logoY - pad);
+    _padX1 = std::min(_width, _logoX + _logoW + pad);
+    _padY1 = std::min(_side, _logoY + _logoH + pad);
+}
+
+// One horizontal span per run of dark modules.
+struct QrRaster::SquareModules {
+    static void drawRow(const QrRaster &r, uint32_t *row, const std::vector<Run> &runs, int /*spriteRow*/) {
+        const int m = r._style.modulePixels;
+        for (const Run &run : runs)
+            std::fill(row + r._start + run.begin * m, row + r._start + run.end * m, r._argb);
+    }
+};
+
+// One row of the ModuleSprite per dark module.
+struct QrRaster::SpriteModules {
+    static void drawRow(const QrRaster &r, uint32_t *row, const std::vector<Run> &runs, int spriteRow) {
+        const int m = r._style.modulePixels;
+        for (const Run &run : runs) {
+            for (int x = run.begin; x < run.end; x++)
+                r._sprite.stampRow(row, r._width, r._start + x * m, spriteRow, r._argb);
+        }
+    }
+};
+
+void QrRaster::render(int y0, int y1, uint32_t *pixels, ptrdiff_t stride) const {
+    switch (_style.shape) {
+        case Shape::Square:
+            _renderRows<SquareModules>(y0, y1, pixels, stride);
+            break;
+        case Shape::Circle:
+        case Shape::Rounded:
+            _renderRows<SpriteModules>(y0, y1, pixels, stride);
+            break;
+    }
+}
+
+template<class Modules>
+void QrRaster::_renderRows(int y0, int y1, uint32_t *pixels, ptrdiff_t stride) const {
+    const int m = _style.modulePixels;
+    const int inner0 = _style.frame, inner1 = _style.frame + _qrPixels;
+    std::vector<uint32_t> logoRow(_logoRows.empty() ? 0 : _logoW); // a scaled logo row
+    for (int y = std::max(0, y0); y < std::min(y1, _height); y++) {
+        uint32_t *row = pixels + (y - y0) * stride;
+        if (y >= _side) {
+            _renderLabelRow(y, row);
+            continue;
+        }
+        std::fill(row, row + _width, BLACK);
+        if (y < inner0 || y >= inner1)
+            continue;
+        std::fill(row + inner0, row + inner1, WHITE);
+
+        int my = y - _start;
+        if (my >= 0 && my < _modules * m)
+            Modules::drawRow(*this, row, _runs[my / m], my % m);
+
+        if (!_logo.empty() && y >= _padY0 && y < _padY1) {
+            fillSpan(row, _width, _padX0, _padX1, WHITE);
+            if (y >= _logoY && y < _logoY + _logoH) {
+                const uint32_t *logo = &_logo[static_cast<size_t>(y - _logoY) * _logoW];
+                if (!_logoRows.empty()) {
+                    _scaleLogoRow(y - _logoY, logoRow.data());
+                    logo = logoRow.data();
+                }
+                blendOver(row + _logoX, logo, _logoW);
+            }
+        }
+    }
+}
+
+void QrRaster::_renderLabelRow(int y, uint32_t *row) const {
+    std::fill(row, row + _width, BLACK);
+    if (_glyphScale <= 0 || y < _textY || y >= _textY + GLYPH_HEIGHT * _glyphScale)
+        return;
+    int dotRow = (y - _textY) / _glyphScale;
+    int x = _textX;
+    for (const char *c = LABEL; *c; c++, x += GLYPH_ADVANCE * _glyphScale) {
+        if (*c < 'A' || *c > 'Z')
+            continue;
+        uint8_t bits = FONT[*c - 'A'][dotRow];
+        for (int dot = 0; dot < GLYPH_WIDTH; dot++) {
+            if (bits & (0x10 >> dot))
+                fillSpan(row, _width, x + dot * _glyphScale, x + (dot + 1) * _glyphScale, WHITE);
+        }
+    }
+}
+
+bool QrRaster::writePng(ByteSink &out, const Progress &progress) const {
+    TinyPngOut png(static_cast<uint32_t>(_width), static_cast<uint32_t>(_height), out);
+    if (_style.dpi > 0)
+        png.addPhysicalSize(static_cast<uint32_t>(std::lround(_style.dpi / 0.0254)));
+    int bandRows = static_cast<int>(std::max<size_t>(1, BAND_BYTES / (static_cast<size_t>(_width) * 4)));
+    std::vector<uint32_t> band(static_cast<size_t>(bandRows) * _width);
+    std::vector<uint8_t> rgb(band.size() * 3);
+    for (int y0 = 0; y0 < _height; y0 += bandRows) {
+        int y1 = std::min(_height, y0 + bandRows);
+        render(y0, y1, band.data(), _width);
+        // every pixel is opaque, so premultiplied and straight RGB are the same
+        size_t count = static_cast<size_t>(y1 - y0) * _width;
+        for (size_t i = 0; i < count; i++) {
+            rgb[3 * i] = static_cast<uint8_t>(band[i] >> 16);
+            rgb[3 * i + 1] = static_cast<uint8_t>(band[i] >> 8);
+            rgb[3 * i + 2] = static_cast<uint8_t>(band[i]);
+        }
+        png.write(rgb.data(), count);
+        if (progress && !progress(y1))
+            return false;
+    }
+    return true;
+}
+
+uint64_t QrRaster::pngSize() const {
+    return TinyPngOut::encodedSize(_width, _height) + (_style.dpi > 0 ? TinyPngOut::PHYS_CHUNK_SIZE : 0);
+}
+
+std::vector<uint8_t> QrRaster::encodePng() const {
+    std::vector<uint8_t> png;
+    png.reserve(static_cast<size_t>(pngSize()));
+    VectorSink sink(png);
+    writePng(sink);
+    return png;
+}
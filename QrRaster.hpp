@@ -0,0 +1,143 @@
+//
+// Software rasterizer for the framed, labelled QR code image the GUI exports.
+//
+
+#ifndef QR_RASTER_HPP
+#define QR_RASTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ModuleSprite.hpp"
+
+class ByteSink;
+
+namespace qrcodegen {
+    class QrCode;
+}
+
+/* Draws the export layout straight into 32-bit pixel rows: a black frame
+ * around the quiet zone, the modules, an optional logo on a white pad in
+ * the centre and a black label bar with "SCAN ME" below. Every part is an
+ * axis-aligned span on the pixel grid, so rows are filled with plain
+ * stores (square modules), ModuleSprite stamps (circles and rounded
+ * squares) and a premultiplied alpha blend (logo); the label uses a
+ * built-in bitmap font. The shape is picked once per render() call, not
+ * per module. No Cairo is involved, so headless builds can
+ * render the same image.
+ *
+ * Pixels are premultiplied ARGB32 in native byte order, as in a Cairo
+ * image surface. Rows are independent: any band of them can be rendered
+ * on its own. */
+class QrRaster {
+public:
+    enum class Shape { Square, Circle, Rounded };
+
+    struct Style {
+        int modulePixels = 10;
+        int border = 4;             // quiet zone, in modules
+        int frame = 20;             // pixels
+        int label = 60;             // height of the label bar in pixels, 0 for none
+        uint32_t color = 0x000000;  // 0xRRGGBB of the dark modules
+        Shape shape = Shape::Square;
+        double logoPercent = 0.2;   // largest logo side, as a fraction of the quiet zone square
+        int dpi = 0;                // pixel density written to PNG files, 0 for none
+    };
+
+    /** @return Circle, Rounded or Square (the default for unknown names) */
+    static Shape shapeFromName(const std::string &name);
+
+    /** @return the image width and height for a symbol of @qrSize modules
+     * per side drawn with @style, without building a raster */
+    static std::pair<int, int> imageSize(int qrSize, const Style &style);
+
+    /** Keeps a reference to @qr, which must outlive the raster. */
+    QrRaster(const qrcodegen::QrCode &qr, const Style &style);
+
+    [[nodiscard]] int width() const { return _width; }
+    [[nodiscard]] int height() const { return _height; }
+
+    /** @return the size a @w x @h logo is scaled to before setLogo(): the
+     * largest that fits logoPercent of the quiet zone square, same aspect */
+    [[nodiscard]] std::pair<int, int> logoSize(int w, int h) const;
+
+    /** Centres a @w x @h logo on the symbol, on a white pad. @pixels are
+     * straight (not premultiplied) RGB or RGBA bytes, @channels 3 or 4,
+     * @rowstride bytes per row; they are copied. */
+    void setLogo(const uint8_t *pixels, int w, int h, int rowstride, int channels);
+
+    /** As above, from premultiplied ARGB32 @pixels, @stride pixels per row. */
+    void setLogo(const uint32_t *pixels, int w, int h, ptrdiff_t stride);
+
+    /** As above, but drawn at @drawW x @drawH: the logo is scaled up
+     * bilinearly row by row while rendering, so a logo on a print sized
+     * image is not held at that size. */
+    void setLogo(const uint32_t *pixels, int w, int h, ptrdiff_t stride, int drawW, int drawH);
+
+    /** Renders image rows [@y0, @y1) into @pixels, @stride pixels per row. */
+    void render(int y0, int y1, uint32_t *pixels, ptrdiff_t stride) const;
+
+    /** Called by writePng() after each band with the number of rows written
+     * so far; returning false stops the export. */
+    using Progress = std::function<bool(int rowsDone)>;
+
+    /** Writes the image as a PNG file (TinyPngOut), rendered in bands of
+     * rows so only one band is held as pixels at a time. @return false if
+     * @progress stopped it, leaving a truncated file in @out */
+    bool writePng(ByteSink &out, const Progress &progress = nullptr) const;
+
+    /** @return the exact size of the file writePng() writes */
+    [[nodiscard]] uint64_t pngSize() const;
+
+    /** @return the image as a PNG file */
+    [[nodiscard]] std::vector<uint8_t> encodePng() const;
+
+private:
+    struct Run {
+        int begin, end; // dark modules [begin, end) of one module row
+    };
+
+    const qrcodegen::QrCode &_qr;
+    Style _style;
+    int _modules;
+    int _qrPixels;     // side of the quiet zone square
+    int _side;         // side of the framed square, without the label
+    int _width, _height;
+    int _start;        // first pixel of the modules, horizontally and vertically
+    uint32_t _argb;    // module colour
+    std::vector<std::vector<Run>> _runs;
+    ModuleSprite _sprite;
+
+    struct LogoTap {
+        int index;       // left or upper source pixel
+        uint32_t weight; // of the next one, 0 to 256
+    };
+
+    std::vector<uint32_t> _logo; // premultiplied, _logoSrcW x _logoSrcH
+    int _logoSrcW = 0, _logoSrcH = 0;
+    std::vector<LogoTap> _logoColumns, _logoRows; // per drawn pixel, only if the logo is scaled
+    int _logoX = 0, _logoY = 0, _logoW = 0, _logoH = 0; // where it is drawn
+    int _padX0 = 0, _padY0 = 0, _padX1 = 0, _padY1 = 0;
+
+    int _glyphScale = 1; // pixels per bitmap font dot
+    int _textX = 0, _textY = 0;
+
+    // how the dark modules of one pixel row are drawn, defined in QrRaster.cpp
+    struct SquareModules;
+    struct SpriteModules;
+
+    // the row loop, specialized per shape so it has no shape tests inside
+    template<class Modules>
+    void _renderRows(int y0, int y1, uint32_t *pixels, ptrdiff_t stride) const;
+
+    void _renderLabelRow(int y, uint32_t *row) const;
+    void _scaleLogoRow(int y, uint32_t *out) const;
+    static std::vector<LogoTap> _logoTaps(int src, int dst);
+    void _placeLogo();
+};
+
+#endif //QR_RASTER_HPP
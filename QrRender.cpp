@@ -0,0 +1,63 @@
+//
+// Renders one payload to image bytes in memory, for the headless front ends.
+//
+
+#include "QrRender.hpp"
+#include "ContentHash.hpp"
+#include "QrToPng.h"
+
+#include <optional>
+
+const char *QrRenderSettings::extension() const {
+    return format == "svg" ? ".svg" : ".png";
+}
+
+std::string QrRenderSettings::contentHash(std::string_view text) const {
+    if (format == "svg")
+        return ContentHash::forImage("svg", text, ecc, 0, 0, svgBorder);
+    return ContentHash::forImage("png", text, ecc, size, modulePixels, 0); // same as QrToPng::contentHash()
+}
+
+bool renderQr(std::string_view text, const QrRenderSettings &settings, std::vector<uint8_t> &out,
+              std::string *error) {
+    out.clear();
+    if (text.empty()) {
+        if (error) *error = "empty text";
+        return false;
+    }
+
+    std::optional<qrcodegen::QrCode> qr;
+    try {
+        qr = qrcodegen::QrCode::encodeText(std::string(text).c_str(), settings.ecc);
+    } catch (const std::exception &e) {
+        if (error) *error = e.what();
+        return false;
+    }
+    return renderQr(*qr, text, settings, out, error);
+}
+
+bool renderQr(const qrcodegen::QrCode &qr, std::string_view text, const QrRenderSettings &settings,
+              std::vector<uint8_t> &out, std::string *error) {
+    out.clear();
+    if (settings.format == "svg") {
+        try {
+            std::string svg = qr.toSvgString(settings.svgBorder);
+            // the hash goes right after the XML declaration, where ContentHash::readEmbedded() finds it
+            size_t firstLine = svg.find('\n') + 1;
+            svg.insert(firstLine, std::string("<!-- ") + ContentHash::KEYWORD + " " +
+                                  settings.contentHash(text) + " -->\n");
+            out.assign(svg.begin(), svg.end());
+        } catch (const std::exception &e) {
+            if (error) *error = e.what();
+            return false;
+        }
+        return true;
+    }
+
+    QrToPng png(settings.size, settings.modulePixels, std::string(text), settings.ecc);
+    if (!png.encodeToBuffer(qr, out)) {
+        if (error) *error = "text does not fit the image size / module size";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+//
+// Renders one payload to image bytes in memory, for the headless front ends.
+//
+
+#ifndef QR_RENDER_HPP
+#define QR_RENDER_HPP
+
+#include "QrCode.hpp"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* How a payload is turned into an image. */
+struct QrRenderSettings {
+    qrcodegen::QrCode::Ecc ecc = qrcodegen::QrCode::Ecc::MEDIUM;
+    int size = 300;         // max image width/height in pixels (PNG)
+    int modulePixels = 1;   // min pixels per module (PNG)
+    std::string format = "png"; // "png" or "svg"
+    int svgBorder = 4;      // quiet zone in modules (SVG)
+
+    /** @return ".png" or ".svg" */
+    [[nodiscard]] const char *extension() const;
+
+    /** @return the hash renderQr() embeds in the image of @text, see ContentHash */
+    [[nodiscard]] std::string contentHash(std::string_view text) const;
+};
+
+/** Encodes @text and renders it as described by @settings into @out,
+ * which is cleared first (its capacity is kept). The image carries
+ * @settings.contentHash(text): in a tEXt chunk (PNG) or a comment (SVG).
+ * @return false if the text does not fit a QR code or the image size;
+ * @error (if given) then says why */
+bool renderQr(std::string_view text, const QrRenderSettings &settings, std::vector<uint8_t> &out,
+              std::string *error = nullptr);
+
+/** Same as above for @qr, the code already encoded from @text with
+ * @settings.ecc, so encoding and rendering can run as separate steps. */
+bool renderQr(const qrcodegen::QrCode &qr, std::string_view text, const QrRenderSettings &settings,
+              std::vector<uint8_t> &out, std::string *error = nullptr);
+
+#endif //QR_RENDER_HPP
@@ -0,0 +1,703 @@
+//
+// Long-running HTTP service rendering QR codes, over TCP or a Unix socket.
+//
+
+#include "QrServer.hpp"
+
+#include <stdexcept>
+
+#if defined(__linux__)
+
+#include "BoundedQueue.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <csignal>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t MAX_CONNECTIONS = 16384;
+    constexpr size_t MAX_HEADER_SIZE = 8192;         // request line and headers
+    constexpr size_t MAX_BUFFERED = 64 * 1024;        // unparsed (pipelined) request bytes per connection
+    constexpr auto IDLE_TIMEOUT = std::chrono::seconds(30);
+
+    // epoll tags; connections are numbered from FIRST_CONNECTION
+    constexpr uint64_t LISTENER = 0, WAKEUP = 1, SIGNALS = 2, FIRST_CONNECTION = 16;
+
+    struct Response {
+        std::string head;
+        std::vector<uint8_t> body;
+        size_t sent = 0;    // of head + body
+        bool close = false; // close the connection once sent
+    };
+
+    struct Connection {
+        int fd = -1;
+        std::string in;             // received, not yet handled
+        std::deque<Response> out;
+        bool busy = false;          // a request is with the workers
+        bool closing = false;       // no more requests are handled
+        bool eof = false;           // the client sent everything it will
+        bool writing = false;       // waiting for the socket to take more output
+        uint32_t events = 0;        // as registered with epoll
+        Clock::time_point lastActive;
+    };
+
+    struct Job {
+        uint64_t connection = 0;
+        std::string text;
+        QrRenderSettings settings;
+        std::string etag;
+        bool head = false;
+        bool keepAlive = true;
+    };
+
+    struct Done {
+        uint64_t connection = 0;
+        Response response;
+    };
+
+    std::string lower(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return s;
+    }
+
+    /* %XX and '+' decoding of one query component. @return false on a bad escape */
+    bool urlDecode(std::string_view in, std::string &out) {
+        out.clear();
+        out.reserve(in.size());
+        auto hex = [](char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        };
+        for (size_t i = 0; i < in.size(); i++) {
+            if (in[i] == '+') {
+                out.push_back(' ');
+            } else if (in[i] == '%') {
+                if (i + 2 >= in.size())
+                    return false;
+                int hi = hex(in[i + 1]), lo = hex(in[i + 2]);
+                if (hi < 0 || lo < 0)
+                    return false;
+                out.push_back(static_cast<char>(hi << 4 | lo));
+                i += 2;
+            } else {
+                out.push_back(in[i]);
+            }
+        }
+        return true;
+    }
+
+    const char *statusText(int status) {
+        switch (status) {
+            case 200: return "OK";
+            case 304: return "Not Modified";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 413: return "Payload Too Large";
+            case 431: return "Request Header Fields Too Large";
+            case 503: return "Service Unavailable";
+            default: return "Internal Server Error";
+        }
+    }
+
+    Response makeResponse(int status, const std::string &contentType, std::vector<uint8_t> body, bool keepAlive,
+                          const std::string &etag, bool head, const char *extraHeaders = "") {
+        Response r;
+        r.head.reserve(256);
+        r.head += "HTTP/1.1 " + std::to_string(status) + " " + statusText(status) + "\r\n";
+        if (!contentType.empty())
+            r.head += "Content-Type: " + contentType + "\r\n";
+        if (status != 304)
+            r.head += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        if (!etag.empty()) {
+            // the URL fully determines the image, so it never changes
+            r.head += "ETag: " + etag + "\r\nCache-Control: public, max-age=31536000, immutable\r\n";
+        }
+        r.head += extraHeaders;
+        r.head += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+        if (!head && status != 304)
+            r.body = std::move(body);
+        r.close = !keepAlive;
+        return r;
+    }
+
+    Response errorResponse(int status, const std::string &message, bool keepAlive) {
+        std::string text = message + "\n";
+        return makeResponse(status, "text/plain; charset=utf-8", std::vector<uint8_t>(text.begin(), text.end()),
+                            keepAlive, std::string(), false,
+                            status == 405 ? "Allow: GET, HEAD\r\n" : "");
+    }
+
+    int openListener(const std::string &address, std::string &unixPath) {
+        if (address.compare(0, 5, "unix:") == 0) {
+            unixPath = address.substr(5);
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            if (unixPath.empty() || unixPath.size() >= sizeof(addr.sun_path))
+                throw std::runtime_error("Bad socket path: " + unixPath);
+            std::memcpy(addr.sun_path, unixPath.c_str(), unixPath.size() + 1);
+            struct stat st{};
+            if (::stat(unixPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+                ::unlink(unixPath.c_str()); // left over from an earlier run
+            int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+                ::listen(fd, SOMAXCONN) != 0) {
+                if (fd >= 0)
+                    ::close(fd);
+                throw std::runtime_error("Cannot listen on " + address + ": " + std::strerror(errno));
+            }
+            return fd;
+        }
+
+        // host:port, [v6]:port, :port or port
+        std::string host, port = address;
+        size_t colon = address.rfind(':');
+        if (colon != std::string::npos) {
+            host = address.substr(0, colon);
+            port = address.substr(colon + 1);
+            if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+                host = host.substr(1, host.size() - 2);
+        }
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo *found = nullptr;
+        if (int rc = ::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found))
+            throw std::runtime_error("Bad address " + address + ": " + ::gai_strerror(rc));
+        int fd = -1;
+        for (addrinfo *ai = found; ai && fd < 0; ai = ai->ai_next) {
+            fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd < 0)
+                continue;
+            int one = 1;
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (::bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        ::freeaddrinfo(found);
+        if (fd < 0)
+            throw std::runtime_error("Cannot listen on " + address + ": " + std::strerror(errno));
+        return fd;
+    }
+
+    /* The single-threaded part of the server: sockets, parsing and writing.
+     * Rendering happens on the workers, which hand results back through
+     * _done and wake the loop with the eventfd. */
+    class EventLoop {
+    public:
+        EventLoop(const ServerOptions &options, int listener, int signals)
+                : _options(options), _listener(listener), _signals(signals), _jobs(MAX_CONNECTIONS) {
+            _epoll = ::epoll_create1(EPOLL_CLOEXEC);
+            _wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (_epoll < 0 || _wakeup < 0)
+                throw std::runtime_error(std::string("Cannot create event loop: ") + std::strerror(errno));
+            _watch(_listener, LISTENER, EPOLLIN);
+            _watch(_wakeup, WAKEUP, EPOLLIN);
+            _watch(_signals, SIGNALS, EPOLLIN);
+        }
+
+        ~EventLoop() {
+            for (auto &c : _connections)
+                ::close(c.second.fd);
+            ::close(_wakeup);
+            ::close(_epoll);
+        }
+
+        uint64_t run(unsigned workers) {
+            std::vector<std::thread> pool;
+            for (unsigned i = 0; i < workers; i++)
+                pool.emplace_back([this] { _work(); });
+
+            epoll_event events[256];
+            auto lastSweep = Clock::now();
+            while (!_stopping) {
+                int n = ::epoll_wait(_epoll, events, 256, 1000);
+                if (n < 0 && errno != EINTR)
+                    break;
+                for (int i = 0; i < n; i++) {
+                    uint64_t tag = events[i].data.u64;
+                    if (tag == LISTENER)
+                        _accept();
+                    else if (tag == WAKEUP)
+                        _collect();
+                    else if (tag == SIGNALS)
+                        _stopping = true;
+                    else
+                        _onConnection(tag, events[i].events);
+                }
+                auto now = Clock::now();
+                if (now - lastSweep >= std::chrono::seconds(1)) {
+                    _closeIdle(now);
+                    lastSweep = now;
+                }
+            }
+
+            _jobs.close();
+            for (auto &t : pool)
+                t.join();
+            return _served;
+        }
+
+    private:
+        const ServerOptions &_options;
+        int _listener, _signals;
+        int _epoll = -1, _wakeup = -1;
+        bool _stopping = false;
+        uint64_t _nextId = FIRST_CONNECTION;
+        uint64_t _served = 0;
+        std::unordered_map<uint64_t, Connection> _connections;
+
+        BoundedQueue<Job> _jobs; // at most one per connection, so push() never waits
+        std::mutex _doneMutex;
+        std::vector<Done> _done, _collected;
+
+        void _watch(int fd, uint64_t tag, uint32_t events, int op = EPOLL_CTL_ADD) {
+            epoll_event ev{};
+            ev.events = events;
+            ev.data.u64 = tag;
+            ::epoll_ctl(_epoll, op, fd, &ev);
+        }
+
+        void _work() {
+            Job job;
+            while (_jobs.pop(job)) {
+                std::vector<uint8_t> image;
+                std::string error;
+                Done done;
+                done.connection = job.connection;
+                if (renderQr(job.text, job.settings, image, &error)) {
+                    const char *type = job.settings.format == "svg" ? "image/svg+xml" : "image/png";
+                    done.response = makeResponse(200, type, std::move(image), job.keepAlive, job.etag, job.head);
+                } else {
+                    done.response = errorResponse(400, error, job.keepAlive);
+                }
+
+                bool wake;
+                {
+                    std::lock_guard<std::mutex> lock(_doneMutex);
+                    wake = _done.empty(); // otherwise the loop is already woken
+                    _done.push_back(std::move(done));
+                }
+                if (wake) {
+                    uint64_t one = 1;
+                    ssize_t ignored = ::write(_wakeup, &one, sizeof(one));
+                    (void) ignored;
+                }
+            }
+        }
+
+        void _accept() {
+            while (true) {
+                int fd = ::accept4(_listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED)
+                        continue;
+                    return; // EAGAIN, or out of descriptors until some close
+                }
+                if (_connections.size() >= MAX_CONNECTIONS) {
+                    ::close(fd);
+                    continue;
+                }
+                int one = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on Unix sockets
+                uint64_t id = _nextId++;
+                Connection &c = _connections[id];
+                c.fd = fd;
+                c.lastActive = Clock::now();
+                c.events = EPOLLIN | EPOLLRDHUP;
+                _watch(fd, id, c.events);
+            }
+        }
+
+        void _collect() {
+            uint64_t count;
+            ssize_t ignored = ::read(_wakeup, &count, sizeof(count));
+            (void) ignored;
+            {
+                std::lock_guard<std::mutex> lock(_doneMutex);
+                _collected.swap(_done);
+            }
+            for (Done &done : _collected) {
+                auto it = _connections.find(done.connection);
+                if (it == _connections.end())
+                    continue; // the client went away meanwhile
+                Connection &c = it->second;
+                c.busy = false;
+                _queue(c, std::move(done.response));
+                _process(done.connection, c);
+                if (!_flush(c))
+                    _close(done.connection);
+                else
+                    _rearm(done.connection, c);
+            }
+            _collected.clear();
+        }
+
+        void _onConnection(uint64_t id, uint32_t events) {
+            auto it = _connections.find(id);
+            if (it == _connections.end())
+                return;
+            Connection &c = it->second;
+            c.lastActive = Clock::now();
+
+            if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                if (!_read(c)) {
+                    if (events & (EPOLLERR | EPOLLHUP)) { // nobody left to answer
+                        _close(id);
+                        return;
+                    }
+                    // the client finished sending: answer what it sent, then close
+                    c.eof = true;
+                }
+                _process(id, c);
+            }
+            if (!_flush(c))
+                _close(id);
+            else
+                _rearm(id, c);
+        }
+
+        /* Watches for input unless closing, and for output space while writing. */
+        void _rearm(uint64_t id, Connection &c) {
+            uint32_t events = 0;
+            if (!c.closing && !c.eof)
+                events |= EPOLLIN | EPOLLRDHUP;
+            if (c.writing)
+                events |= EPOLLOUT;
+            if (events != c.events) {
+                c.events = events;
+                _watch(c.fd, id, events, EPOLL_CTL_MOD);
+            }
+        }
+
+        /* @return false at end of stream or on errors */
+        bool _read(Connection &c) {
+            char buffer[16384];
+            while (true) {
+                ssize_t n = ::recv(c.fd, buffer, sizeof(buffer), 0);
+                if (n > 0) {
+                    if (c.in.size() + static_cast<size_t>(n) > MAX_BUFFERED) {
+                        c.in.clear();
+                        _queue(c, errorResponse(413, "request too large", false));
+                        c.closing = true;
+                        return true;
+                    }
+                    c.in.append(buffer, static_cast<size_t>(n));
+                    continue;
+                }
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    return true;
+                return false;
+            }
+        }
+
+        /* Handles buffered requests until one goes to the workers. */
+        void _process(uint64_t id, Connection &c) {
+            while (!c.busy && !c.closing) {
+                size_t end = c.in.find("\r\n\r\n");
+                if (end == std::string::npos) {
+                    if (c.in.size() > MAX_HEADER_SIZE) {
+                        _queue(c, errorResponse(431, "request header too large", false));
+                        c.closing = true;
+                    }
+                    return;
+                }
+                std::string request = c.in.substr(0, end);
+                c.in.erase(0, end + 4);
+                _handle(id, c, request);
+            }
+        }
+
+        void _handle(uint64_t id, Connection &c, const std::string &request) {
+            // request line
+            size_t lineEnd = request.find("\r\n");
+            std::string line = request.substr(0, lineEnd);
+            size_t sp1 = line.find(' '), sp2 = line.rfind(' ');
+            if (sp1 == std::string::npos || sp2 == sp1) {
+                _queue(c, errorResponse(400, "malformed request line", false));
+                c.closing = true;
+                return;
+            }
+            std::string method = line.substr(0, sp1);
+            std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+            std::string version = line.substr(sp2 + 1);
+
+            // headers
+            bool keepAlive = version == "HTTP/1.1";
+            bool hasBody = false;
+            std::string ifNoneMatch;
+            for (size_t pos = lineEnd; pos != std::string::npos && pos < request.size(); ) {
+                pos += 2;
+                size_t next = request.find("\r\n", pos);
+                std::string header = request.substr(pos, next == std::string::npos ? std::string::npos : next - pos);
+                pos = next;
+                size_t colon = header.find(':');
+                if (colon == std::string::npos)
+                    continue;
+                std::string name = lower(header.substr(0, colon));
+                size_t valueStart = header.find_first_not_of(" \t", colon + 1);
+                std::string value = valueStart == std::string::npos ? std::string() : header.substr(valueStart);
+                if (name == "connection") {
+                    std::string v = lower(value);
+                    if (v.find("close") != std::string::npos)
+                        keepAlive = false;
+                    else if (v.find("keep-alive") != std::string::npos)
+                        keepAlive = true;
+                } else if (name == "if-none-match") {
+                    ifNoneMatch = value;
+                } else if ((name == "content-length" && value != "0") || name == "transfer-encoding") {
+                    hasBody = true;
+                }
+            }
+
+            if (version.compare(0, 5, "HTTP/") != 0 || hasBody) {
+                // bodies are never read, so the stream cannot be trusted after one
+                _queue(c, errorResponse(400, hasBody ? "request bodies are not accepted" : "bad HTTP version", false));
+                c.closing = true;
+                return;
+            }
+            if (!keepAlive)
+                c.closing = true;
+            bool head = method == "HEAD";
+            if (method != "GET" && !head) {
+                _queue(c, errorResponse(405, "only GET and HEAD", keepAlive));
+                return;
+            }
+
+            size_t question = target.find('?');
+            std::string path = target.substr(0, question);
+            if (path != "/qr") {
+                _queue(c, errorResponse(404, "not found, use /qr?data=...", keepAlive));
+                return;
+            }
+
+            Job job;
+            job.connection = id;
+            job.settings = _options.defaults;
+            job.settings.format = "png";
+            job.head = head;
+            job.keepAlive = keepAlive;
+            std::string error;
+            if (!_parseQuery(question == std::string::npos ? std::string_view() :
+                             std::string_view(target).substr(question + 1), job, error)) {
+                _queue(c, errorResponse(400, error, keepAlive));
+                return;
+            }
+
+            job.etag = "\"" + job.settings.contentHash(job.text) + "\"";
+            if (!ifNoneMatch.empty() && (ifNoneMatch == "*" || ifNoneMatch.find(job.etag) != std::string::npos)) {
+                _queue(c, makeResponse(304, std::string(), {}, keepAlive, job.etag, head));
+                return;
+            }
+
+            c.busy = true;
+            _jobs.push(std::move(job));
+        }
+
+        bool _parseQuery(std::string_view query, Job &job, std::string &error) {
+            bool hasData = false;
+            std::string name, value;
+            while (!query.empty()) {
+                size_t amp = query.find('&');
+                std::string_view pair = query.substr(0, amp);
+                query = amp == std::string_view::npos ? std::string_view() : query.substr(amp + 1);
+                size_t eq = pair.find('=');
+                if (!urlDecode(pair.substr(0, eq), name) ||
+                    !urlDecode(eq == std::string_view::npos ? std::string_view() : pair.substr(eq + 1), value)) {
+                    error = "bad percent-encoding";
+                    return false;
+                }
+
+                auto number = [&](int &out, int min, int max) {
+                    char *end = nullptr;
+                    long v = std::strtol(value.c_str(), &end, 10);
+                    if (value.empty() || *end != '\0' || v < min || v > max) {
+                        error = "bad " + name + ": " + value;
+                        return false;
+                    }
+                    out = static_cast<int>(v);
+                    return true;
+                };
+                if (name == "data") {
+                    job.text = value;
+                    hasData = true;
+                } else if (name == "ecc") {
+                    std::string v = lower(value);
+                    using Ecc = qrcodegen::QrCode::Ecc;
+                    if (v == "l") job.settings.ecc = Ecc::LOW;
+                    else if (v == "m") job.settings.ecc = Ecc::MEDIUM;
+                    else if (v == "q") job.settings.ecc = Ecc::QUARTILE;
+                    else if (v == "h") job.settings.ecc = Ecc::HIGH;
+                    else {
+                        error = "bad ecc: " + value;
+                        return false;
+                    }
+                } else if (name == "size") {
+                    if (!number(job.settings.size, 1, _options.maxSize))
+                        return false;
+                } else if (name == "border") {
+                    if (!number(job.settings.svgBorder, 0, 100))
+                        return false;
+                } else if (name == "fmt" || name == "format") {
+                    if (value != "png" && value != "svg") {
+                        error = "bad fmt: " + value;
+                        return false;
+                    }
+                    job.settings.format = value;
+                }
+            }
+            if (!hasData || job.text.empty()) {
+                error = "data is required";
+                return false;
+            }
+            return true;
+        }
+
+        void _queue(Connection &c, Response response) {
+            if (response.close)
+                c.closing = true;
+            c.out.push_back(std::move(response));
+            _served++;
+        }
+
+        /* Sends queued responses. @return false if the connection should be closed */
+        bool _flush(Connection &c) {
+            c.writing = false;
+            while (!c.out.empty()) {
+                Response &r = c.out.front();
+                size_t total = r.head.size() + r.body.size();
+                iovec iov[2];
+                int count = 0;
+                if (r.sent < r.head.size()) {
+                    iov[count++] = {&r.head[r.sent], r.head.size() - r.sent};
+                    if (!r.body.empty())
+                        iov[count++] = {r.body.data(), r.body.size()};
+                } else {
+                    iov[count++] = {r.body.data() + (r.sent - r.head.size()), total - r.sent};
+                }
+                msghdr msg{};
+                msg.msg_iov = iov;
+                msg.msg_iovlen = static_cast<size_t>(count);
+                ssize_t n = ::sendmsg(c.fd, &msg, MSG_NOSIGNAL);
+                if (n < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+                        return false;
+                    c.writing = true;
+                    return true;
+                }
+                r.sent += static_cast<size_t>(n);
+                if (r.sent < total)
+                    continue;
+                bool close = r.close;
+                c.out.pop_front();
+                if (close)
+                    return false;
+            }
+            return c.busy || !(c.closing || c.eof); // otherwise nothing more will be answered
+        }
+
+        void _close(uint64_t id) {
+            auto it = _connections.find(id);
+            if (it == _connections.end())
+                return;
+            ::close(it->second.fd); // also removes it from the epoll set
+            _connections.erase(it);
+        }
+
+        void _closeIdle(Clock::time_point now) {
+            std::vector<uint64_t> idle;
+            for (auto &entry : _connections) {
+                const Connection &c = entry.second;
+                if (!c.busy && c.out.empty() && now - c.lastActive > IDLE_TIMEOUT)
+                    idle.push_back(entry.first);
+            }
+            for (uint64_t id : idle)
+                _close(id);
+        }
+    };
+}
+
+QrServer::QrServer(ServerOptions options) : _options(std::move(options)) {
+    if (_options.workers == 0)
+        _options.workers = std::max(1u, std::thread::hardware_concurrency());
+}
+
+void QrServer::run() {
+    std::string unixPath;
+    int listener = openListener(_options.listen, unixPath);
+
+    // SIGINT / SIGTERM arrive through a signalfd in the loop; blocked before
+    // the workers start, so they inherit the mask and never take them
+    sigset_t stopSignals, previous;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, &previous);
+    int signals = ::signalfd(-1, &stopSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    try {
+        if (signals < 0)
+            throw std::runtime_error(std::string("Cannot create signalfd: ") + std::strerror(errno));
+        if (!_options.quiet)
+            std::cerr << "qrgen: serving on " << _options.listen << " with " << _options.workers << " workers"
+                      << std::endl;
+        EventLoop loop(_options, listener, signals);
+        _served = loop.run(_options.workers);
+    } catch (...) {
+        if (signals >= 0)
+            ::close(signals);
+        ::close(listener);
+        pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+        throw;
+    }
+    ::close(signals);
+    ::close(listener);
+    if (!unixPath.empty())
+        ::unlink(unixPath.c_str());
+    pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+}
+
+#else
+
+QrServer::QrServer(ServerOptions options) : _options(std::move(options)) {
+}
+
+void QrServer::run() {
+    throw std::runtime_error("The server needs epoll and is only available on Linux");
+}
+
+#endif
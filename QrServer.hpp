@@ -0,0 +1,49 @@
+//
+// Long-running HTTP service rendering QR codes, over TCP or a Unix socket.
+//
+
+#ifndef QR_SERVER_HPP
+#define QR_SERVER_HPP
+
+#include "QrRender.hpp"
+
+#include <cstdint>
+#include <string>
+
+struct ServerOptions {
+    std::string listen;         // "host:port", ":port" (all interfaces) or "unix:/path/to/socket"
+    QrRenderSettings defaults;  // used for parameters a request leaves out
+    unsigned workers = 0;       // render threads, 0 = one per core
+    int maxSize = 4096;         // largest size a request may ask for
+    bool quiet = false;
+};
+
+/* Serves
+ *
+ *   GET /qr?data=TEXT&ecc=L|M|Q|H&size=N&fmt=png|svg&border=N
+ *
+ * with HTTP/1.1 keep-alive. One thread runs an epoll loop over all
+ * connections and a fixed pool of workers renders the images in memory
+ * with renderQr(). The ETag of a response is its content hash, which
+ * depends only on the parameters, so If-None-Match is answered with
+ * 304 without rendering anything.
+ *
+ * Requests on one connection are answered in order, one at a time;
+ * pipelined requests wait in the connection's buffer. */
+class QrServer {
+public:
+    explicit QrServer(ServerOptions options);
+
+    /** Binds the listening socket and serves until SIGINT or SIGTERM.
+     * Throws std::runtime_error if the socket cannot be set up, or on
+     * platforms without epoll (the server is Linux only). */
+    void run();
+
+    [[nodiscard]] uint64_t requestsServed() const { return _served; }
+
+private:
+    ServerOptions _options;
+    uint64_t _served = 0;
+};
+
+#endif //QR_SERVER_HPP
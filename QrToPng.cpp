@@ -1,124 +1,228 @@
-//
-// Created by remy on 02-06-20.
-//
-
-#include "QrToPng.h"
-
-QrToPng::QrToPng(std::string fileName, int imgSize, int minModulePixelSize, std::string text,
-                 bool overwriteExistingFile, qrcodegen::QrCode::Ecc ecc) :
-        _fileName(std::move(fileName)), _size(imgSize), _minModulePixelSize(minModulePixelSize), _text(std::move(text)),
-        _overwriteExistingFile(overwriteExistingFile), _ecc(ecc) {
-}
-
-bool QrToPng::writeToPNG() {
-    /* text is required */
-    if (_text.empty())
-        return false;
-
-
-    if (!_overwriteExistingFile and fs::exists(_fileName))
-        return false;
-
-    auto _qr = qrcodegen::QrCode::encodeText("", _ecc);
-    try {
-        _qr = qrcodegen::QrCode::encodeText(_text.c_str(), _ecc);
-    }
-    catch (const std::length_error &e) {
-        std::cerr << "Failed to generate QR code, too much data. Decrease _ecc, enlarge size or give less text."
-                  << std::endl;
-        std::cerr << "e.what(): " << e.what() << std::endl;
-        return false;
-    }
-
-    if (_overwriteExistingFile and fs::exists(_fileName))
-        if (!fs::copy_file(_fileName, _fileName + ".tmp", fs::copy_options::overwrite_existing))
-            return false;
-
-    auto result = _writeToPNG(_qr);
-
-    if (result)
-        fs::remove(_fileName + ".tmp");
-
-    return result;
-
-}
-
-bool QrToPng::_writeToPNG(const qrcodegen::QrCode &qrData) const {
-    std::ofstream out(_fileName.c_str(), std::ios::binary);
-    int pngWH = _imgSizeWithBorder(qrData);
-    TinyPngOut pngout(pngWH, pngWH, out);
-
-    auto qrSize = qrData.getSize();
-    auto qrSizeWithBorder = qrData.getSize() + 2;
-    if (qrSizeWithBorder > _size)
-        return false; // qrcode doesn't fit
-
-    int qrSizeFitsInMaxImgSizeTimes = _size / qrSizeWithBorder;
-    int pixelsWHPerModule = qrSizeFitsInMaxImgSizeTimes;
-
-    if (qrSizeFitsInMaxImgSizeTimes < _minModulePixelSize)
-        return false; // image would be to small to scan
-
-    std::vector<uint8_t> tmpData;
-    const uint8_t blackPixel = 0x00;
-    const uint8_t whitePixel = 0xFF;
-
-    /* The below loop converts the qrData to RGB8.8.8 pixels and writes it with
-     * the tinyPNGoutput library. since we probably have requested a larger
-     * qr module pixel size we must transform the qrData modules to be larger
-     * pixels (than just 1x1). */
-
-    // border above
-    for (int i = 0; i < pngWH; i++) // row
-        for (int j = 0; j < pixelsWHPerModule; j++) // module pixel (height)
-            tmpData.insert(tmpData.end(), {whitePixel, whitePixel, whitePixel});
-
-    pngout.write(tmpData.data(), static_cast<size_t>(tmpData.size() / 3));
-    tmpData.clear();
-
-    for (int qrModuleAtY = 0; qrModuleAtY < qrSize; qrModuleAtY++) {
-        for (int col = 0; col < pixelsWHPerModule; col++) {
-            // border left
-            for (int i = 0; i < qrSizeFitsInMaxImgSizeTimes; ++i)
-                tmpData.insert(tmpData.end(), {whitePixel, whitePixel, whitePixel});
-
-            // qr module to pixel
-            for (int qrModuleAtX = 0; qrModuleAtX < (qrSize); qrModuleAtX++) {
-            for (int row = 0; row < qrSizeFitsInMaxImgSizeTimes; ++row) {
-                    if (qrData.getModule(qrModuleAtX, qrModuleAtY)) {
-                        // insert saves us a for loop or 3 times the same line.
-                        tmpData.insert(tmpData.end(), {blackPixel, blackPixel, blackPixel});
-                    } else {
-                        tmpData.insert(tmpData.end(), {whitePixel, whitePixel, whitePixel});
-                    }
-                }
-            }
-            // border right
-            for (int i = 0; i < qrSizeFitsInMaxImgSizeTimes; ++i)
-                tmpData.insert(tmpData.end(), {whitePixel, whitePixel, whitePixel});
-
-            // write the entire  row
-            pngout.write(tmpData.data(), static_cast<size_t>(tmpData.size() / 3));
-            tmpData.clear();
-        }
-    }
-
-    // border below
-    for (int i = 0; i < pngWH; i++) // row
-        for (int j = 0; j < pixelsWHPerModule; j++) // module pixel (height)
-            tmpData.insert(tmpData.end(), {whitePixel, whitePixel, whitePixel});
-
-    pngout.write(tmpData.data(), static_cast<size_t>(tmpData.size() / 3));
-    tmpData.clear();
-
-    return fs::exists(_fileName);
-}
-
-
-uint32_t QrToPng::_imgSize(const qrcodegen::QrCode &qrData) const {
-    return (_size / qrData.getSize()) * qrData.getSize();
-}
-
-uint32_t QrToPng::_imgSizeWithBorder(const qrcodegen::QrCode &qrData) const {
-    return (_size / (qrData.getSize() + 2)) * (qrData.getSize() + 2);
-}
+//
+// Created by remy on 02-06-20.
+//
+
+#include "QrToPng.h"
+#include "AtomicFile.hpp"
+
+QrToPng::QrToPng(std::string fileName, int imgSize, int minModulePixelSize, std::string text,
+                 bool overwriteExistingFile, qrcodegen::QrCode::Ecc ecc) :
+        _fileName(std::move(fileName)), _size(imgSize), _minModulePixelSize(minModulePixelSize), _text(std::move(text)),
+        _overwriteExistingFile(overwriteExistingFile), _ecc(ecc) {
+}
+
+QrToPng::QrToPng(int imgSize, int minModulePixelSize, std::string text, qrcodegen::QrCode::Ecc ecc) :
+        QrToPng(std::string(), imgSize, minModulePixelSize, std::move(text), false, ecc) {
+}
+
+bool QrToPng::writeToPNG() {
+    // early out only; _writeToPNG publishes without replacing, in case the file appears meanwhile
+    if (!_overwriteExistingFile and fs::exists(_fileName))
+        return false;
+
+    /* Regenerating an unchanged image would produce the same bytes,
+     * so a matching hash means the file can be left alone. */
+    if (_skipUnchanged && !_text.empty() && ContentHash::readEmbedded(_fileName) == contentHash())
+        return true;
+
+    auto _qr = qrcodegen::QrCode::encodeText("", _ecc);
+    if (!_encode(_qr))
+        return false;
+
+    bool result = false;
+    try {
+        result = _writeToPNG(_qr);
+    }
+    catch (const std::runtime_error &e) {
+        std::cerr << "Failed to write " << _fileName << ": " << e.what() << std::endl;
+    }
+
+    return result;
+
+}
+
+void QrToPng::setSyncToDisk(bool syncToDisk) {
+    _syncToDisk = syncToDisk;
+}
+
+void QrToPng::setSkipUnchanged(bool skipUnchanged) {
+    _skipUnchanged = skipUnchanged;
+}
+
+std::string QrToPng::contentHash() const {
+    return ContentHash::forImage("png", _text, _ecc, _size, _minModulePixelSize, 0);
+}
+
+bool QrToPng::encodeToBuffer(std::vector<uint8_t> &out) const {
+    auto _qr = qrcodegen::QrCode::encodeText("", _ecc);
+    if (!_encode(_qr))
+        return false;
+    return encodeToBuffer(_qr, out);
+}
+
+bool QrToPng::encodeToBuffer(const qrcodegen::QrCode &qrData, std::vector<uint8_t> &out) const {
+    if (_pixelsPerModule(qrData) == 0)
+        return false;
+
+    uint32_t pngWH = _imgSizeWithBorder(qrData);
+    out.clear();
+    out.reserve(static_cast<size_t>(_pngSize(pngWH)));
+    VectorSink sink(out);
+    return _writePixels(qrData, sink);
+}
+
+size_t QrToPng::encodeToBuffer(uint8_t *buffer, size_t capacity) const {
+    auto _qr = qrcodegen::QrCode::encodeText("", _ecc);
+    if (!_encode(_qr) || _pixelsPerModule(_qr) == 0)
+        return 0;
+
+    uint32_t pngWH = _imgSizeWithBorder(_qr);
+    if (_pngSize(pngWH) > capacity)
+        return 0; // checked up front, so nothing is written on failure
+
+    SpanSink sink(buffer, capacity);
+    if (!_writePixels(_qr, sink))
+        return 0;
+    return sink.size();
+}
+
+size_t QrToPng::encodedSize() const {
+    auto _qr = qrcodegen::QrCode::encodeText("", _ecc);
+    if (!_encode(_qr) || _pixelsPerModule(_qr) == 0)
+        return 0;
+
+    uint32_t pngWH = _imgSizeWithBorder(_qr);
+    return static_cast<size_t>(_pngSize(pngWH));
+}
+
+bool QrToPng::_encode(qrcodegen::QrCode &qrData) const {
+    /* text is required */
+    if (_text.empty())
+        return false;
+
+    try {
+        qrData = qrcodegen::QrCode::encodeText(_text.c_str(), _ecc);
+    }
+    catch (const std::length_error &e) {
+        std::cerr << "Failed to generate QR code, too much data. Decrease _ecc, enlarge size or give less text."
+                  << std::endl;
+        std::cerr << "e.what(): " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool QrToPng::_writeToPNG(const qrcodegen::QrCode &qrData) const {
+    if (_pixelsPerModule(qrData) == 0)
+        return false;
+
+    /* The image is written to a temp file next to the target and renamed
+     * over it (AtomicFile), so readers see either the old file or the
+     * complete new one, never a partial write. TinyPngOut hands over
+     * 64 KiB chunks, so the file is written in a few write calls. */
+    return AtomicFile::write(_fileName, _overwriteExistingFile, _syncToDisk,
+                             [this, &qrData](ByteSink &out) { return _writePixels(qrData, out); });
+}
+
+bool QrToPng::_writePixels(const qrcodegen::QrCode &qrData, ByteSink &out) const {
+    int pixelsWHPerModule = _pixelsPerModule(qrData);
+    if (pixelsWHPerModule == 0)
+        return false;
+
+    auto qrSize = qrData.getSize();
+    int pngWH = _imgSizeWithBorder(qrData);
+
+    std::string hash = contentHash();
+
+    if (_usesBands(pngWH)) {
+        /* Large images: rows are rendered independently, so bands
+         * of them can be rendered and encoded on all cores. */
+        BandedPngOut pngout(pngWH, pngWH, out);
+        pngout.addText(ContentHash::KEYWORD, hash);
+        pngout.write([&qrData, pixelsWHPerModule](uint32_t y, uint8_t row[]) {
+            _rasterizeRow(qrData, static_cast<int>(y) / pixelsWHPerModule - 1, pixelsWHPerModule, row);
+        });
+        return true;
+    }
+
+    TinyPngOut pngout(pngWH, pngWH, out);
+    pngout.addText(ContentHash::KEYWORD, hash);
+
+    /* Every module row is pixelsWHPerModule identical pixel rows, so each
+     * one is rasterized once and handed to the tinyPNGoutput library that
+     * many times. The quiet zone row is the same above and below. */
+    std::vector<uint8_t> quietRow(static_cast<size_t>(pngWH) * 3);
+    std::vector<uint8_t> moduleRow(quietRow.size());
+    _rasterizeRow(qrData, -1, pixelsWHPerModule, quietRow.data());
+
+    // border above
+    for (int j = 0; j < pixelsWHPerModule; j++)
+        pngout.write(quietRow.data(), static_cast<size_t>(pngWH));
+
+    for (int qrModuleAtY = 0; qrModuleAtY < qrSize; qrModuleAtY++) {
+        _rasterizeRow(qrData, qrModuleAtY, pixelsWHPerModule, moduleRow.data());
+        for (int j = 0; j < pixelsWHPerModule; j++)
+            pngout.write(moduleRow.data(), static_cast<size_t>(pngWH));
+    }
+
+    // border below
+    for (int j = 0; j < pixelsWHPerModule; j++)
+        pngout.write(quietRow.data(), static_cast<size_t>(pngWH));
+
+    return true;
+}
+
+void QrToPng::_rasterizeRow(const qrcodegen::QrCode &qrData, int qrModuleAtY, int pixelsWHPerModule, uint8_t *row) {
+    const uint8_t blackPixel = 0x00;
+    const uint8_t whitePixel = 0xFF;
+    auto qrSize = qrData.getSize();
+    size_t moduleBytes = static_cast<size_t>(pixelsWHPerModule) * 3;
+
+    std::memset(row, whitePixel, (qrSize + 2) * moduleBytes);
+    if (qrModuleAtY < 0 || qrModuleAtY >= qrSize)
+        return; // border row
+
+    // one memset per run of dark modules, the border left is module -1
+    for (int qrModuleAtX = 0; qrModuleAtX < qrSize; ) {
+        if (!qrData.getModule(qrModuleAtX, qrModuleAtY)) {
+            qrModuleAtX++;
+            continue;
+        }
+        int runStart = qrModuleAtX;
+        while (qrModuleAtX < qrSize && qrData.getModule(qrModuleAtX, qrModuleAtY))
+            qrModuleAtX++;
+        std::memset(row + (runStart + 1) * moduleBytes, blackPixel, (qrModuleAtX - runStart) * moduleBytes);
+    }
+}
+
+bool QrToPng::_usesBands(uint32_t pngWH) {
+    return static_cast<uint64_t>(pngWH) * (static_cast<uint64_t>(pngWH) * 3 + 1) > BANDED_MIN_SIZE;
+}
+
+uint64_t QrToPng::_pngSize(uint32_t pngWH) const {
+    uint64_t hashChunk = TinyPngOut::textChunk(ContentHash::KEYWORD, contentHash()).size();
+    if (_usesBands(pngWH))
+        return BandedPngOut::encodedSize(pngWH, pngWH) + hashChunk;
+    return TinyPngOut::encodedSize(pngWH, pngWH) + hashChunk;
+}
+
+int QrToPng::_pixelsPerModule(const qrcodegen::QrCode &qrData) const {
+    auto qrSizeWithBorder = qrData.getSize() + 2;
+    if (qrSizeWithBorder > _size)
+        return 0; // qrcode doesn't fit
+
+    int qrSizeFitsInMaxImgSizeTimes = _size / qrSizeWithBorder;
+    if (qrSizeFitsInMaxImgSizeTimes < _minModulePixelSize)
+        return 0; // image would be to small to scan
+
+    return qrSizeFitsInMaxImgSizeTimes;
+}
+
+
+uint32_t QrToPng::_imgSize(const qrcodegen::QrCode &qrData) const {
+    return (_size / qrData.getSize()) * qrData.getSize();
+}
+
+uint32_t QrToPng::_imgSizeWithBorder(const qrcodegen::QrCode &qrData) const {
+    return (_size / (qrData.getSize() + 2)) * (qrData.getSize() + 2);
+}
@@ -1,71 +1,142 @@
-//
-// Created by remy on 07-06-20.
-//
-
-#ifndef QR_TO_PNG_H
-#define QR_TO_PNG_H
-
-/* If your compiler is recent enough,
- * you don't need to include '::experimental::',
- * you can just include "::filesystem". The below
- * code makes both work, accessible at 'fs::'. */
-#if defined(__GNUC__) && __GNUC__ < 9
-#include <experimental/filesystem>
-namespace fs = std::experimental::filesystem;
-#else
-#include <filesystem>
-namespace fs = std::filesystem;
-#endif
-
-#include "QrCode.hpp"
-#include "TinyPngOut.hpp"
-#include <fstream>
-#include <iostream>
-#include <memory>
-#include <string>
-
-class QrToPng {
-public:
-    /**
-     * Gives an object containing all the data to create the QR code. When @writeToPNG() is called,
-     * the actual file is constructed and written.
-     * The image is scaled to fit in the given size as much as possible relative to the QR code
-     * size.
-     * @param fileName relative or absolute filename to write image to. Relative will be in CWD.
-     * @param imgSize The height and width of the image. Image is square, so will be width and height.
-     * @param minModulePixelSize How many pixels big should a qr module be (a white or black dot)?
-     * @param text The text to encode in the QR code.
-     * @param overwriteExistingFile Overwrite if a file with @fileName already exists?
-     * @param ecc error correction (low,mid,high).
-     */
-    QrToPng(std::string fileName, int imgSize, int minModulePixelSize, std::string text,
-            bool overwriteExistingFile, qrcodegen::QrCode::Ecc ecc);
-
-    /** Writes a QrToPng object to a png file at @_fileName.
-     * @return true if file could be written, false if file could not be written */
-    bool writeToPNG();
-
-private:
-    std::string _fileName;
-    int _size;
-    int _minModulePixelSize;
-    std::string _text;
-    bool _overwriteExistingFile;
-    qrcodegen::QrCode::Ecc _ecc;
-
-    /** Writes the PNG file. Constructs a vector with
-     * each element being a row of RGB 8.8.8 pixels, the
-     * format is geared towards the tinypngoutput library.
-     * @param qrData the code returned by the qrcodegen library
-     * @return true if file could be written, false if file could not be written */
-    [[nodiscard]] bool _writeToPNG(const qrcodegen::QrCode &qrData) const;
-
-    /* returns the width/height of the image based on the max image size
-    * and qr width. Ex. If the max img size is 90, the qr code size 29
-    * the qr module pixel size will be 3, the image size will be 3*29=87. */
-    [[nodiscard]] uint32_t _imgSize(const qrcodegen::QrCode &qrData) const;
-
-    [[nodiscard]] uint32_t _imgSizeWithBorder(const qrcodegen::QrCode &qrData) const;
-};
-
-#endif //QR_TO_PNG_H
+//
+// Created by remy on 07-06-20.
+//
+
+#ifndef QR_TO_PNG_H
+#define QR_TO_PNG_H
+
+/* If your compiler is recent enough,
+ * you don't need to include '::experimental::',
+ * you can just include "::filesystem". The below
+ * code makes both work, accessible at 'fs::'. */
+#if defined(__GNUC__) && __GNUC__ < 9
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#else
+#include <filesystem>
+namespace fs = std::filesystem;
+#endif
+
+#include "BandedPngOut.hpp"
+#include "ContentHash.hpp"
+#include "QrCode.hpp"
+#include "TinyPngOut.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+class QrToPng {
+public:
+    /**
+     * Gives an object containing all the data to create the QR code. When @writeToPNG() is called,
+     * the actual file is constructed and written.
+     * The image is scaled to fit in the given size as much as possible relative to the QR code
+     * size.
+     * @param fileName relative or absolute filename to write image to. Relative will be in CWD.
+     * @param imgSize The height and width of the image. Image is square, so will be width and height.
+     * @param minModulePixelSize How many pixels big should a qr module be (a white or black dot)?
+     * @param text The text to encode in the QR code.
+     * @param overwriteExistingFile Overwrite if a file with @fileName already exists?
+     * @param ecc error correction (low,mid,high).
+     */
+    QrToPng(std::string fileName, int imgSize, int minModulePixelSize, std::string text,
+            bool overwriteExistingFile, qrcodegen::QrCode::Ecc ecc);
+
+    /**
+     * Same as above, for objects that only encode to memory with @encodeToBuffer().
+     */
+    QrToPng(int imgSize, int minModulePixelSize, std::string text, qrcodegen::QrCode::Ecc ecc);
+
+    /** Writes a QrToPng object to a png file at @_fileName.
+     * The file is written under a unique temporary name in the same directory
+     * and renamed to @_fileName once complete, so an existing file is replaced
+     * atomically and never left half-written.
+     * If the file already holds this image (its embedded @contentHash() matches),
+     * nothing is encoded or written, see @setSkipUnchanged().
+     * @return true if file could be written or was up to date, false if file could not be written */
+    bool writeToPNG();
+
+    /** Makes @writeToPNG() rewrite files that already hold the same image. On by default. */
+    void setSkipUnchanged(bool skipUnchanged);
+
+    /** @return the hash of the text and every setting that determines the image. Every
+     * PNG file written carries it in a tEXt chunk (keyword ContentHash::KEYWORD). */
+    [[nodiscard]] std::string contentHash() const;
+
+    /** Makes @writeToPNG() fsync the file before the rename and the directory
+     * after it, so the new image survives a crash. Off by default. */
+    void setSyncToDisk(bool syncToDisk);
+
+    /** Encodes the PNG file into @out without touching the disk. @out is cleared first
+     * but keeps its capacity, so reusing one vector avoids reallocating per image.
+     * @return true if the image could be encoded, false otherwise */
+    bool encodeToBuffer(std::vector<uint8_t> &out) const;
+
+    /** Same as above for a code that is already encoded, which must be the
+     * encoding of this object's text (it goes into the @contentHash()). */
+    bool encodeToBuffer(const qrcodegen::QrCode &qrData, std::vector<uint8_t> &out) const;
+
+    /** Encodes the PNG file into the caller-provided @buffer of @capacity bytes.
+     * Nothing is written if the image does not fit, see @encodedSize().
+     * @return the number of bytes written, 0 if the image could not be encoded */
+    size_t encodeToBuffer(uint8_t *buffer, size_t capacity) const;
+
+    /** @return the exact size in bytes of the PNG file, 0 if the image could not be encoded */
+    [[nodiscard]] size_t encodedSize() const;
+
+private:
+    std::string _fileName;
+    int _size;
+    int _minModulePixelSize;
+    std::string _text;
+    bool _overwriteExistingFile;
+    qrcodegen::QrCode::Ecc _ecc;
+    bool _syncToDisk = false;
+    bool _skipUnchanged = true;
+
+    /** Encodes @_text into @qrData.
+     * @return false if there is no text or too much of it */
+    [[nodiscard]] bool _encode(qrcodegen::QrCode &qrData) const;
+
+    /** Writes the PNG file.
+     * @param qrData the code returned by the qrcodegen library
+     * @return true if file could be written, false if file could not be written */
+    [[nodiscard]] bool _writeToPNG(const qrcodegen::QrCode &qrData) const;
+
+    /** Writes the PNG image to @out, one rasterized row of RGB 8.8.8
+     * pixels at a time, the format is geared towards the tinypngoutput library.
+     * @param qrData the code returned by the qrcodegen library
+     * @return false if the QR code does not fit the image size */
+    [[nodiscard]] bool _writePixels(const qrcodegen::QrCode &qrData, ByteSink &out) const;
+
+    /** Fills @row (a full-width row of RGB 8.8.8 pixels) with module row @qrModuleAtY,
+     * where -1 and the qr size are the quiet zone rows above and below. */
+    static void _rasterizeRow(const qrcodegen::QrCode &qrData, int qrModuleAtY, int pixelsWHPerModule, uint8_t *row);
+
+    /* Images with more raw pixel data than this are encoded in
+     * parallel bands with BandedPngOut instead of TinyPngOut. */
+    static constexpr uint64_t BANDED_MIN_SIZE = 16 << 20;
+
+    [[nodiscard]] static bool _usesBands(uint32_t pngWH);
+
+    /* exact PNG file size for an image of pngWH x pngWH pixels, with the hash chunk */
+    [[nodiscard]] uint64_t _pngSize(uint32_t pngWH) const;
+
+    /* returns how many pixels wide a module is, or 0 if the qr code
+     * doesn't fit in the image size or modules would be smaller
+     * than the minimum module pixel size. */
+    [[nodiscard]] int _pixelsPerModule(const qrcodegen::QrCode &qrData) const;
+
+    /* returns the width/height of the image based on the max image size
+    * and qr width. Ex. If the max img size is 90, the qr code size 29
+    * the qr module pixel size will be 3, the image size will be 3*29=87. */
+    [[nodiscard]] uint32_t _imgSize(const qrcodegen::QrCode &qrData) const;
+
+    [[nodiscard]] uint32_t _imgSizeWithBorder(const qrcodegen::QrCode &qrData) const;
+};
+
+#endif //QR_TO_PNG_H
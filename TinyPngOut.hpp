@@ -1,98 +1,176 @@
-/*
- * Tiny PNG Output (C++)
- *
- * Copyright (c) 2018 Project Nayuki
- * https://www.nayuki.io/page/tiny-png-output
- *
- * This program is free software: you can redistribute it and/or modify
- * it under the terms of the GNU Lesser General Public License as published by
- * the Free Software Foundation, either version 3 of the License, or
- * (at your option) any later version.
- *
- * This program is distributed in the hope that it will be useful,
- * but WITHOUT ANY WARRANTY; without even the implied warranty of
- * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- * GNU Lesser General Public License for more details.
- *
- * You should have received a copy of the GNU Lesser General Public License
- * along with this program (see COPYING.txt and COPYING.LESSER.txt).
- * If not, see <http://www.gnu.org/licenses/>.
- */
-
-#pragma once
-
-#include <cstddef>
-#include <cstdint>
-#include <ostream>
-
-
-/*
- * Takes image pixel data in raw RGB8.8.8 format and writes a PNG file to a byte output stream.
- */
-class TinyPngOut final {
-
-    /*---- Fields ----*/
-
-	// Immutable configuration
-	private: std::uint32_t width;   // Measured in pixels
-	private: std::uint32_t height;  // Measured in pixels
-	private: std::uint32_t lineSize;  // Measured in bytes, equal to (width * 3 + 1)
-
-	// Running state
-	private: std::ostream &output;
-	private: std::uint32_t positionX;      // Next byte index in current line
-	private: std::uint32_t positionY;      // Line index of next byte
-	private: std::uint32_t uncompRemain;   // Number of uncompressed bytes remaining
-	private: std::uint16_t deflateFilled;  // Bytes filled in the current block (0 <= n < DEFLATE_MAX_BLOCK_SIZE)
-	private: std::uint32_t crc;    // Primarily for IDAT chunk
-	private: std::uint32_t adler;  // For DEFLATE data within IDAT
-
-
-
-	/*---- Public constructor and method ----*/
-
-	/*
-	 * Creates a PNG writer with the given width and height (both non-zero) and byte output stream.
-	 * TinyPngOut will leave the output stream still open once it finishes writing the PNG file data.
-	 * Throws an exception if the dimensions exceed certain limits (e.g. w * h > 700 million).
-	 */
-	public: explicit TinyPngOut(std::uint32_t w, std::uint32_t h, std::ostream &out);
-
-
-	/*
-	 * Writes 'count' pixels from the given array to the output stream. This reads count*3
-	 * bytes from the array. Pixels are presented from top to bottom, left to right, and with
-	 * subpixels in RGB order. This object keeps track of how many pixels were written and
-	 * various position variables. It is an error to write more pixels in total than width*height.
-	 * Once exactly width*height pixels have been written with this TinyPngOut object,
-	 * there are no more valid operations on the object and it should be discarded.
-	 */
-	public: void write(const std::uint8_t pixels[], size_t count);
-
-
-
-	/*---- Private checksum methods ----*/
-
-	// Reads the 'crc' field and updates its value based on the given array of new data.
-	private: void crc32(const std::uint8_t data[], size_t len);
-
-
-	// Reads the 'adler' field and updates its value based on the given array of new data.
-	private: void adler32(const std::uint8_t data[], size_t len);
-
-
-
-	/*---- Private utility members ----*/
-
-	private: template <std::size_t N>
-	void write(const std::uint8_t (&data)[N]) {
-		output.write(reinterpret_cast<const char*>(data), sizeof(data));
-	}
-
-
-	private: static void putBigUint32(std::uint32_t val, std::uint8_t array[4]);
-
-
-	private: static constexpr std::uint16_t DEFLATE_MAX_BLOCK_SIZE = 65535;
-
-};
+/*
+ * Tiny PNG Output (C++)
+ *
+ * Copyright (c) 2018 Project Nayuki
+ * https://www.nayuki.io/page/tiny-png-output
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program (see COPYING.txt and COPYING.LESSER.txt).
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ByteSink.hpp"
+
+
+/*
+ * Takes image pixel data in raw RGB8.8.8 format and writes a PNG file to a byte output stream.
+ * Output is collected in an internal buffer and passed to the sink in BUFFER_SIZE chunks.
+ */
+class TinyPngOut final {
+
+    /*---- Fields ----*/
+
+	// Immutable configuration
+	private: std::uint32_t width;   // Measured in pixels
+	private: std::uint32_t height;  // Measured in pixels
+	private: std::uint32_t lineSize;  // Measured in bytes, equal to (width * 3 + 1)
+
+	// Output
+	private: std::unique_ptr<ByteSink> ownedSink;  // Only set when constructed from a std::ostream
+	private: ByteSink &output;
+	private: std::unique_ptr<std::uint8_t[]> buffer;  // BUFFER_SIZE bytes
+	private: std::size_t bufferFilled;
+
+	// Running state
+	private: std::uint32_t positionX;      // Next byte index in current line
+	private: std::uint32_t positionY;      // Line index of next byte
+	private: std::uint64_t uncompRemain;   // Number of uncompressed bytes remaining
+	private: std::uint16_t deflateFilled;  // Bytes filled in the current block (0 <= n < DEFLATE_MAX_BLOCK_SIZE)
+	private: std::uint64_t idatRemain;     // Number of zlib stream bytes remaining, across all IDAT chunks
+	private: std::uint32_t chunkRemain;    // Bytes left in the current IDAT chunk, 0 between chunks
+	private: bool idatStarted;     // Set once the zlib header is written, after which no tEXt chunks can be added
+	private: std::uint32_t crc;    // Primarily for IDAT chunks
+	private: std::uint32_t adler;  // For DEFLATE data within IDAT
+
+
+
+	/*---- Public constructor and method ----*/
+
+	/*
+	 * Creates a PNG writer with the given width and height (both non-zero) and byte output stream.
+	 * TinyPngOut will leave the output stream still open once it finishes writing the PNG file data.
+	 * The zlib stream is split into IDAT chunks of at most IDAT_MAX_SIZE bytes, so the image size
+	 * is only limited by the width: throws an exception if w * 3 + 1 does not fit in 32 bits.
+	 */
+	public: explicit TinyPngOut(std::uint32_t w, std::uint32_t h, std::ostream &out);
+
+
+	/*
+	 * Creates a PNG writer with the given width and height (both non-zero) and byte sink.
+	 * The sink must outlive this object; it receives the whole file in a few large writes.
+	 */
+	public: explicit TinyPngOut(std::uint32_t w, std::uint32_t h, ByteSink &out);
+
+
+	/*
+	 * Writes 'count' pixels from the given array to the output stream. This reads count*3
+	 * bytes from the array. Pixels are presented from top to bottom, left to right, and with
+	 * subpixels in RGB order. This object keeps track of how many pixels were written and
+	 * various position variables. It is an error to write more pixels in total than width*height.
+	 * Once exactly width*height pixels have been written with this TinyPngOut object,
+	 * there are no more valid operations on the object and it should be discarded.
+	 */
+	public: void write(const std::uint8_t pixels[], size_t count);
+
+
+	/*
+	 * Writes a tEXt chunk with the given keyword (1 to 79 bytes) and text, both without NUL bytes.
+	 * Must be called before the first pixel is written; text chunks precede the image data.
+	 */
+	public: void addText(const std::string &keyword, const std::string &text);
+
+
+	/*
+	 * Writes a pHYs chunk with the pixel density in pixels per metre, so that print and layout
+	 * programs place the image at its intended physical size. Must be called before the first
+	 * pixel is written, like addText(). Adds PHYS_CHUNK_SIZE bytes to the file.
+	 */
+	public: void addPhysicalSize(std::uint32_t pixelsPerMetre);
+
+
+	public: static constexpr std::uint64_t PHYS_CHUNK_SIZE = 21;
+
+
+	/*
+	 * Returns the exact size in bytes of the PNG file that a TinyPngOut object
+	 * with the given dimensions produces, so that callers can size buffers up front.
+	 * Text and pHYs chunks come on top of that, see textChunk() and PHYS_CHUNK_SIZE.
+	 * Throws the same exceptions as the constructor for invalid dimensions.
+	 */
+	public: static std::uint64_t encodedSize(std::uint32_t w, std::uint32_t h);
+
+
+	/*
+	 * Returns the complete tEXt chunk (length, type, data, CRC) for the given keyword and text.
+	 * Throws std::invalid_argument if the keyword is empty or too long, or either contains a NUL byte.
+	 */
+	public: static std::vector<std::uint8_t> textChunk(const std::string &keyword, const std::string &text);
+
+
+
+	/*---- Private checksum methods ----*/
+
+	// Reads the 'crc' field and updates its value based on the given array of new data.
+	private: void crc32(const std::uint8_t data[], size_t len);
+
+
+	// Reads the 'adler' field and updates its value based on the given array of new data.
+	private: void adler32(const std::uint8_t data[], size_t len);
+
+
+
+	/*---- Private utility members ----*/
+
+	private: void writeHeader();
+
+
+	private: template <std::size_t N>
+	void write(const std::uint8_t (&data)[N]) {
+		put(data, sizeof(data));
+	}
+
+
+	// Appends zlib stream bytes, starting and ending IDAT chunks as their precomputed lengths dictate.
+	private: void writeIdat(const std::uint8_t data[], std::size_t len);
+
+
+	// Appends bytes to the output buffer, handing full buffers to the sink.
+	private: void put(const std::uint8_t data[], std::size_t len);
+
+
+	// Hands whatever is buffered to the sink.
+	private: void flushBuffer();
+
+
+	// Returns the IDAT payload length (zlib stream) for the given amount of raw scanline data.
+	private: static std::uint64_t idatLength(std::uint64_t uncomp);
+
+
+	private: static void putBigUint32(std::uint32_t val, std::uint8_t array[4]);
+
+
+	private: static constexpr std::uint16_t DEFLATE_MAX_BLOCK_SIZE = 65535;
+
+	private: static constexpr std::size_t BUFFER_SIZE = 65536;
+
+	private: static constexpr std::uint32_t IDAT_MAX_SIZE = 1 << 20;
+
+};
@@ -1,583 +1,903 @@
-// main.cpp
-// Compile with (MSYS2 / MinGW64):
-// g++ main.cpp QrCode.cpp -o qr_gui `pkg-config --cflags --libs gtkmm-4.0 cairomm-1.0 gdk-pixbuf-2.0` -std=c++17
-
-#include <gtkmm.h>
-#include <cairomm/cairomm.h>
-#include <gdkmm/pixbuf.h>
-#include <gdkmm/general.h>
-
-#include <gdk/gdkcairo.h>   // gdk_cairo_set_source_pixbuf
-#include <cairo/cairo.h>
-
-#include <string>
-#include <sstream>
-#include <iostream>
-#include <cmath>
-
-#include "QrCode.hpp" // Nayuki QrCode.hpp / QrCode.cpp
-
-using qrcodegen::QrCode;
-
-#ifndef M_PI
-constexpr double M_PI = 3.14159265358979323846;
-#endif
-
-class QRWindow : public Gtk::Window {
-public:
-    QRWindow() {
-        set_title("QR Code Generator - GTKmm 4");
-        set_default_size(700, 920);
-        set_resizable(true);
-
-        container.set_margin(10);
-        container.set_spacing(8);
-        set_child(container);
-
-        // Mode selector
-        mode_combo.append("Text / URL");
-        mode_combo.append("Wi-Fi");
-        mode_combo.append("vCard");
-        mode_combo.append("Image URL");
-        mode_combo.append("Location");
-        mode_combo.set_active_text("Text / URL");
-        mode_combo.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::on_mode_changed));
-        container.append(mode_combo);
-
-        // Generic text entry (live)
-        entry.set_placeholder_text("Enter text or URL...");
-        entry.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-        container.append(entry);
-
-        // Wi-Fi inputs (live)
-        wifi_box.set_orientation(Gtk::Orientation::VERTICAL);
-        wifi_ssid.set_placeholder_text("SSID (network name)");
-        wifi_ssid.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-        wifi_pass.set_placeholder_text("Password");
-        wifi_pass.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-        wifi_enc.append("WPA/WPA2"); wifi_enc.append("WEP"); wifi_enc.append("None");
-        wifi_enc.set_active_text("WPA/WPA2");
-        wifi_enc.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-        wifi_box.append(wifi_ssid);
-        wifi_box.append(wifi_pass);
-        wifi_box.append(wifi_enc);
-        wifi_box.set_visible(false);
-        container.append(wifi_box);
-
-        // vCard inputs (live)
-        vcard_box.set_orientation(Gtk::Orientation::VERTICAL);
-        vcard_name.set_placeholder_text("Full name (FN)");
-        vcard_name.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-        vcard_tel.set_placeholder_text("Phone");
-        vcard_tel.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-        vcard_email.set_placeholder_text("Email");
-        vcard_email.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-        vcard_box.append(vcard_name);
-        vcard_box.append(vcard_tel);
-        vcard_box.append(vcard_email);
-        vcard_box.set_visible(false);
-        container.append(vcard_box);
-
-        // Location inputs (live)
-        location_box.set_orientation(Gtk::Orientation::VERTICAL);
-        location_lat.set_placeholder_text("Latitude (e.g. -6.200000)");
-        location_lat.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-        location_lon.set_placeholder_text("Longitude (e.g. 106.816666)");
-        location_lon.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-        location_box.append(location_lat);
-        location_box.append(location_lon);
-        location_box.set_visible(false);
-        container.append(location_box);
-
-        // Color & shape (live)
-        container.append(*Gtk::make_managed<Gtk::Label>("Module Color:"));
-        color_button.set_rgba(Gdk::RGBA("black"));
-        color_button.signal_color_set().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-        container.append(color_button);
-
-        container.append(*Gtk::make_managed<Gtk::Label>("Module Shape:"));
-        shape_combo.append("Square"); shape_combo.append("Circle"); shape_combo.append("Rounded");
-        shape_combo.set_active_text("Square");
-        shape_combo.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-        container.append(shape_combo);
-
-        // Logo controls
-        logo_btn.set_label("Select Logo...");
-        logo_btn.signal_clicked().connect(sigc::mem_fun(*this, &QRWindow::on_select_logo));
-        container.append(logo_btn);
-
-        logo_enable.set_label("Enable Logo");
-        logo_enable.signal_toggled().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-        container.append(logo_enable);
-
-        logo_size_adjustment = Gtk::Adjustment::create(25.0, 5.0, 60.0, 1.0, 5.0);
-        logo_size_spin.set_adjustment(logo_size_adjustment);
-        logo_size_spin.set_digits(0);
-        logo_size_spin.signal_value_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
-
-        auto logo_row = Gtk::Box(Gtk::Orientation::HORIZONTAL);
-        logo_row.set_spacing(6);
-        logo_row.append(*Gtk::make_managed<Gtk::Label>("Logo size (%):"));
-        logo_row.append(logo_size_spin);
-        container.append(logo_row);
-
-        // Save button
-        btn_save.set_label("Save as PNG");
-        btn_save.signal_clicked().connect(sigc::mem_fun(*this, &QRWindow::on_save_png));
-        container.append(btn_save);
-
-        // Drawing area (flexible)
-        drawing.set_hexpand(true);
-        drawing.set_vexpand(true);
-        drawing.set_draw_func(sigc::mem_fun(*this, &QRWindow::on_draw));
-        container.append(drawing);
-
-        // defaults
-        last_content = "https://raymii.org";
-        qr = QrCode::encodeText(last_content.c_str(), QrCode::Ecc::MEDIUM);
-    }
-
-private:
-    // UI widgets
-    Gtk::Box container{Gtk::Orientation::VERTICAL};
-    Gtk::ComboBoxText mode_combo;
-    Gtk::Entry entry;
-
-    Gtk::Box wifi_box{Gtk::Orientation::VERTICAL};
-    Gtk::Entry wifi_ssid, wifi_pass;
-    Gtk::ComboBoxText wifi_enc;
-
-    Gtk::Box vcard_box{Gtk::Orientation::VERTICAL};
-    Gtk::Entry vcard_name, vcard_tel, vcard_email;
-
-    Gtk::Box location_box{Gtk::Orientation::VERTICAL};
-    Gtk::Entry location_lat, location_lon;
-
-    Gtk::ColorButton color_button;
-    Gtk::ComboBoxText shape_combo;
-
-    Gtk::Button logo_btn, btn_save;
-    Gtk::CheckButton logo_enable;
-    Glib::RefPtr<Gtk::Adjustment> logo_size_adjustment;
-    Gtk::SpinButton logo_size_spin;
-    Glib::RefPtr<Gdk::Pixbuf> logo_pixbuf;
-
-    Gtk::DrawingArea drawing;
-
-    // QR state
-    QrCode qr = QrCode::encodeText(" ", QrCode::Ecc::LOW);
-    std::string last_content;
-
-    // --- helpers ---
-    static std::string escape_semicolons(const std::string &s) {
-        std::string out; out.reserve(s.size()*2);
-        for (char c : s) {
-            if (c == '\\' || c == ';' || c == ',') { out.push_back('\\'); out.push_back(c); }
-            else out.push_back(c);
-        }
-        return out;
-    }
-    static std::string escape_vcard(const std::string &s) {
-        std::string out; out.reserve(s.size());
-        for (char c : s) {
-            if (c == '\n') out += "\\n"; else out.push_back(c);
-        }
-        return out;
-    }
-
-    // Build content string from current inputs
-    std::string build_content_from_inputs() {
-        auto mode = mode_combo.get_active_text();
-        if (mode == "Text / URL") {
-            return entry.get_text();
-        } else if (mode == "Wi-Fi") {
-            std::string ssid = wifi_ssid.get_text();
-            if (ssid.empty()) return std::string();
-            std::string pass = wifi_pass.get_text();
-            std::string enc = wifi_enc.get_active_text();
-            std::ostringstream ss;
-            if (enc == "None") ss << "WIFI:T:nopass;S:" << escape_semicolons(ssid) << ";;";
-            else ss << "WIFI:T:" << enc << ";S:" << escape_semicolons(ssid) << ";P:" << escape_semicolons(pass) << ";;";
-            return ss.str();
-        } else if (mode == "vCard") {
-            std::string name = vcard_name.get_text();
-            if (name.empty()) return std::string();
-            std::ostringstream ss;
-            ss << "BEGIN:VCARD\nVERSION:3.0\nFN:" << escape_vcard(name) << "\n";
-            if (!vcard_tel.get_text().empty()) ss << "TEL:" << escape_vcard(vcard_tel.get_text()) << "\n";
-            if (!vcard_email.get_text().empty()) ss << "EMAIL:" << escape_vcard(vcard_email.get_text()) << "\n";
-            ss << "END:VCARD";
-            return ss.str();
-        } else if (mode == "Location") {
-            std::string lat = location_lat.get_text();
-            std::string lon = location_lon.get_text();
-            if (lat.empty() || lon.empty()) return std::string();
-            return "https://www.google.com/maps?q=" + lat + "," + lon;
-        } else if (mode == "Image URL") {
-            return entry.get_text();
-        }
-        return std::string();
-    }
-
-    // --- NEW: update_qr (live preview) ---
-    void update_qr() {
-        try {
-            std::string content = build_content_from_inputs();
-            if (content.empty()) {
-                // keep previous QR if inputs incomplete, but you can also choose to clear
-                return;
-            }
-            last_content = content;
-            qr = QrCode::encodeText(last_content.c_str(), QrCode::Ecc::MEDIUM);
-            drawing.queue_draw();
-        } catch (const std::exception &ex) {
-            // don't crash preview on invalid input; show in console
-            std::cerr << "QR encode error: " << ex.what() << std::endl;
-        }
-    }
-
-    // mode changed -> show/hide inputs and update preview
-    void on_mode_changed() {
-        std::string mode = mode_combo.get_active_text();
-        entry.set_visible(mode == "Text / URL" || mode == "Image URL");
-        wifi_box.set_visible(mode == "Wi-Fi");
-        vcard_box.set_visible(mode == "vCard");
-        location_box.set_visible(mode == "Location");
-        update_qr();
-    }
-
-    // select logo (async dialog)
-    void on_select_logo() {
-        auto *dialog = new Gtk::FileChooserDialog("Select Logo", Gtk::FileChooser::Action::OPEN);
-        dialog->set_transient_for(*this);
-        dialog->add_button("_Cancel", Gtk::ResponseType::CANCEL);
-        dialog->add_button("_Open", Gtk::ResponseType::OK);
-
-        auto filter = Gtk::FileFilter::create();
-        filter->set_name("Images");
-        filter->add_mime_type("image/png");
-        filter->add_mime_type("image/jpeg");
-        filter->add_mime_type("image/webp");
-        dialog->add_filter(filter);
-
-        dialog->signal_response().connect([this, dialog](int response){
-            if (response == Gtk::ResponseType::OK) {
-                auto file = dialog->get_file();
-                if (file) {
-                    try {
-                        logo_pixbuf = Gdk::Pixbuf::create_from_file(file->get_path());
-                        logo_enable.set_active(true);
-                        update_qr();
-                        show_info("Logo selected", file->get_path());
-                    } catch (const Glib::FileError& e) {
-                        show_error(std::string("File error: ") + e.what());
-                    } catch (const Gdk::PixbufError& e) {
-                        show_error(std::string("Pixbuf error: ") + e.what());
-                    }
-                }
-            }
-            delete dialog;
-        });
-        dialog->show();
-    }
-
-    // drawing callback (preview)
-    void on_draw(const Cairo::RefPtr<Cairo::Context>& cr, int width, int height) {
-        // reuse a drawing routine that keeps QR square and centers it
-        draw_qr(cr, width, height);
-    }
-
-    void draw_qr(const Cairo::RefPtr<Cairo::Context>& cr, int width, int height) {
-        int modules = qr.getSize();
-        if (modules <= 0) return;
-
-        // constants
-        const int border_modules = 4;
-        const double frame_thickness = std::max(8.0, std::min(width, height) * 0.03);
-        const double label_height = std::max(28.0, std::min(width, height) * 0.08);
-
-        double side = std::min(width, height) - 2.0 * frame_thickness - label_height;
-        if (side <= 0) side = std::min(width, height) - 2.0 * frame_thickness;
-        double pixelsPerModule = std::floor(side / (modules + 2*border_modules));
-        if (pixelsPerModule < 1.0) pixelsPerModule = 1.0;
-
-        double qrPixelSize = (modules + 2*border_modules) * pixelsPerModule;
-        double outWidth = qrPixelSize + 2.0 * frame_thickness;
-        double outHeight = outWidth + label_height;
-        double offsetX = (width - outWidth) / 2.0;
-        double offsetY = (height - outHeight) / 2.0;
-
-        // clear
-        cr->set_source_rgb(1.0, 1.0, 1.0);
-        cr->paint();
-
-        // frame
-        cr->set_source_rgb(0.0, 0.0, 0.0);
-        cr->rectangle(offsetX, offsetY, outWidth, outWidth);
-        cr->fill();
-
-        // inner
-        double innerX = offsetX + frame_thickness;
-        double innerY = offsetY + frame_thickness;
-        cr->set_source_rgb(1.0, 1.0, 1.0);
-        cr->rectangle(innerX, innerY, qrPixelSize, qrPixelSize);
-        cr->fill();
-
-        // draw modules
-        Gdk::RGBA rgba = color_button.get_rgba();
-        cr->set_source_rgb(rgba.get_red(), rgba.get_green(), rgba.get_blue());
-        std::string shape = shape_combo.get_active_text();
-        double startX = innerX + border_modules * pixelsPerModule;
-        double startY = innerY + border_modules * pixelsPerModule;
-
-        cr->set_antialias(Cairo::Antialias::ANTIALIAS_NONE);
-
-        for (int y = 0; y < modules; ++y) {
-            for (int x = 0; x < modules; ++x) {
-                if (!qr.getModule(x, y)) continue;
-                double rx = startX + x * pixelsPerModule;
-                double ry = startY + y * pixelsPerModule;
-                if (shape == "Square") {
-                    cr->rectangle(rx, ry, pixelsPerModule, pixelsPerModule);
-                    cr->fill();
-                } else if (shape == "Circle") {
-                    cr->arc(rx + pixelsPerModule/2.0, ry + pixelsPerModule/2.0, pixelsPerModule/2.0, 0.0, 2.0*M_PI);
-                    cr->fill();
-                } else { // Rounded
-                    double r = std::max(1.0, pixelsPerModule * 0.25);
-                    double x0 = rx, y0 = ry, x1 = rx + pixelsPerModule, y1 = ry + pixelsPerModule;
-                    cr->begin_new_sub_path();
-                    cr->arc(x1 - r, y0 + r, r, -M_PI/2.0, 0.0);
-                    cr->arc(x1 - r, y1 - r, r, 0.0, M_PI/2.0);
-                    cr->arc(x0 + r, y1 - r, r, M_PI/2.0, M_PI);
-                    cr->arc(x0 + r, y0 + r, r, M_PI, 3.0*M_PI/2.0);
-                    cr->close_path();
-                    cr->fill();
-                }
-            }
-        }
-
-        // logo (proportional)
-        if (logo_enable.get_active() && logo_pixbuf) {
-            double pct = logo_size_adjustment->get_value() / 100.0;
-            double logo_max = qrPixelSize * pct;
-            int orig_w = logo_pixbuf->get_width();
-            int orig_h = logo_pixbuf->get_height();
-            if (orig_w > 0 && orig_h > 0) {
-                double scale_logo = std::min(logo_max / orig_w, logo_max / orig_h);
-                int new_w = std::max(1, int(orig_w * scale_logo + 0.5));
-                int new_h = std::max(1, int(orig_h * scale_logo + 0.5));
-                double lx = innerX + (qrPixelSize - new_w) / 2.0;
-                double ly = innerY + (qrPixelSize - new_h) / 2.0;
-
-                // white pad
-                double pad = std::max(2.0, std::min(new_w, new_h) * 0.06);
-                cr->set_source_rgb(1.0, 1.0, 1.0);
-                cr->rectangle(lx - pad, ly - pad, new_w + 2*pad, new_h + 2*pad);
-                cr->fill();
-
-                // scale & paint via C API (robust)
-                auto scaled = logo_pixbuf->scale_simple(new_w, new_h, Gdk::InterpType::BILINEAR);
-                if (scaled) {
-                    cairo_t* c = cr->cobj();
-                    gdk_cairo_set_source_pixbuf(c, scaled->gobj(), lx, ly);
-                    cairo_paint(c);
-                }
-            }
-        }
-
-        // label bar bottom
-        double labelX = offsetX;
-        double labelY = offsetY + outWidth;
-        cr->set_source_rgb(0.0, 0.0, 0.0);
-        cr->rectangle(labelX, labelY, outWidth, label_height);
-        cr->fill();
-
-        // "SCAN ME" centered white
-        cairo_t* c = cr->cobj();
-        if (c) {
-            cairo_select_font_face(c, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-            double fsize = std::max(12.0, label_height * 0.45);
-            cairo_set_font_size(c, fsize);
-            const char* txt = "SCAN ME";
-            cairo_text_extents_t te;
-            cairo_text_extents(c, txt, &te);
-            double tx = offsetX + (outWidth - te.width) / 2.0 - te.x_bearing;
-            double ty = labelY + (label_height - te.height) / 2.0 - te.y_bearing;
-            cairo_set_source_rgb(c, 1.0, 1.0, 1.0);
-            cairo_move_to(c, tx, ty);
-            cairo_show_text(c, txt);
-        }
-    }
-
-    // --- save PNG ---
-    void on_save_png() {
-        // ensure we have content
-        if (qr.getSize() <= 0) {
-            show_error("No QR to save.");
-            return;
-        }
-
-        auto *dialog = new Gtk::FileChooserDialog("Save QR Code as PNG", Gtk::FileChooser::Action::SAVE);
-        dialog->set_transient_for(*this);
-        dialog->add_button("_Cancel", Gtk::ResponseType::CANCEL);
-        dialog->add_button("_Save", Gtk::ResponseType::OK);
-
-        auto filter = Gtk::FileFilter::create();
-        filter->set_name("PNG images");
-        filter->add_pattern("*.png");
-        dialog->add_filter(filter);
-
-        dialog->signal_response().connect([this, dialog](int response){
-            if (response == Gtk::ResponseType::OK) {
-                auto file = dialog->get_file();
-                if (file) {
-                    std::string path = file->get_path();
-                    if (path.size() < 4 || path.substr(path.size()-4) != ".png") path += ".png";
-                    try {
-                        write_png_with_cairo(path);
-                        show_info("Saved", "QR image saved successfully.");
-                    } catch (const std::exception &e) {
-                        show_error(std::string("Failed to save PNG: ") + e.what());
-                    }
-                }
-            }
-            delete dialog;
-        });
-        dialog->show();
-    }
-
-    void write_png_with_cairo(const std::string &filename) {
-        int modules = qr.getSize();
-        if (modules <= 0) throw std::runtime_error("No QR code generated.");
-
-        const int border_modules = 4;
-        const int frame_thickness = 20;
-        const int label_height = 60;
-        const int module_pixel = 10;
-
-        int qrPixelSize = (modules + 2*border_modules) * module_pixel;
-        int outWidth = qrPixelSize + 2*frame_thickness;
-        int outHeight = outWidth + label_height;
-
-        cairo_surface_t* surf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, outWidth, outHeight);
-        if (!surf) throw std::runtime_error("Failed to create surface");
-        cairo_t* cr = cairo_create(surf);
-        if (!cr) { cairo_surface_destroy(surf); throw std::runtime_error("Failed to create context"); }
-
-        cairo_set_antialias(cr, CAIRO_ANTIALIAS_NONE);
-        cairo_set_source_rgb(cr, 1,1,1); cairo_paint(cr);
-
-        // frame
-        cairo_set_source_rgb(cr, 0,0,0);
-        cairo_rectangle(cr, 0, 0, outWidth, outWidth);
-        cairo_fill(cr);
-
-        // inner white
-        cairo_set_source_rgb(cr, 1,1,1);
-        cairo_rectangle(cr, frame_thickness, frame_thickness, qrPixelSize, qrPixelSize);
-        cairo_fill(cr);
-
-        // modules color/shape
-        Gdk::RGBA rgba = color_button.get_rgba();
-        cairo_set_source_rgb(cr, rgba.get_red(), rgba.get_green(), rgba.get_blue());
-        std::string shape = shape_combo.get_active_text();
-        int startX = frame_thickness + border_modules * module_pixel;
-        int startY = frame_thickness + border_modules * module_pixel;
-
-        for (int y = 0; y < modules; ++y) {
-            for (int x = 0; x < modules; ++x) {
-                if (!qr.getModule(x, y)) continue;
-                int rx = startX + x * module_pixel;
-                int ry = startY + y * module_pixel;
-                if (shape == "Square") {
-                    cairo_rectangle(cr, rx, ry, module_pixel, module_pixel);
-                    cairo_fill(cr);
-                } else if (shape == "Circle") {
-                    cairo_arc(cr, rx + module_pixel/2.0, ry + module_pixel/2.0, module_pixel/2.0, 0, 2*M_PI);
-                    cairo_fill(cr);
-                } else {
-                    double r = std::max(1.0, module_pixel * 0.25);
-                    double x0 = rx, y0 = ry, x1 = rx + module_pixel, y1 = ry + module_pixel;
-                    cairo_new_sub_path(cr);
-                    cairo_arc(cr, x1 - r, y0 + r, r, -M_PI/2.0, 0.0);
-                    cairo_arc(cr, x1 - r, y1 - r, r, 0.0, M_PI/2.0);
-                    cairo_arc(cr, x0 + r, y1 - r, r, M_PI/2.0, M_PI);
-                    cairo_arc(cr, x0 + r, y0 + r, r, M_PI, 3.0*M_PI/2.0);
-                    cairo_close_path(cr);
-                    cairo_fill(cr);
-                }
-            }
-        }
-
-        // logo (proportional)
-        if (logo_enable.get_active() && logo_pixbuf) {
-            double logo_percent = logo_size_adjustment->get_value() / 100.0;
-            int logo_max_side = std::max(1, int(qrPixelSize * logo_percent + 0.5));
-            int orig_w = logo_pixbuf->get_width();
-            int orig_h = logo_pixbuf->get_height();
-            if (orig_w > 0 && orig_h > 0) {
-                double scale = std::min((double)logo_max_side / orig_w, (double)logo_max_side / orig_h);
-                int new_w = std::max(1, int(orig_w * scale + 0.5));
-                int new_h = std::max(1, int(orig_h * scale + 0.5));
-                double lx = frame_thickness + (qrPixelSize - new_w) / 2.0;
-                double ly = frame_thickness + (qrPixelSize - new_h) / 2.0;
-
-                double pad = std::max(2.0, std::min(new_w, new_h) * 0.06);
-                cairo_set_source_rgb(cr, 1,1,1);
-                cairo_rectangle(cr, lx - pad, ly - pad, new_w + 2*pad, new_h + 2*pad);
-                cairo_fill(cr);
-
-                auto scaled = logo_pixbuf->scale_simple(new_w, new_h, Gdk::InterpType::BILINEAR);
-                if (scaled) {
-                    gdk_cairo_set_source_pixbuf(cr, scaled->gobj(), lx, ly);
-                    cairo_paint(cr);
-                }
-            }
-        }
-
-        // label bar
-        cairo_set_source_rgb(cr, 0,0,0);
-        cairo_rectangle(cr, 0, outWidth, outWidth, label_height);
-        cairo_fill(cr);
-
-        // "SCAN ME"
-        cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_BOLD);
-        double font_size = std::max(12.0, label_height * 0.45);
-        cairo_set_font_size(cr, font_size);
-        const char* text = "SCAN ME";
-        cairo_text_extents_t te;
-        cairo_text_extents(cr, text, &te);
-        double tx = (outWidth - te.width) / 2.0 - te.x_bearing;
-        double ty = outWidth + (label_height - te.height) / 2.0 - te.y_bearing;
-        cairo_set_source_rgb(cr, 1,1,1);
-        cairo_move_to(cr, tx, ty);
-        cairo_show_text(cr, text);
-
-        // write and cleanup
-        cairo_surface_write_to_png(surf, filename.c_str());
-        cairo_destroy(cr);
-        cairo_surface_destroy(surf);
-    }
-
-    // dialogs
-    void show_error(const std::string &msg) {
-        auto *d = new Gtk::MessageDialog(*this, "Error", false, Gtk::MessageType::ERROR);
-        d->set_secondary_text(msg);
-        d->add_button("OK", Gtk::ResponseType::OK);
-        d->signal_response().connect([d](int){ delete d; });
-        d->show();
-    }
-    void show_info(const std::string &title, const std::string &msg) {
-        auto *d = new Gtk::MessageDialog(*this, title, false, Gtk::MessageType::INFO);
-        d->set_secondary_text(msg);
-        d->add_button("OK", Gtk::ResponseType::OK);
-        d->signal_response().connect([d](int){ delete d; });
-        d->show();
-    }
-};
-
-int main(int argc, char *argv[]) {
-    auto app = Gtk::Application::create("org.example.qrgtkmm");
-    return app->make_window_and_run<QRWindow>(argc, argv);
-}
+// main.cpp
+// Compile with (MSYS2 / MinGW64):
+// g++ main.cpp QrAsync.cpp AsyncFileWriter.cpp IoUring.cpp QrRender.cpp QrToPng.cpp AtomicFile.cpp ContentHash.cpp TinyPngOut.cpp
+//     BandedPngOut.cpp ByteSink.cpp PngChecksum.cpp QrCode.cpp QrContent.cpp QrOutline.cpp ModuleSprite.cpp QrRaster.cpp
+//     LogoCache.cpp -o qr_gui
+//     `pkg-config --cflags --libs gtkmm-4.0 cairomm-1.0 gdk-pixbuf-2.0` -std=c++20 -pthread
+// (with -std=c++17 saving blocks the window while the PNG is written)
+
+#include <gtkmm.h>
+#include <cairomm/cairomm.h>
+#include <gdkmm/pixbuf.h>
+#include <gdkmm/general.h>
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <optional>
+#include <functional>
+#include <filesystem>
+#include <cstdio>
+
+#include "QrCode.hpp" // Nayuki QrCode.hpp / QrCode.cpp
+#include "QrContent.hpp"
+#include "QrRaster.hpp"
+#include "LogoCache.hpp"
+#include "ByteSink.hpp"
+#include "TinyPngOut.hpp"
+#include "QrAsync.hpp"
+
+using qrcodegen::QrCode;
+
+#if defined(__cpp_impl_coroutine)
+// co_await ResumeOnMainLoop{} continues a coroutine on the GTK thread
+struct ResumeOnMainLoop {
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) const {
+        Glib::MainContext::get_default()->invoke([handle]() { handle.resume(); return false; });
+    }
+    void await_resume() const noexcept {}
+};
+#endif
+
+// The export and the preview are drawn by the same QrRaster, with their own pixel sizes.
+static QrRaster::Style raster_style(uint32_t color, QrRaster::Shape shape, double logo_percent,
+                                    int module_pixels, int frame, int label) {
+    QrRaster::Style style;
+    style.modulePixels = module_pixels;
+    style.border = 4;
+    style.frame = frame;
+    style.label = label;
+    style.color = color;
+    style.shape = shape;
+    style.logoPercent = logo_percent;
+    return style;
+}
+
+// The export keeps its proportions at any module size: a frame of 2 and a label bar of 6 modules.
+static QrRaster::Style export_style(uint32_t color, QrRaster::Shape shape, double logo_percent,
+                                    int module_pixels, int dpi) {
+    QrRaster::Style style = raster_style(color, shape, logo_percent, module_pixels, 2 * module_pixels,
+                                         6 * module_pixels);
+    style.dpi = dpi;
+    return style;
+}
+
+// hands @logo (proportional) to @raster at the size it asks for, scaled once from the master and cached.
+// Past the master's resolution scaling adds no detail, so a larger logo (a print export) is cached at
+// most MAX_MASTER_SIDE pixels wide and scaled up by the raster while it renders.
+static void set_raster_logo(QrRaster &raster, const LogoCache &logo) {
+    auto [new_w, new_h] = raster.logoSize(logo.width(), logo.height());
+    double shrink = std::min(1.0, double(LogoCache::MAX_MASTER_SIDE) / std::max(new_w, new_h));
+    auto scaled = logo.scaled(int(std::lround(new_w * shrink)), int(std::lround(new_h * shrink)),
+                              LogoCache::Filter::Bilinear);
+    raster.setLogo(scaled->pixels.data(), scaled->width, scaled->height, scaled->width, new_w, new_h);
+}
+
+// passes bytes on to @out and counts them, so an export can tell how much of the file is written
+class CountingSink final : public ByteSink {
+public:
+    explicit CountingSink(ByteSink &out) : out(out) {}
+    void write(const std::uint8_t data[], std::size_t len) override { out.write(data, len); count += len; }
+    void flush() override { out.flush(); }
+    uint64_t count = 0;
+private:
+    ByteSink &out;
+};
+
+// 0xRRGGBB
+static uint32_t rgb_of(const Gdk::RGBA &rgba) {
+    return uint32_t(std::lround(rgba.get_red() * 255)) << 16 |
+           uint32_t(std::lround(rgba.get_green() * 255)) << 8 |
+           uint32_t(std::lround(rgba.get_blue() * 255));
+}
+
+class QRWindow : public Gtk::Window {
+public:
+    QRWindow() {
+        set_title("QR Code Generator - GTKmm 4");
+        set_default_size(700, 920);
+        set_resizable(true);
+
+        container.set_margin(10);
+        container.set_spacing(8);
+        set_child(container);
+
+        // Mode selector
+        mode_combo.append("Text / URL");
+        mode_combo.append("Wi-Fi");
+        mode_combo.append("vCard");
+        mode_combo.append("Image URL");
+        mode_combo.append("Location");
+        mode_combo.set_active_text("Text / URL");
+        mode_combo.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::on_mode_changed));
+        container.append(mode_combo);
+
+        // Generic text entry (live)
+        entry.set_placeholder_text("Enter text or URL...");
+        entry.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
+        container.append(entry);
+
+        // Wi-Fi inputs (live)
+        wifi_box.set_orientation(Gtk::Orientation::VERTICAL);
+        wifi_ssid.set_placeholder_text("SSID (network name)");
+        wifi_ssid.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
+        wifi_pass.set_placeholder_text("Password");
+        wifi_pass.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
+        wifi_enc.append("WPA/WPA2"); wifi_enc.append("WEP"); wifi_enc.append("None");
+        wifi_enc.set_active_text("WPA/WPA2");
+        wifi_enc.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
+        wifi_box.append(wifi_ssid);
+        wifi_box.append(wifi_pass);
+        wifi_box.append(wifi_enc);
+        wifi_box.set_visible(false);
+        container.append(wifi_box);
+
+        // vCard inputs (live)
+        vcard_box.set_orientation(Gtk::Orientation::VERTICAL);
+        vcard_name.set_placeholder_text("Full name (FN)");
+        vcard_name.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
+        vcard_tel.set_placeholder_text("Phone");
+        vcard_tel.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
+        vcard_email.set_placeholder_text("Email");
+        vcard_email.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
+        vcard_box.append(vcard_name);
+        vcard_box.append(vcard_tel);
+        vcard_box.append(vcard_email);
+        vcard_box.set_visible(false);
+        container.append(vcard_box);
+
+        // Location inputs (live)
+        location_box.set_orientation(Gtk::Orientation::VERTICAL);
+        location_lat.set_placeholder_text("Latitude (e.g. -6.200000)");
+        location_lat.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
+        location_lon.set_placeholder_text("Longitude (e.g. 106.816666)");
+        location_lon.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::update_qr));
+        location_box.append(location_lat);
+        location_box.append(location_lon);
+        location_box.set_visible(false);
+        container.append(location_box);
+
+        // Color & shape (live)
+        container.append(*Gtk::make_managed<Gtk::Label>("Module Color:"));
+        color_button.set_rgba(Gdk::RGBA("black"));
+        color_button.signal_color_set().connect(sigc::mem_fun(*this, &QRWindow::on_style_changed));
+        container.append(color_button);
+
+        container.append(*Gtk::make_managed<Gtk::Label>("Module Shape:"));
+        shape_combo.append("Square"); shape_combo.append("Circle"); shape_combo.append("Rounded");
+        shape_combo.set_active_text("Square");
+        shape_combo.signal_changed().connect(sigc::mem_fun(*this, &QRWindow::on_style_changed));
+        container.append(shape_combo);
+
+        // Logo controls
+        logo_btn.set_label("Select Logo...");
+        logo_btn.signal_clicked().connect(sigc::mem_fun(*this, &QRWindow::on_select_logo));
+        container.append(logo_btn);
+
+        logo_progress.set_show_text(true);
+        logo_progress.set_visible(false);
+        container.append(logo_progress);
+        logo_progress_dispatcher.connect(sigc::mem_fun(*this, &QRWindow::on_logo_progress));
+        logo_done_dispatcher.connect(sigc::mem_fun(*this, &QRWindow::on_logo_loaded));
+
+        logo_enable.set_label("Enable Logo");
+        logo_enable.signal_toggled().connect(sigc::mem_fun(*this, &QRWindow::on_style_changed));
+        container.append(logo_enable);
+
+        logo_size_adjustment = Gtk::Adjustment::create(25.0, 5.0, 60.0, 1.0, 5.0);
+        logo_size_spin.set_adjustment(logo_size_adjustment);
+        logo_size_spin.set_digits(0);
+        logo_size_spin.signal_value_changed().connect(sigc::mem_fun(*this, &QRWindow::on_style_changed));
+
+        auto logo_row = Gtk::Box(Gtk::Orientation::HORIZONTAL);
+        logo_row.set_spacing(6);
+        logo_row.append(*Gtk::make_managed<Gtk::Label>("Logo size (%):"));
+        logo_row.append(logo_size_spin);
+        container.append(logo_row);
+
+        // export size: pixels per module (frame and label follow) and the DPI recorded in the file
+        export_module_adjustment = Gtk::Adjustment::create(10.0, 1.0, 1000.0, 1.0, 10.0);
+        export_module_spin.set_adjustment(export_module_adjustment);
+        export_module_spin.set_digits(0);
+        export_module_spin.signal_value_changed().connect(sigc::mem_fun(*this, &QRWindow::update_export_size));
+        export_dpi_adjustment = Gtk::Adjustment::create(300.0, 72.0, 2400.0, 1.0, 100.0);
+        export_dpi_spin.set_adjustment(export_dpi_adjustment);
+        export_dpi_spin.set_digits(0);
+        export_dpi_spin.signal_value_changed().connect(sigc::mem_fun(*this, &QRWindow::update_export_size));
+
+        auto *export_size_row = Gtk::make_managed<Gtk::Box>(Gtk::Orientation::HORIZONTAL);
+        export_size_row->set_spacing(6);
+        export_size_row->append(*Gtk::make_managed<Gtk::Label>("Export module size (px):"));
+        export_size_row->append(export_module_spin);
+        export_size_row->append(*Gtk::make_managed<Gtk::Label>("DPI:"));
+        export_size_row->append(export_dpi_spin);
+        container.append(*export_size_row);
+        container.append(export_size_label);
+
+        // Save button
+        btn_save.set_label("Save as PNG");
+        btn_save.signal_clicked().connect(sigc::mem_fun(*this, &QRWindow::on_save_png));
+        container.append(btn_save);
+
+        // export progress, shown while a PNG is written
+        export_progress.set_show_text(true);
+        export_progress.set_hexpand(true);
+        btn_cancel_export.set_label("Cancel");
+        btn_cancel_export.signal_clicked().connect([this]() { export_cancel = true; });
+        export_row.append(export_progress);
+        export_row.append(btn_cancel_export);
+        export_row.set_visible(false);
+        container.append(export_row);
+#if defined(__cpp_impl_coroutine)
+        export_dispatcher.connect(sigc::mem_fun(*this, &QRWindow::on_export_progress));
+#endif
+
+        // Drawing area (flexible)
+        drawing.set_hexpand(true);
+        drawing.set_vexpand(true);
+        drawing.set_draw_func(sigc::mem_fun(*this, &QRWindow::on_draw));
+        container.append(drawing);
+
+        // defaults
+        last_content = "https://raymii.org";
+        requested_content = last_content;
+        qr = QrCode::encodeText(last_content.c_str(), QrCode::Ecc::MEDIUM);
+        update_export_size();
+
+        encode_dispatcher.connect(sigc::mem_fun(*this, &QRWindow::on_encoded));
+        encode_thread = std::thread([this]() { encode_loop(); });
+    }
+
+    ~QRWindow() override {
+        {
+            std::lock_guard<std::mutex> lock(encode_mutex);
+            encode_stop = true;
+        }
+        encode_wakeup.notify_one();
+        encode_thread.join();
+        stop_logo_load();
+#if defined(__cpp_impl_coroutine)
+        // an export still writing uses the pool below; stop it at its next band
+        export_cancel = true;
+        std::unique_lock<std::mutex> lock(exports_mutex);
+        exports_done.wait(lock, [this]{ return exports_running == 0; });
+#endif
+    }
+
+private:
+    // UI widgets
+    Gtk::Box container{Gtk::Orientation::VERTICAL};
+    Gtk::ComboBoxText mode_combo;
+    Gtk::Entry entry;
+
+    Gtk::Box wifi_box{Gtk::Orientation::VERTICAL};
+    Gtk::Entry wifi_ssid, wifi_pass;
+    Gtk::ComboBoxText wifi_enc;
+
+    Gtk::Box vcard_box{Gtk::Orientation::VERTICAL};
+    Gtk::Entry vcard_name, vcard_tel, vcard_email;
+
+    Gtk::Box location_box{Gtk::Orientation::VERTICAL};
+    Gtk::Entry location_lat, location_lon;
+
+    Gtk::ColorButton color_button;
+    Gtk::ComboBoxText shape_combo;
+
+    Gtk::Button logo_btn, btn_save, btn_cancel_export;
+    Gtk::Box export_row{Gtk::Orientation::HORIZONTAL};
+    Gtk::ProgressBar export_progress;
+    std::atomic<bool> export_cancel{false}; // set by btn_cancel_export, read by the export
+    Gtk::CheckButton logo_enable;
+    Glib::RefPtr<Gtk::Adjustment> logo_size_adjustment;
+    Gtk::SpinButton logo_size_spin;
+    Gtk::ProgressBar logo_progress; // shown while a logo file is decoded
+    Glib::RefPtr<Gtk::Adjustment> export_module_adjustment, export_dpi_adjustment;
+    Gtk::SpinButton export_module_spin, export_dpi_spin;
+    Gtk::Label export_size_label; // pixel, print and file size of the export
+    std::shared_ptr<const LogoCache> logo_image; // the selected logo, decoded
+    unsigned logo_image_generation = 0;          // counts the logos loaded, so a new one is told apart
+
+    // A chosen logo file is decoded on logo_thread, which reports through the
+    // dispatchers. Only one load runs at a time; logo_generation tells reports
+    // of a superseded load, still queued on the main loop, apart.
+    std::thread logo_thread;
+    std::atomic<bool> logo_cancel{false};
+    Glib::Dispatcher logo_progress_dispatcher, logo_done_dispatcher;
+    unsigned logo_generation = 0;
+    std::mutex logo_mutex; // guards the fields below, written by logo_thread
+    unsigned logo_progress_generation = 0; // of the load logo_load_fraction is from
+    unsigned logo_load_generation = 0;     // of the finished load in logo_load_result, 0 once taken
+    double logo_load_fraction = 0;
+    std::shared_ptr<const LogoCache> logo_load_result;
+    std::string logo_load_error, logo_load_path;
+
+    Gtk::DrawingArea drawing;
+
+    // The preview is rendered once into preview_surface and only blitted by
+    // on_draw; it is rendered again when anything in preview_key changes.
+    // Its size depends on the integer module size, frame and label height,
+    // so most resize steps just move it.
+    struct PreviewKey {
+        std::string content;
+        uint32_t color = 0;
+        QrRaster::Shape shape = QrRaster::Shape::Square;
+        unsigned logo = 0; // logo_image_generation of the logo shown, 0 if none
+        double logo_percent = 0;
+        int pixels_per_module = 0, frame = 0, label = 0;
+
+        bool operator==(const PreviewKey &o) const {
+            return content == o.content && color == o.color && shape == o.shape &&
+                   logo == o.logo && logo_percent == o.logo_percent &&
+                   pixels_per_module == o.pixels_per_module && frame == o.frame && label == o.label;
+        }
+    };
+    Cairo::RefPtr<Cairo::ImageSurface> preview_surface;
+    PreviewKey preview_key;
+
+    // QR state
+    QrCode qr = QrCode::encodeText(" ", QrCode::Ecc::LOW);
+    std::string last_content;     // what qr encodes
+    std::string requested_content; // the newest content handed to encode_thread
+
+    // Encoding runs on encode_thread, so typing never waits for it. update_qr
+    // leaves the newest content in encode_request; one the thread has not
+    // picked up yet is simply replaced. Each request gets a generation, and a
+    // result older than the one shown is dropped when it arrives.
+    std::thread encode_thread;
+    Glib::Dispatcher encode_dispatcher;
+    std::mutex encode_mutex; // guards the encode_* fields below
+    std::condition_variable encode_wakeup;
+    bool encode_stop = false;
+    unsigned encode_generation = 0;      // of the newest request
+    std::optional<std::string> encode_request;
+    unsigned encode_result_generation = 0;
+    std::optional<QrCode> encode_result; // empty if the content could not be encoded
+    std::string encode_result_content, encode_error;
+    unsigned shown_generation = 0;       // main thread only
+    // module colour (0xRRGGBB) and shape, resolved from the widgets when they change
+    uint32_t module_color = 0x000000;
+    QrRaster::Shape module_shape = QrRaster::Shape::Square;
+
+#if defined(__cpp_impl_coroutine)
+    // An export is encoded and rendered on export_pool and written through
+    // export_io, so saving doesn't block the UI; one runs at a time. It reports
+    // the rows and bytes rendered through export_dispatcher and stops once
+    // export_cancel is set. Print sizes too large to hold in memory are
+    // streamed into their file on the pool instead.
+    QrAsync::ThreadPool export_pool{2};
+    std::unique_ptr<AsyncFileWriter> export_io = AsyncFileWriter::create();
+    static constexpr uint64_t MAX_BUFFERED_EXPORT = 64 << 20; // PNG bytes
+    std::mutex exports_mutex; // guards exports_running and the export_*_done/total fields
+    std::condition_variable exports_done;
+    int exports_running = 0;
+    Glib::Dispatcher export_dispatcher;
+    int export_rows_done = 0, export_rows_total = 0;
+    uint64_t export_bytes_done = 0, export_bytes_total = 0;
+    std::shared_ptr<bool> alive = std::make_shared<bool>(true); // gone once the window is destroyed
+#endif
+
+    // everything an export needs, copied from the widgets on the GTK thread
+    // so the image can be rendered on another one
+    struct ExportJob {
+        std::string content; // what the code encodes
+        uint32_t color;
+        QrRaster::Shape shape;
+        std::shared_ptr<const LogoCache> logo; // null if no logo is shown
+        double logo_percent;
+        int module_pixels;
+        int dpi;
+    };
+
+    // (rows, total rows, bytes, total bytes) done so far; returning false cancels the export
+    using ExportProgress = std::function<bool(int, int, uint64_t, uint64_t)>;
+
+    // --- helpers ---
+    // Build content string from current inputs
+    std::string build_content_from_inputs() {
+        auto mode = mode_combo.get_active_text();
+        if (mode == "Text / URL") {
+            return entry.get_text();
+        } else if (mode == "Wi-Fi") {
+            return QrContent::wifi(wifi_ssid.get_text(), wifi_pass.get_text(), wifi_enc.get_active_text());
+        } else if (mode == "vCard") {
+            return QrContent::vcard(vcard_name.get_text(), vcard_tel.get_text(), vcard_email.get_text());
+        } else if (mode == "Location") {
+            return QrContent::location(location_lat.get_text(), location_lon.get_text());
+        } else if (mode == "Image URL") {
+            return entry.get_text();
+        }
+        return std::string();
+    }
+
+    // --- NEW: update_qr (live preview) ---
+    // hands the content to encode_thread; on_encoded shows the result
+    void update_qr() {
+        std::string content = build_content_from_inputs();
+        if (content.empty()) {
+            // keep previous QR if inputs incomplete, but you can also choose to clear
+            return;
+        }
+        if (content == requested_content) return; // e.g. a mode switched back and forth
+        requested_content = content;
+        {
+            std::lock_guard<std::mutex> lock(encode_mutex);
+            encode_generation++;
+            encode_request = std::move(content);
+        }
+        encode_wakeup.notify_one();
+    }
+
+    // runs on encode_thread: encodes the newest request, then waits for another
+    void encode_loop() {
+        std::unique_lock<std::mutex> lock(encode_mutex);
+        while (true) {
+            encode_wakeup.wait(lock, [this]{ return encode_stop || encode_request; });
+            if (encode_stop) return;
+            std::string content = std::move(*encode_request);
+            encode_request.reset();
+            unsigned generation = encode_generation;
+            lock.unlock();
+
+            std::optional<QrCode> result;
+            std::string error;
+            try {
+                result = QrCode::encodeText(content.c_str(), QrCode::Ecc::MEDIUM);
+            } catch (const std::exception &ex) {
+                error = ex.what();
+            }
+
+            lock.lock();
+            encode_result_generation = generation;
+            encode_result = std::move(result);
+            encode_result_content = std::move(content);
+            encode_error = std::move(error);
+            lock.unlock();
+            encode_dispatcher.emit();
+            lock.lock();
+        }
+    }
+
+    void on_encoded() {
+        std::lock_guard<std::mutex> lock(encode_mutex);
+        if (encode_result_generation <= shown_generation) return; // stale, or already shown
+        shown_generation = encode_result_generation;
+        if (!encode_result) {
+            // don't crash preview on invalid input; show in console
+            std::cerr << "QR encode error: " << encode_error << std::endl;
+            return;
+        }
+        qr = *encode_result;
+        last_content = encode_result_content;
+        update_export_size();
+        drawing.queue_draw();
+    }
+
+    // shows what the export settings produce for the current code
+    void update_export_size() {
+        int module_pixels = export_module_spin.get_value_as_int();
+        int dpi = export_dpi_spin.get_value_as_int();
+        auto [w, h] = QrRaster::imageSize(qr.getSize(), export_style(0, QrRaster::Shape::Square, 0,
+                                                                      module_pixels, dpi));
+        uint64_t bytes = TinyPngOut::encodedSize(w, h) + TinyPngOut::PHYS_CHUNK_SIZE;
+        char text[160];
+        std::snprintf(text, sizeof text, "Export: %d x %d px, %.1f x %.1f cm at %d DPI, %.1f MB",
+                      w, h, w * 2.54 / dpi, h * 2.54 / dpi, dpi, bytes / 1e6);
+        export_size_label.set_text(text);
+    }
+
+    // colour, shape or logo changed: the code stays, only the preview is drawn again
+    void on_style_changed() {
+        module_color = rgb_of(color_button.get_rgba());
+        module_shape = QrRaster::shapeFromName(shape_combo.get_active_text());
+        drawing.queue_draw();
+    }
+
+    // mode changed -> show/hide inputs and update preview
+    void on_mode_changed() {
+        std::string mode = mode_combo.get_active_text();
+        entry.set_visible(mode == "Text / URL" || mode == "Image URL");
+        wifi_box.set_visible(mode == "Wi-Fi");
+        vcard_box.set_visible(mode == "vCard");
+        location_box.set_visible(mode == "Location");
+        update_qr();
+    }
+
+    // select logo (async dialog)
+    void on_select_logo() {
+        auto *dialog = new Gtk::FileChooserDialog("Select Logo", Gtk::FileChooser::Action::OPEN);
+        dialog->set_transient_for(*this);
+        dialog->add_button("_Cancel", Gtk::ResponseType::CANCEL);
+        dialog->add_button("_Open", Gtk::ResponseType::OK);
+
+        auto filter = Gtk::FileFilter::create();
+        filter->set_name("Images");
+        filter->add_mime_type("image/png");
+        filter->add_mime_type("image/jpeg");
+        filter->add_mime_type("image/webp");
+        dialog->add_filter(filter);
+
+        dialog->signal_response().connect([this, dialog](int response){
+            if (response == Gtk::ResponseType::OK) {
+                auto file = dialog->get_file();
+                if (file) start_logo_load(file->get_path());
+            }
+            delete dialog;
+        });
+        dialog->show();
+    }
+
+    // decodes @path on logo_thread; a load still running is cancelled, the newest choice wins
+    void start_logo_load(const std::string &path) {
+        stop_logo_load();
+        logo_cancel = false;
+        unsigned generation = ++logo_generation;
+        logo_progress.set_fraction(0.0);
+        logo_progress.set_text("Loading logo...");
+        logo_progress.set_visible(true);
+        logo_thread = std::thread([this, path, generation]() { load_logo(path, generation); });
+    }
+
+    void stop_logo_load() {
+        if (!logo_thread.joinable()) return;
+        logo_cancel = true;
+        logo_thread.join();
+    }
+
+    // runs on logo_thread: feeds the file to a PixbufLoader in chunks, then builds the premultiplied master
+    void load_logo(const std::string &path, unsigned generation) {
+        std::shared_ptr<const LogoCache> result;
+        std::string error;
+        try {
+            std::ifstream in(path, std::ios::binary | std::ios::ate);
+            if (!in) throw std::runtime_error("cannot open " + path);
+            std::streamoff total = std::max<std::streamoff>(1, in.tellg());
+            in.seekg(0);
+
+            auto loader = Gdk::PixbufLoader::create();
+            std::vector<char> chunk(64 * 1024);
+            std::streamoff done = 0;
+            int reported = -1;
+            while (!logo_cancel) {
+                in.read(chunk.data(), std::streamsize(chunk.size()));
+                std::streamsize n = in.gcount();
+                if (n <= 0) break;
+                loader->write(reinterpret_cast<const guint8*>(chunk.data()), gsize(n));
+                done += n;
+                int percent = int(90 * done / total); // the rest is for building the master
+                if (percent != reported) {
+                    reported = percent;
+                    post_logo_progress(generation, percent / 100.0);
+                }
+            }
+            loader->close();
+            if (logo_cancel) return;
+
+            auto pixbuf = loader->get_pixbuf();
+            if (!pixbuf) throw std::runtime_error("not an image: " + path);
+            result = std::make_shared<const LogoCache>(pixbuf->get_pixels(), pixbuf->get_width(), pixbuf->get_height(),
+                                                       pixbuf->get_rowstride(), pixbuf->get_n_channels());
+        } catch (const Glib::Error &e) {
+            error = e.what();
+        } catch (const std::exception &e) {
+            error = e.what();
+        }
+        if (logo_cancel) return; // superseded: close() fails on the partial data, which is no error to show
+        {
+            std::lock_guard<std::mutex> lock(logo_mutex);
+            logo_load_generation = generation;
+            logo_load_result = std::move(result);
+            logo_load_error = error;
+            logo_load_path = path;
+        }
+        logo_done_dispatcher.emit();
+    }
+
+    void post_logo_progress(unsigned generation, double fraction) {
+        {
+            std::lock_guard<std::mutex> lock(logo_mutex);
+            logo_progress_generation = generation;
+            logo_load_fraction = fraction;
+        }
+        logo_progress_dispatcher.emit();
+    }
+
+    void on_logo_progress() {
+        std::lock_guard<std::mutex> lock(logo_mutex);
+        if (logo_progress_generation == logo_generation)
+            logo_progress.set_fraction(logo_load_fraction);
+    }
+
+    void on_logo_loaded() {
+        std::shared_ptr<const LogoCache> result;
+        std::string error, path;
+        {
+            std::lock_guard<std::mutex> lock(logo_mutex);
+            if (logo_load_generation != logo_generation) return; // superseded meanwhile, or taken already
+            logo_load_generation = 0;
+            result = std::move(logo_load_result);
+            error = logo_load_error;
+            path = logo_load_path;
+        }
+        stop_logo_load(); // the thread is done, this only joins it
+        logo_progress.set_visible(false);
+        if (!result) {
+            show_error("Cannot load logo: " + error);
+            return;
+        }
+        logo_image = std::move(result);
+        logo_image_generation++;
+        logo_enable.set_active(true);
+        drawing.queue_draw();
+        show_info("Logo selected", path);
+    }
+
+    // drawing callback (preview): keeps the QR square and centered, blits the cached image
+    void on_draw(const Cairo::RefPtr<Cairo::Context>& cr, int width, int height) {
+        cr->set_source_rgb(1.0, 1.0, 1.0);
+        cr->paint();
+
+        int modules = qr.getSize();
+        if (modules <= 0) return;
+
+        const int border_modules = 4;
+        PreviewKey key;
+        key.frame = int(std::lround(std::max(8.0, std::min(width, height) * 0.03)));
+        key.label = int(std::lround(std::max(28.0, std::min(width, height) * 0.08)));
+        int side = std::min(width, height) - 2 * key.frame - key.label;
+        if (side <= 0) side = std::min(width, height) - 2 * key.frame;
+        key.pixels_per_module = std::max(1, side / (modules + 2*border_modules));
+
+        key.content = last_content;
+        key.color = module_color;
+        key.shape = module_shape;
+        if (logo_enable.get_active() && logo_image) {
+            key.logo = logo_image_generation;
+            key.logo_percent = logo_size_adjustment->get_value() / 100.0;
+        }
+
+        if (!preview_surface || !(key == preview_key)) {
+            preview_surface = render_preview(key);
+            preview_key = key;
+        }
+        int outWidth = preview_surface->get_width();
+        int outHeight = preview_surface->get_height();
+        cr->set_source(preview_surface, std::floor((width - outWidth) / 2.0), std::floor((height - outHeight) / 2.0));
+        cr->paint();
+    }
+
+    // renders the preview image, sized as on_draw computed in @key, with the export's renderer
+    Cairo::RefPtr<Cairo::ImageSurface> render_preview(const PreviewKey &key) const {
+        QrRaster raster(qr, raster_style(key.color, key.shape, key.logo_percent,
+                                         key.pixels_per_module, key.frame, key.label));
+        if (key.logo) set_raster_logo(raster, *logo_image);
+
+        auto surface = Cairo::ImageSurface::create(Cairo::Surface::Format::ARGB32, raster.width(), raster.height());
+        surface->flush();
+        raster.render(0, raster.height(), reinterpret_cast<uint32_t*>(surface->get_data()), surface->get_stride() / 4);
+        surface->mark_dirty();
+        return surface;
+    }
+
+    // --- save PNG ---
+    void on_save_png() {
+        // ensure we have content
+        if (qr.getSize() <= 0) {
+            show_error("No QR to save.");
+            return;
+        }
+
+        auto *dialog = new Gtk::FileChooserDialog("Save QR Code as PNG", Gtk::FileChooser::Action::SAVE);
+        dialog->set_transient_for(*this);
+        dialog->add_button("_Cancel", Gtk::ResponseType::CANCEL);
+        dialog->add_button("_Save", Gtk::ResponseType::OK);
+
+        auto filter = Gtk::FileFilter::create();
+        filter->set_name("PNG images");
+        filter->add_pattern("*.png");
+        dialog->add_filter(filter);
+
+        dialog->signal_response().connect([this, dialog](int response){
+            if (response == Gtk::ResponseType::OK) {
+                auto file = dialog->get_file();
+                if (file) {
+                    std::string path = file->get_path();
+                    if (path.size() < 4 || path.substr(path.size()-4) != ".png") path += ".png";
+#if defined(__cpp_impl_coroutine)
+                    QrAsync::start(export_png_async(path));
+#else
+                    try {
+                        write_png_file(path);
+                        show_info("Saved", "QR image saved successfully.");
+                    } catch (const std::exception &e) {
+                        show_error(std::string("Failed to save PNG: ") + e.what());
+                    }
+#endif
+                }
+            }
+            delete dialog;
+        });
+        dialog->show();
+    }
+
+#if defined(__cpp_impl_coroutine)
+    // snapshot on the GTK thread, render and write on the pool, report on the GTK thread
+    QrAsync::Task<void> export_png_async(std::string path) {
+        ExportJob job = snapshot_export();
+        std::weak_ptr<bool> window = alive;
+        {
+            std::lock_guard<std::mutex> lock(exports_mutex);
+            exports_running++;
+            export_rows_done = export_rows_total = 0;
+            export_bytes_done = export_bytes_total = 0;
+        }
+        export_cancel = false;
+        btn_save.set_sensitive(false);
+        export_progress.set_fraction(0.0);
+        export_progress.set_text("Exporting...");
+        export_row.set_visible(true);
+
+        ExportProgress progress = [this](int rows, int total_rows, uint64_t bytes, uint64_t total_bytes) {
+            {
+                std::lock_guard<std::mutex> lock(exports_mutex);
+                export_rows_done = rows;
+                export_rows_total = total_rows;
+                export_bytes_done = bytes;
+                export_bytes_total = total_bytes;
+            }
+            export_dispatcher.emit();
+            return !export_cancel;
+        };
+        std::string error;
+        bool saved = false;
+        try {
+            QrCode code = co_await QrAsync::encode(export_pool, job.content, QrCode::Ecc::MEDIUM);
+            if (export_png_size(code, job) <= MAX_BUFFERED_EXPORT) {
+                std::vector<uint8_t> png = co_await render_png(export_pool, code, job, progress);
+                if (!png.empty()) { // empty: cancelled
+                    saved = co_await QrAsync::write(export_pool, *export_io, path, std::move(png));
+                    if (!saved) error = "cannot write " + path;
+                }
+            } else {
+                saved = save_png(code, job, path, progress); // already on the pool
+            }
+        } catch (const std::exception &e) {
+            error = e.what();
+        }
+        {
+            std::lock_guard<std::mutex> lock(exports_mutex);
+            exports_running--;
+            exports_done.notify_all();
+        }
+
+        co_await ResumeOnMainLoop{};
+        if (window.expired()) co_return; // closed meanwhile
+        export_row.set_visible(false);
+        btn_save.set_sensitive(true);
+        if (!error.empty())
+            show_error("Failed to save PNG: " + error);
+        else if (saved)
+            show_info("Saved", "QR image saved successfully.");
+    }
+
+    void on_export_progress() {
+        std::lock_guard<std::mutex> lock(exports_mutex);
+        if (export_bytes_total == 0) return;
+        export_progress.set_fraction(double(export_bytes_done) / double(export_bytes_total));
+        export_progress.set_text("Row " + std::to_string(export_rows_done) + " of " +
+                                 std::to_string(export_rows_total) + ", " +
+                                 std::to_string(export_bytes_done >> 20) + " of " +
+                                 std::to_string(export_bytes_total >> 20) + " MB");
+    }
+
+    // Renders the export image on @pool into memory, for QrAsync::write.
+    // @return the PNG, empty if @progress cancelled it
+    static QrAsync::Task<std::vector<uint8_t>> render_png(QrAsync::ThreadPool &pool, QrCode code, ExportJob job,
+                                                          ExportProgress progress) {
+        co_await pool.schedule();
+        QrRaster raster(code, export_style(job.color, job.shape, job.logo_percent, job.module_pixels, job.dpi));
+        if (job.logo) set_raster_logo(raster, *job.logo);
+        std::vector<uint8_t> png;
+        uint64_t total = raster.pngSize();
+        png.reserve(total);
+        VectorSink sink(png);
+        if (!raster.writePng(sink, [&](int rows) { return progress(rows, raster.height(), png.size(), total); }))
+            png.clear();
+        co_return png;
+    }
+
+    static uint64_t export_png_size(const QrCode &code, const ExportJob &job) {
+        auto [w, h] = QrRaster::imageSize(code.getSize(), export_style(job.color, job.shape, job.logo_percent,
+                                                                       job.module_pixels, job.dpi));
+        return TinyPngOut::encodedSize(w, h) + TinyPngOut::PHYS_CHUNK_SIZE;
+    }
+#endif
+
+
+    ExportJob snapshot_export() const {
+        return ExportJob{last_content, module_color, module_shape,
+                         logo_enable.get_active() ? logo_image : std::shared_ptr<const LogoCache>(),
+                         logo_size_adjustment->get_value() / 100.0,
+                         export_module_spin.get_value_as_int(), export_dpi_spin.get_value_as_int()};
+    }
+
+    void write_png_file(const std::string &filename) {
+        ExportJob job = snapshot_export();
+        save_png(QrCode::encodeText(job.content.c_str(), QrCode::Ecc::MEDIUM), job, filename, nullptr);
+    }
+
+    // Renders the export image of @code and streams it into @path (print sizes, and saving
+    // without coroutines); touches no widgets, so it can run on any thread. QrRaster draws it
+    // in bands of rows that TinyPngOut encodes straight into the file, without Cairo and
+    // without holding the image, so memory stays at about one band (a megabyte of pixels). The PNG is written to "@path.part" and
+    // renamed over @path once complete, so a failed or cancelled export leaves no broken file.
+    // @return false if @progress cancelled it
+    static bool save_png(const QrCode &code, const ExportJob &job, const std::string &path,
+                         const ExportProgress &progress) {
+        if (code.getSize() <= 0) throw std::runtime_error("No QR code generated.");
+
+        QrRaster raster(code, export_style(job.color, job.shape, job.logo_percent, job.module_pixels, job.dpi));
+        if (job.logo) set_raster_logo(raster, *job.logo);
+
+        std::string part = path + ".part";
+        std::FILE *file = std::fopen(part.c_str(), "wb");
+        if (!file) throw std::runtime_error("cannot create " + part);
+        bool complete;
+        try {
+            FileSink file_sink(file);
+            CountingSink sink(file_sink);
+            uint64_t total = raster.pngSize();
+            complete = raster.writePng(sink, [&](int rows) {
+                return !progress || progress(rows, raster.height(), sink.count, total);
+            });
+        } catch (...) {
+            std::fclose(file);
+            std::remove(part.c_str());
+            throw;
+        }
+        if (std::fclose(file) != 0 && complete) {
+            std::remove(part.c_str());
+            throw std::runtime_error("cannot write " + part);
+        }
+        if (!complete) {
+            std::remove(part.c_str());
+            return false;
+        }
+        try {
+            std::filesystem::rename(part, path); // replaces an existing file, also on Windows
+        } catch (...) {
+            std::remove(part.c_str());
+            throw;
+        }
+        return true;
+    }
+
+    // dialogs
+    void show_error(const std::string &msg) {
+        auto *d = new Gtk::MessageDialog(*this, "Error", false, Gtk::MessageType::ERROR);
+        d->set_secondary_text(msg);
+        d->add_button("OK", Gtk::ResponseType::OK);
+        d->signal_response().connect([d](int){ delete d; });
+        d->show();
+    }
+    void show_info(const std::string &title, const std::string &msg) {
+        auto *d = new Gtk::MessageDialog(*this, title, false, Gtk::MessageType::INFO);
+        d->set_secondary_text(msg);
+        d->add_button("OK", Gtk::ResponseType::OK);
+        d->signal_response().connect([d](int){ delete d; });
+        d->show();
+    }
+};
+
+int main(int argc, char *argv[]) {
+    auto app = Gtk::Application::create("org.example.qrgtkmm");
+    return app->make_window_and_run<QRWindow>(argc, argv);
+}
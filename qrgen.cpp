@@ -0,0 +1,535 @@
+// qrgen.cpp
+// Headless QR code generator: the QrCode / QrToPng / TinyPngOut core without any GUI.
+// Compile with (every .cpp except main.cpp):
+// g++ qrgen.cpp ArchiveOutput.cpp BatchFileWriter.cpp BulkOutput.cpp BulkRunner.cpp ContentHash.cpp IoUring.cpp Manifest.cpp
+//     MappedFile.cpp Coordinator.cpp PipeRunner.cpp QrContent.cpp QrRender.cpp QrServer.cpp QrToPng.cpp TinyPngOut.cpp
+//     BandedPngOut.cpp ByteSink.cpp PngChecksum.cpp AtomicFile.cpp AsyncFileWriter.cpp QrAsync.cpp QrCode.cpp QrOutline.cpp -o qrgen -std=c++17 -O2 -pthread
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#define isatty _isatty
+#else
+#include <unistd.h>
+#endif
+
+#include "ArchiveOutput.hpp"
+#include "AtomicFile.hpp"
+#include "BulkRunner.hpp"
+#include "ContentHash.hpp"
+#include "Coordinator.hpp"
+#include "PipeRunner.hpp"
+#include "QrRender.hpp"
+#include "QrServer.hpp"
+#include "QrToPng.h"
+
+using qrcodegen::QrCode;
+
+namespace {
+
+struct Options {
+    std::string text;
+    QrRenderSettings render;  // format empty = from output name
+    std::string output = "-"; // "-" is stdout
+    bool overwrite = true;
+    bool force = false;         // rewrite outputs that already hold the same image
+
+    // bulk mode
+    std::string manifest;
+    std::string manifestFormat; // "csv" or "ndjson", empty = from manifest name
+    std::string outDir = ".";
+    std::string archive;        // write into this tar/zip instead of outDir
+    uint64_t shardSize = 0;     // start a new archive beyond this many bytes, 0 = never
+    int jobs = 0;
+    int queueDepth = 256;
+    std::string io = "auto";    // how image files are written: auto, uring or sync
+    int ioDepth = 64;           // files in flight with io_uring
+    bool fsync = false;
+    bool dedup = true;
+    bool quiet = false;
+    std::string statsFile;      // also write the totals here
+    std::string indexFile;      // write this run's index entries here instead of updating the directory's
+
+    // coordinator mode
+    int workers = 0;            // worker processes, 0 = bulk run in this process
+    int shards = 0;
+    std::string launcher;
+    std::string workDir;
+    std::string program;        // this executable, for the workers
+
+    // server mode
+    std::string serve;          // listen address
+
+    // pipe mode
+    bool pipe = false;
+    PipeOptions pipeOptions;
+};
+
+void print_usage(std::ostream &os) {
+    os << "Usage: qrgen [options] [TEXT]\n"
+          "  -t, --text TEXT        text to encode (or give it as the last argument)\n"
+          "  -e, --ecc L|M|Q|H      error correction level (default M)\n"
+          "  -s, --size N           max image width/height in pixels (default 300)\n"
+          "  -m, --module-px N      minimum pixels per module (default 1)\n"
+          "  -f, --format png|svg   output format (default: from file extension, else png)\n"
+          "  -o, --output FILE      output file, '-' for stdout (default -)\n"
+          "      --svg-border N     quiet zone in modules for SVG output (default 4)\n"
+          "      --no-clobber       fail instead of replacing an existing file\n"
+          "      --force            rewrite files that already hold the same image\n"
+          "  -h, --help             show this help\n"
+          "\n"
+          "Bulk mode, one image per manifest entry:\n"
+          "      --manifest FILE    CSV (name,text) or NDJSON ({\"name\":..,\"text\":..}) manifest\n"
+          "      --manifest-format csv|ndjson  (default: from file extension)\n"
+          "  -d, --out-dir DIR      directory for the images (default .)\n"
+          "  -a, --archive FILE     stream the images into FILE.tar or FILE.zip instead\n"
+          "      --shard-size N     start a new archive before it exceeds N bytes (k/M/G suffixes)\n"
+          "  -j, --jobs N           encoder threads (default: one per core)\n"
+          "      --queue N          max items between pipeline stages (default 256)\n"
+          "      --no-dedup         render identical entries separately instead of linking them\n"
+          "      --io auto|uring|sync  write image files through io_uring in batches (Linux 5.19+)\n"
+          "                         or one by one (default auto: io_uring if available)\n"
+          "      --io-depth N       files in flight with io_uring (default 64)\n"
+          "      --fsync            flush every image file to disk before counting it written\n"
+          "  -q, --quiet            no progress output\n"
+          "      --stats-file FILE  also write the totals to FILE\n"
+          "\n"
+          "Coordinator mode, the manifest split by name over worker processes:\n"
+          "  -w, --workers N        run N qrgen workers at a time (with --manifest)\n"
+          "      --shards N         split the manifest into N shards (default: one per worker)\n"
+          "      --launcher CMD     run each worker through CMD, e.g. \"ssh node{shard} {cmd}\"\n"
+          "      --work-dir DIR     shard manifests, logs and the journal used to resume\n"
+          "                         (default DIR/.qrgen-work or ARCHIVE.qrgen-work)\n"
+          "\n"
+          "Server mode (Linux), GET /qr?data=TEXT&ecc=M&size=300&fmt=png|svg:\n"
+          "      --serve ADDR       listen on HOST:PORT, :PORT or unix:PATH until interrupted;\n"
+          "                         -e/-s/-m/--svg-border set the defaults, -j the render threads\n"
+          "\n"
+          "Pipe mode, one result per stdin record, in input order:\n"
+          "      --pipe             read newline-delimited records from stdin, write results to stdout\n"
+          "  -0, --null             records are NUL-delimited instead\n"
+          "      --content text|wifi|vcard|location\n"
+          "                         record is the text, or tab-separated fields: SSID, password,\n"
+          "                         encryption / name, phone, email / latitude, longitude\n"
+          "      --emit png|base64|svg|bitmap  (default png; bitmap is 1 byte per module)\n"
+          "      --framing ndjson|length  one JSON object per line (default), or a 4-byte\n"
+          "                         big-endian length before each result (0 = failed)\n"
+          "                         -e/-s/-m/--svg-border/-j/--queue apply as above\n";
+}
+
+bool parse_ecc(const std::string &s, QrCode::Ecc &ecc) {
+    if (s == "L" || s == "l" || s == "low") ecc = QrCode::Ecc::LOW;
+    else if (s == "M" || s == "m" || s == "medium") ecc = QrCode::Ecc::MEDIUM;
+    else if (s == "Q" || s == "q" || s == "quartile") ecc = QrCode::Ecc::QUARTILE;
+    else if (s == "H" || s == "h" || s == "high") ecc = QrCode::Ecc::HIGH;
+    else return false;
+    return true;
+}
+
+bool parse_int(const std::string &s, int &value) {
+    char *end = nullptr;
+    long v = std::strtol(s.c_str(), &end, 10);
+    if (s.empty() || *end != '\0' || v < 0 || v > 1000000000L) return false;
+    value = static_cast<int>(v);
+    return true;
+}
+
+bool parse_size(const std::string &s, uint64_t &value) {
+    char *end = nullptr;
+    unsigned long long v = std::strtoull(s.c_str(), &end, 10);
+    if (s.empty() || end == s.c_str()) return false;
+    std::string suffix(end);
+    if (suffix == "k" || suffix == "K") v <<= 10;
+    else if (suffix == "m" || suffix == "M") v <<= 20;
+    else if (suffix == "g" || suffix == "G") v <<= 30;
+    else if (!suffix.empty()) return false;
+    value = v;
+    return true;
+}
+
+bool ends_with(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// returns 0 on success, otherwise the exit code
+int parse_args(int argc, char *argv[], Options &opt) {
+    bool explicitFormat = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](std::string &out) {
+            if (i + 1 >= argc) {
+                std::cerr << "qrgen: " << arg << " needs a value" << std::endl;
+                return false;
+            }
+            out = argv[++i];
+            return true;
+        };
+        std::string v;
+        if (arg == "-h" || arg == "--help") {
+            print_usage(std::cout);
+            std::exit(0);
+        } else if (arg == "-t" || arg == "--text") {
+            if (!value(opt.text)) return 2;
+        } else if (arg == "-e" || arg == "--ecc") {
+            if (!value(v)) return 2;
+            if (!parse_ecc(v, opt.render.ecc)) { std::cerr << "qrgen: bad ECC level: " << v << std::endl; return 2; }
+        } else if (arg == "-s" || arg == "--size") {
+            if (!value(v)) return 2;
+            if (!parse_int(v, opt.render.size) || opt.render.size == 0) { std::cerr << "qrgen: bad size: " << v << std::endl; return 2; }
+        } else if (arg == "-m" || arg == "--module-px") {
+            if (!value(v)) return 2;
+            if (!parse_int(v, opt.render.modulePixels)) { std::cerr << "qrgen: bad module size: " << v << std::endl; return 2; }
+        } else if (arg == "-f" || arg == "--format") {
+            if (!value(opt.render.format)) return 2;
+            explicitFormat = true;
+            if (opt.render.format != "png" && opt.render.format != "svg") { std::cerr << "qrgen: bad format: " << opt.render.format << std::endl; return 2; }
+        } else if (arg == "-o" || arg == "--output") {
+            if (!value(opt.output)) return 2;
+        } else if (arg == "--svg-border") {
+            if (!value(v)) return 2;
+            if (!parse_int(v, opt.render.svgBorder)) { std::cerr << "qrgen: bad border: " << v << std::endl; return 2; }
+        } else if (arg == "--no-clobber") {
+            opt.overwrite = false;
+        } else if (arg == "--force") {
+            opt.force = true;
+        } else if (arg == "--manifest") {
+            if (!value(opt.manifest)) return 2;
+        } else if (arg == "--manifest-format") {
+            if (!value(opt.manifestFormat)) return 2;
+            if (opt.manifestFormat != "csv" && opt.manifestFormat != "ndjson") { std::cerr << "qrgen: bad manifest format: " << opt.manifestFormat << std::endl; return 2; }
+        } else if (arg == "-d" || arg == "--out-dir") {
+            if (!value(opt.outDir)) return 2;
+        } else if (arg == "-a" || arg == "--archive") {
+            if (!value(opt.archive)) return 2;
+        } else if (arg == "--shard-size") {
+            if (!value(v)) return 2;
+            if (!parse_size(v, opt.shardSize)) { std::cerr << "qrgen: bad shard size: " << v << std::endl; return 2; }
+        } else if (arg == "-j" || arg == "--jobs") {
+            if (!value(v)) return 2;
+            if (!parse_int(v, opt.jobs)) { std::cerr << "qrgen: bad job count: " << v << std::endl; return 2; }
+        } else if (arg == "--queue") {
+            if (!value(v)) return 2;
+            if (!parse_int(v, opt.queueDepth) || opt.queueDepth == 0) { std::cerr << "qrgen: bad queue depth: " << v << std::endl; return 2; }
+        } else if (arg == "--io") {
+            if (!value(opt.io)) return 2;
+            if (opt.io != "auto" && opt.io != "uring" && opt.io != "sync") { std::cerr << "qrgen: bad io mode: " << opt.io << std::endl; return 2; }
+        } else if (arg == "--io-depth") {
+            if (!value(v)) return 2;
+            if (!parse_int(v, opt.ioDepth) || opt.ioDepth == 0 || opt.ioDepth > 4096) { std::cerr << "qrgen: bad io depth: " << v << std::endl; return 2; }
+        } else if (arg == "--fsync") {
+            opt.fsync = true;
+        } else if (arg == "--serve") {
+            if (!value(opt.serve)) return 2;
+        } else if (arg == "--stats-file") {
+            if (!value(opt.statsFile)) return 2;
+        } else if (arg == "--index-file") {
+            if (!value(opt.indexFile)) return 2;
+        } else if (arg == "-w" || arg == "--workers") {
+            if (!value(v)) return 2;
+            if (!parse_int(v, opt.workers) || opt.workers == 0) { std::cerr << "qrgen: bad worker count: " << v << std::endl; return 2; }
+        } else if (arg == "--shards") {
+            if (!value(v)) return 2;
+            if (!parse_int(v, opt.shards) || opt.shards == 0) { std::cerr << "qrgen: bad shard count: " << v << std::endl; return 2; }
+        } else if (arg == "--launcher") {
+            if (!value(opt.launcher)) return 2;
+        } else if (arg == "--work-dir") {
+            if (!value(opt.workDir)) return 2;
+        } else if (arg == "--pipe") {
+            opt.pipe = true;
+        } else if (arg == "-0" || arg == "--null") {
+            opt.pipeOptions.delimiter = '\0';
+        } else if (arg == "--content") {
+            if (!value(v)) return 2;
+            if (v == "text") opt.pipeOptions.content = PipeOptions::Content::Text;
+            else if (v == "wifi") opt.pipeOptions.content = PipeOptions::Content::Wifi;
+            else if (v == "vcard") opt.pipeOptions.content = PipeOptions::Content::Vcard;
+            else if (v == "location") opt.pipeOptions.content = PipeOptions::Content::Location;
+            else { std::cerr << "qrgen: bad content type: " << v << std::endl; return 2; }
+        } else if (arg == "--emit") {
+            if (!value(v)) return 2;
+            if (v == "png") opt.pipeOptions.emit = PipeOptions::Emit::Png;
+            else if (v == "base64") opt.pipeOptions.emit = PipeOptions::Emit::PngBase64;
+            else if (v == "svg") opt.pipeOptions.emit = PipeOptions::Emit::Svg;
+            else if (v == "bitmap") opt.pipeOptions.emit = PipeOptions::Emit::Bitmap;
+            else { std::cerr << "qrgen: bad emit format: " << v << std::endl; return 2; }
+        } else if (arg == "--framing") {
+            if (!value(v)) return 2;
+            if (v == "ndjson") opt.pipeOptions.framing = PipeOptions::Framing::Ndjson;
+            else if (v == "length") opt.pipeOptions.framing = PipeOptions::Framing::Length;
+            else { std::cerr << "qrgen: bad framing: " << v << std::endl; return 2; }
+        } else if (arg == "--no-dedup") {
+            opt.dedup = false;
+        } else if (arg == "-q" || arg == "--quiet") {
+            opt.quiet = true;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            std::cerr << "qrgen: unknown option: " << arg << std::endl;
+            return 2;
+        } else {
+            opt.text = arg;
+        }
+    }
+
+    if (!explicitFormat)
+        opt.render.format = ends_with(opt.output, ".svg") ? "svg" : "png";
+    return 0;
+}
+
+// to stdout for "-", else through a temp file renamed into place (AtomicFile), like QrToPng does;
+// that also gives a file hard linked from a bulk run a new inode instead of changing all links
+bool write_bytes(const std::string &path, const void *data, size_t len, bool overwrite) {
+    if (path == "-") {
+#if defined(_WIN32)
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        return std::fwrite(data, 1, len, stdout) == len && std::fflush(stdout) == 0;
+    }
+    return AtomicFile::write(path, overwrite, false, [data, len](ByteSink &out) {
+        out.write(static_cast<const uint8_t *>(data), len);
+        return true;
+    });
+}
+
+int write_svg(const Options &opt) {
+    if (!opt.overwrite && opt.output != "-" && fs::exists(opt.output)) {
+        std::cerr << "qrgen: " << opt.output << " already exists" << std::endl;
+        return 1;
+    }
+    if (!opt.force && opt.output != "-" && ContentHash::readEmbedded(opt.output) == opt.render.contentHash(opt.text))
+        return 0; // already up to date
+
+    std::vector<uint8_t> svg;
+    std::string error;
+    if (!renderQr(opt.text, opt.render, svg, &error)) {
+        std::cerr << "qrgen: " << error << std::endl;
+        return 1;
+    }
+    if (!write_bytes(opt.output, svg.data(), svg.size(), opt.overwrite)) {
+        std::cerr << "qrgen: failed to write " << opt.output << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int write_png(const Options &opt) {
+    if (opt.output == "-") {
+        QrToPng png(opt.render.size, opt.render.modulePixels, opt.text, opt.render.ecc);
+        std::vector<uint8_t> buffer;
+        if (!png.encodeToBuffer(buffer)) {
+            std::cerr << "qrgen: text does not fit the image size / module size" << std::endl;
+            return 1;
+        }
+        return write_bytes(opt.output, buffer.data(), buffer.size(), true) ? 0 : 1;
+    }
+
+    QrToPng png(opt.output, opt.render.size, opt.render.modulePixels, opt.text, opt.overwrite, opt.render.ecc);
+    png.setSkipUnchanged(!opt.force);
+    if (!png.writeToPNG()) {
+        std::cerr << "qrgen: failed to write " << opt.output << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int run_bulk(const Options &opt) {
+    BulkOptions bulk;
+    bulk.manifestPath = opt.manifest;
+    if (opt.manifestFormat.empty())
+        bulk.format = ManifestReader::formatFor(opt.manifest);
+    else
+        bulk.format = opt.manifestFormat == "ndjson" ? ManifestReader::Format::Ndjson : ManifestReader::Format::Csv;
+    bulk.render = opt.render;
+    bulk.jobs = static_cast<unsigned>(opt.jobs);
+    bulk.queueDepth = static_cast<size_t>(opt.queueDepth);
+    bulk.progress = !opt.quiet && isatty(2); // a \r progress line only makes sense on a terminal
+    bulk.skipUnchanged = !opt.force;
+    bulk.dedup = opt.dedup;
+
+    try {
+        std::unique_ptr<BulkOutput> output;
+        if (opt.archive.empty()) {
+            auto directory = std::make_unique<DirectoryOutput>(opt.outDir, opt.overwrite);
+            if (!opt.indexFile.empty())
+                directory->setPartialIndex(opt.indexFile);
+            std::string backend = directory->setBatchedWrites(opt.io != "sync", static_cast<unsigned>(opt.ioDepth), opt.fsync);
+            if (opt.io == "uring" && backend != "io_uring")
+                std::cerr << "qrgen: io_uring not available, writing files one by one" << std::endl;
+            output = std::move(directory);
+        } else {
+            output = ArchiveOutput::create(ArchiveOutput::formatFor(opt.archive), opt.archive, opt.shardSize);
+        }
+        BulkStats stats = BulkRunner(bulk, *output).run();
+        if (!opt.statsFile.empty() && !Coordinator::writeStats(opt.statsFile, stats)) {
+            std::cerr << "qrgen: failed to write " << opt.statsFile << std::endl;
+            return 1;
+        }
+        if (!opt.quiet)
+            std::fprintf(stderr, "%llu rows, %llu written (%llu bytes), %llu unchanged, %llu linked, %llu failed"
+                                 " in %.2f s, %.0f items/s\n",
+                         static_cast<unsigned long long>(stats.rows), static_cast<unsigned long long>(stats.written),
+                         static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.unchanged),
+                         static_cast<unsigned long long>(stats.linked), static_cast<unsigned long long>(stats.failed),
+                         stats.seconds, stats.itemsPerSecond());
+        return stats.failed == 0 ? 0 : 1;
+    } catch (const std::exception &e) {
+        std::cerr << "qrgen: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+const char *ecc_name(QrCode::Ecc ecc) {
+    switch (ecc) {
+        case QrCode::Ecc::LOW: return "L";
+        case QrCode::Ecc::QUARTILE: return "Q";
+        case QrCode::Ecc::HIGH: return "H";
+        default: return "M";
+    }
+}
+
+int run_coordinator(const Options &opt) {
+    CoordinatorOptions co;
+    co.manifestPath = opt.manifest;
+    if (opt.manifestFormat.empty())
+        co.format = ManifestReader::formatFor(opt.manifest);
+    else
+        co.format = opt.manifestFormat == "ndjson" ? ManifestReader::Format::Ndjson : ManifestReader::Format::Csv;
+    co.workerProgram = opt.program;
+    co.outDir = opt.outDir;
+    co.archive = opt.archive;
+    co.workDir = opt.workDir;
+    co.workers = static_cast<unsigned>(opt.workers);
+    co.shards = static_cast<unsigned>(opt.shards);
+    co.launcher = opt.launcher;
+    co.progress = !opt.quiet;
+
+    int jobs = opt.jobs;
+    if (jobs == 0 && opt.launcher.empty()) // local workers share this machine's cores
+        jobs = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / opt.workers);
+    co.workerArgs = {"--ecc", ecc_name(opt.render.ecc), "--size", std::to_string(opt.render.size),
+                     "--module-px", std::to_string(opt.render.modulePixels), "--format", opt.render.format,
+                     "--svg-border", std::to_string(opt.render.svgBorder)};
+    co.tuningArgs = {"--queue", std::to_string(opt.queueDepth), "--io", opt.io, "--io-depth", std::to_string(opt.ioDepth)};
+    if (opt.fsync) co.tuningArgs.emplace_back("--fsync");
+    if (jobs > 0) {
+        co.tuningArgs.emplace_back("--jobs");
+        co.tuningArgs.push_back(std::to_string(jobs));
+    }
+    if (opt.shardSize > 0) {
+        co.workerArgs.emplace_back("--shard-size");
+        co.workerArgs.push_back(std::to_string(opt.shardSize));
+    }
+    if (!opt.overwrite) co.workerArgs.emplace_back("--no-clobber");
+    if (opt.force) co.workerArgs.emplace_back("--force");
+    if (!opt.dedup) co.workerArgs.emplace_back("--no-dedup");
+
+    try {
+        Coordinator coordinator(co);
+        BulkStats stats = coordinator.run();
+        if (!opt.statsFile.empty() && !Coordinator::writeStats(opt.statsFile, stats))
+            std::cerr << "qrgen: failed to write " << opt.statsFile << std::endl;
+        if (!opt.quiet) {
+            std::fprintf(stderr, "%llu rows, %llu written (%llu bytes), %llu unchanged, %llu linked, %llu failed"
+                                 " in %.2f s, %.0f items/s; %u shards failed\n",
+                         static_cast<unsigned long long>(stats.rows), static_cast<unsigned long long>(stats.written),
+                         static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.unchanged),
+                         static_cast<unsigned long long>(stats.linked), static_cast<unsigned long long>(stats.failed),
+                         stats.seconds, stats.itemsPerSecond(), coordinator.shardsFailed());
+            if (coordinator.shardsResumed() > 0) {
+                const BulkStats &resumed = coordinator.resumedStats();
+                std::fprintf(stderr, "%u shards resumed, finished by an earlier run: %llu rows, %llu written\n",
+                             coordinator.shardsResumed(), static_cast<unsigned long long>(resumed.rows),
+                             static_cast<unsigned long long>(resumed.written));
+            }
+        }
+        return stats.failed == 0 && coordinator.shardsFailed() == 0 ? 0 : 1;
+    } catch (const std::exception &e) {
+        std::cerr << "qrgen: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+int run_server(const Options &opt) {
+    ServerOptions server;
+    server.listen = opt.serve;
+    server.defaults = opt.render;
+    server.workers = static_cast<unsigned>(opt.jobs);
+    server.quiet = opt.quiet;
+    try {
+        QrServer qrServer(server);
+        qrServer.run();
+        if (!opt.quiet)
+            std::cerr << "qrgen: " << qrServer.requestsServed() << " requests served" << std::endl;
+        return 0;
+    } catch (const std::exception &e) {
+        std::cerr << "qrgen: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+int run_pipe(const Options &opt) {
+#if defined(_WIN32)
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    PipeOptions pipe = opt.pipeOptions;
+    pipe.render = opt.render;
+    pipe.jobs = static_cast<unsigned>(opt.jobs);
+    pipe.window = static_cast<size_t>(opt.queueDepth);
+    try {
+        PipeStats stats = PipeRunner(pipe, stdin, stdout).run();
+        if (!opt.quiet && stats.failed > 0)
+            std::fprintf(stderr, "qrgen: %llu of %llu records failed\n", static_cast<unsigned long long>(stats.failed),
+                         static_cast<unsigned long long>(stats.records));
+        return stats.failed == 0 ? 0 : 1;
+    } catch (const std::exception &e) {
+        std::cerr << "qrgen: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+// the workers run the same executable
+std::string self_path(const char *argv0) {
+    std::error_code ec;
+#if defined(__linux__)
+    fs::path self = fs::read_symlink("/proc/self/exe", ec);
+    if (!ec)
+        return self.string();
+#endif
+    fs::path path(argv0);
+    if (!path.has_parent_path())
+        return argv0; // found through PATH, the shell will find it again
+    path = fs::absolute(path, ec);
+    return ec ? argv0 : path.string();
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (int rc = parse_args(argc, argv, opt))
+        return rc;
+    if (!opt.serve.empty())
+        return run_server(opt);
+    if (opt.pipe)
+        return run_pipe(opt);
+    if (!opt.manifest.empty() && opt.workers > 0) {
+        opt.program = self_path(argv[0]);
+        return run_coordinator(opt);
+    }
+    if (!opt.manifest.empty())
+        return run_bulk(opt);
+    if (opt.text.empty()) {
+        print_usage(std::cerr);
+        return 2;
+    }
+    return opt.render.format == "svg" ? write_svg(opt) : write_png(opt);
+}